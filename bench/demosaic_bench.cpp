@@ -0,0 +1,153 @@
+// Verifies the demosaic engine against the scalar reference and measures its
+// throughput for every method, instruction set and thread count.
+//
+// Exits with non-zero status when any optimized output differs from the
+// reference.
+
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+#include "demosaic.hpp"
+#include "scheduling.hpp"
+
+// deterministic pseudo random Bayer content with smooth areas, hard edges and noise
+static std::vector<uint8_t> BayerImage(size_t width, size_t height, size_t bytes_per_pixel, uint32_t seed) {
+  std::vector<uint8_t> image(width * height * bytes_per_pixel);
+  uint32_t state = seed | 1;
+
+  for(size_t y = 0; y < height; y++) {
+    for(size_t x = 0; x < width; x++) {
+      state ^= state << 13;
+      state ^= state >> 17;
+      state ^= state << 5;
+
+      uint32_t value = (x * 255 / width + y * 128 / height) / 2;
+      if(((x / 7) + (y / 5)) % 3 == 0) {
+        value = 255 - value;
+      }
+      value = (value + (state & 0x1F)) & 0xFF;
+
+      if(bytes_per_pixel == 2) {
+        uint16_t sample = (value << 8) | (state >> 24);
+        memcpy(&image[(y * width + x) * 2], &sample, 2);
+      }
+      else {
+        image[y * width + x] = value;
+      }
+    }
+  }
+
+  return image;
+}
+
+static bool Verify() {
+  const size_t sizes[][2] = { {2, 2}, {3, 5}, {17, 3}, {33, 9}, {64, 48}, {1001, 333}, {1920, 1080} };
+  const PixelFormat formats[] = {
+    PixelFormat::BayerRG8, PixelFormat::BayerGR8, PixelFormat::BayerGB8, PixelFormat::BayerBG8,
+    PixelFormat::BayerRG16, PixelFormat::BayerBG16, PixelFormat::Mono8, PixelFormat::Mono16
+  };
+  const DemosaicMethod methods[] = { DemosaicMethod::Bilinear, DemosaicMethod::EdgeAware };
+  const SimdLevel best = DetectSimdLevel();
+  const int thread_counts[] = { 1, 3 };
+
+  bool ok = true;
+  size_t checks = 0;
+
+  for(auto& size : sizes) {
+    size_t width = size[0];
+    size_t height = size[1];
+
+    for(PixelFormat pixel_format : formats) {
+      size_t bytes_per_pixel = BytesPerPixel(pixel_format);
+      std::vector<uint8_t> input = BayerImage(width, height, bytes_per_pixel, width * 31 + height);
+
+      for(DemosaicMethod method : methods) {
+        std::vector<uint8_t> expected(width * height * 3);
+        DemosaicReference(input.data(), width, height, width * bytes_per_pixel, pixel_format, method, expected.data(), width * 3);
+
+        for(int simd = (int)SimdLevel::Scalar; simd <= (int)best; simd++) {
+          for(int threads : thread_counts) {
+            Demosaicer demosaicer(method, threads, (SimdLevel)simd);
+            std::vector<uint8_t> output(width * height * 3, 0xAA);
+            demosaicer.Process(input.data(), width, height, width * bytes_per_pixel, pixel_format, output.data(), width * 3);
+            checks++;
+
+            for(size_t i = 0; i < output.size(); i++) {
+              if(output[i] != expected[i]) {
+                size_t pixel = i / 3;
+                std::cout << "MISMATCH " << PixelFormatName(pixel_format) << " " << width << "x" << height <<
+                    " " << DemosaicMethodName(method) << " " << SimdLevelName((SimdLevel)simd) <<
+                    " threads " << threads << " at x " << pixel % width << " y " << pixel / width <<
+                    " channel " << i % 3 << ": " << (int)output[i] << " != " << (int)expected[i] << std::endl;
+                ok = false;
+                break;
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+
+  std::cout << "verified " << checks << " configurations against reference: " << (ok ? "ok" : "FAILED") << std::endl;
+  return ok;
+}
+
+static void Measure(size_t width, size_t height) {
+  const DemosaicMethod methods[] = { DemosaicMethod::Bilinear, DemosaicMethod::EdgeAware };
+  const SimdLevel best = DetectSimdLevel();
+  const double MEASURE_SECONDS = 1.0;
+
+  std::vector<uint8_t> input = BayerImage(width, height, 1, 7);
+  std::vector<uint8_t> output(width * height * 3);
+  std::vector<int> thread_counts = { 1 };
+  if(CpuCount() > 1) {
+    thread_counts.push_back(CpuCount());
+  }
+
+  std::cout << "throughput for " << width << "x" << height << " BayerRG8 -> BGR8" << std::endl;
+
+  for(DemosaicMethod method : methods) {
+    for(int simd = (int)SimdLevel::Scalar; simd <= (int)best; simd++) {
+      for(int threads : thread_counts) {
+        Demosaicer demosaicer(method, threads, (SimdLevel)simd);
+
+        // warm up caches and workers
+        demosaicer.Process(input.data(), width, height, width, PixelFormat::BayerRG8, output.data(), width * 3);
+
+        size_t frames = 0;
+        auto begin = std::chrono::steady_clock::now();
+        double elapsed = 0;
+
+        while(elapsed < MEASURE_SECONDS) {
+          demosaicer.Process(input.data(), width, height, width, PixelFormat::BayerRG8, output.data(), width * 3);
+          frames++;
+          elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        }
+
+        double megapixels = (double)width * height * frames / 1e6 / elapsed;
+
+        std::cout << "  " << std::left << std::setw(11) << DemosaicMethodName(method) <<
+            std::setw(8) << SimdLevelName((SimdLevel)simd) <<
+            "threads " << std::setw(3) << threads <<
+            std::right << std::fixed << std::setprecision(1) << std::setw(9) << megapixels << " MP/s" <<
+            std::setw(8) << frames / elapsed << " fps" << std::endl;
+      }
+    }
+  }
+}
+
+int main() {
+  std::cout << "cpu simd level: " << SimdLevelName(DetectSimdLevel()) << std::endl;
+
+  if(!Verify()) {
+    return 1;
+  }
+
+  // typical 5 MP machine vision sensor
+  Measure(2448, 2048);
+
+  return 0;
+}
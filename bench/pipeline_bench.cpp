@@ -0,0 +1,539 @@
+// Microbenchmarks for the capture to sink hot path: frame queue handoff,
+// frame copy and allocation, pixel format conversion, previews, exposure statistics, motion scoring, shared
+// memory publishing and the whole pipeline from a synthetic source through the
+// conversion pool.
+//
+// No camera is needed. Results are printed as JSON (frames/s, MB/s and
+// latency percentiles per benchmark) so runs can be compared across commits.
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+#include "clock.hpp"
+#include "conversion_pool.hpp"
+#include "demosaic.hpp"
+#include "frame_pool.hpp"
+#include "frame_queue.hpp"
+#include "histogram.hpp"
+#include "image_stats.hpp"
+#include "motion_detector.hpp"
+#include "preview.hpp"
+#include "scheduling.hpp"
+#include "shm_publisher.hpp"
+#include "shm_reader.hpp"
+#include "synthetic_source.hpp"
+
+// one benchmark result, fields keep their order in the output
+struct BenchResult {
+  std::string name;
+  std::vector<std::pair<std::string, std::string>> fields;
+
+  void Add(std::string key, double value) {
+    std::ostringstream text;
+    text << std::fixed << std::setprecision(3) << value;
+    fields.push_back(std::make_pair(key, text.str()));
+  }
+
+  void Add(std::string key, std::string value) {
+    fields.push_back(std::make_pair(key, "\"" + value + "\""));
+  }
+
+  // p50/p99/p999 in microseconds
+  void AddLatency(std::string prefix, LatencyHistogram& histogram) {
+    Add(prefix + "_p50_us", histogram.Percentile(0.5) / 1000.0);
+    Add(prefix + "_p99_us", histogram.Percentile(0.99) / 1000.0);
+    Add(prefix + "_p999_us", histogram.Percentile(0.999) / 1000.0);
+    Add(prefix + "_max_us", histogram.Max() / 1000.0);
+  }
+};
+
+struct BenchConfig {
+  size_t width = 2448;  // typical 5 MP machine vision sensor
+  size_t height = 2048;
+  double seconds = 1.0; // per benchmark
+};
+
+// keeps the compiler from dropping work whose result is never read
+static void KeepAlive(void* data) {
+  asm volatile("" : : "r"(data) : "memory");
+}
+
+static double Seconds(uint64_t begin, uint64_t end) {
+  return (end - begin) / 1e9;
+}
+
+static FramePtr SyntheticFrame(BenchConfig& config, std::vector<uint8_t>& buffer) {
+  buffer.resize(config.width * config.height);
+  SyntheticSource::RenderPattern(buffer.data(), config.width, config.height, config.width, PixelFormat::BayerRG8, 0);
+
+  FramePtr frame(new Frame());
+  frame->data = buffer.data();
+  frame->size = buffer.size();
+  frame->width = config.width;
+  frame->height = config.height;
+  frame->stride = config.width;
+  frame->pixel_format = PixelFormat::BayerRG8;
+  return frame;
+}
+
+// producer and consumer threads passing pooled frames, no pixel data is touched
+static BenchResult QueueHandoff(BenchConfig& config, OverflowPolicy policy, std::string name) {
+  const size_t QUEUE_SIZE = 64;
+
+  // enough frames for a full queue plus the ones held by both threads
+  FrameQueue<FramePtr> queue(QUEUE_SIZE, policy);
+  FramePool frames(QUEUE_SIZE * 2);
+  frames.Reserve(64);
+
+  LatencyHistogram latency;
+  uint64_t received = 0;
+
+  std::thread consumer([&] {
+    FramePtr frame;
+    while(queue.WaitPop(frame, -1)) {
+      latency.Record(MonotonicNow() - frame->enqueue_time);
+      received++;
+    }
+  });
+
+  uint64_t begin = MonotonicNow();
+  uint64_t end = begin + config.seconds * 1e9;
+
+  while(MonotonicNow() < end) {
+    FramePtr frame = frames.Acquire();
+    frame->enqueue_time = MonotonicNow();
+    queue.Push(std::move(frame));
+  }
+
+  queue.Close();
+  consumer.join();
+  double elapsed = Seconds(begin, MonotonicNow());
+
+  BenchResult result;
+  result.name = name;
+  result.Add("frames_per_s", received / elapsed);
+  result.Add("dropped", (double)queue.Dropped());
+  result.AddLatency("latency", latency);
+  return result;
+}
+
+// frame copy into pool buffers as done for frames which cannot be lent
+static BenchResult PoolCopy(BenchConfig& config) {
+  std::vector<uint8_t> buffer;
+  FramePtr source = SyntheticFrame(config, buffer);
+  FramePool pool(32);
+  pool.Reserve(source->size);
+
+  LatencyHistogram latency;
+  uint64_t frames = 0;
+  uint64_t begin = MonotonicNow();
+  uint64_t end = begin + config.seconds * 1e9;
+
+  while(MonotonicNow() < end) {
+    uint64_t start = MonotonicNow();
+    FramePtr frame = pool.Acquire();
+    memcpy(frame->data, source->data, source->size);
+    KeepAlive(frame->data);
+    frame.reset();
+    latency.Record(MonotonicNow() - start);
+    frames++;
+  }
+
+  double elapsed = Seconds(begin, MonotonicNow());
+
+  BenchResult result;
+  result.name = "frame_copy_pool";
+  result.Add("frames_per_s", frames / elapsed);
+  result.Add("mb_per_s", frames * source->size / 1e6 / elapsed);
+  result.AddLatency("latency", latency);
+  return result;
+}
+
+// the same copy into a fresh heap buffer per frame, what the pool saves us
+static BenchResult HeapCopy(BenchConfig& config) {
+  std::vector<uint8_t> buffer;
+  FramePtr source = SyntheticFrame(config, buffer);
+
+  LatencyHistogram latency;
+  uint64_t frames = 0;
+  uint64_t begin = MonotonicNow();
+  uint64_t end = begin + config.seconds * 1e9;
+
+  while(MonotonicNow() < end) {
+    uint64_t start = MonotonicNow();
+    uint8_t* data = (uint8_t*)malloc(source->size);
+    memcpy(data, source->data, source->size);
+    KeepAlive(data);
+    free(data);
+    latency.Record(MonotonicNow() - start);
+    frames++;
+  }
+
+  double elapsed = Seconds(begin, MonotonicNow());
+
+  BenchResult result;
+  result.name = "frame_copy_heap";
+  result.Add("frames_per_s", frames / elapsed);
+  result.Add("mb_per_s", frames * source->size / 1e6 / elapsed);
+  result.AddLatency("latency", latency);
+  return result;
+}
+
+// paced publishing into shared memory with a reader sleeping on the futex,
+// reader latency includes its wakeup as it would in another process
+static BenchResult ShmPublish(BenchConfig& config) {
+  const uint64_t FRAME_INTERVAL = 5 * 1000 * 1000; // ns, 200 fps
+
+  std::vector<uint8_t> buffer;
+  FramePtr source = SyntheticFrame(config, buffer);
+  std::string name = "/capture_bench_" + std::to_string(getpid());
+  ShmPublisher publisher(name, "bench");
+
+  // segment exists once the first frame is out
+  publisher.Publish(*source);
+
+  ShmReader reader;
+  reader.Open(name);
+
+  LatencyHistogram publish_latency;
+  LatencyHistogram read_latency;
+  std::atomic<bool> reading{true};
+
+  std::thread consumer([&] {
+    Frame frame;
+    uint64_t publish_time;
+    while(reading) {
+      if(reader.Next(frame, publish_time, 10 * 1000)) {
+        read_latency.Record(MonotonicNow() - publish_time);
+      }
+    }
+  });
+
+  uint64_t frames = 0;
+  uint64_t begin = MonotonicNow();
+  uint64_t end = begin + config.seconds * 1e9;
+
+  while(MonotonicNow() < end) {
+    uint64_t start = MonotonicNow();
+    source->id = frames;
+    publisher.Publish(*source);
+    publish_latency.Record(MonotonicNow() - start);
+    frames++;
+
+    uint64_t next = start + FRAME_INTERVAL;
+    uint64_t now = MonotonicNow();
+    if(next > now) {
+      usleep((next - now) / 1000);
+    }
+  }
+
+  double elapsed = Seconds(begin, MonotonicNow());
+
+  // last frames are in flight to the reader
+  usleep(20 * 1000);
+  reading = false;
+  consumer.join();
+
+  BenchResult result;
+  result.name = "shm_publish";
+  result.Add("frames_per_s", frames / elapsed);
+  result.Add("read", (double)reader.Read());
+  result.Add("missed", (double)reader.Missed());
+  result.AddLatency("publish", publish_latency);
+  result.AddLatency("publish_to_read", read_latency);
+  return result;
+}
+
+static BenchResult Conversion(BenchConfig& config, DemosaicMethod method, int threads) {
+  std::vector<uint8_t> buffer;
+  FramePtr source = SyntheticFrame(config, buffer);
+  std::vector<uint8_t> output(config.width * config.height * 3);
+  Demosaicer demosaicer(method, threads);
+
+  // warm up caches and workers
+  demosaicer.Process(*source, output.data(), config.width * 3);
+
+  LatencyHistogram latency;
+  uint64_t frames = 0;
+  uint64_t begin = MonotonicNow();
+  uint64_t end = begin + config.seconds * 1e9;
+
+  while(MonotonicNow() < end) {
+    uint64_t start = MonotonicNow();
+    demosaicer.Process(*source, output.data(), config.width * 3);
+    latency.Record(MonotonicNow() - start);
+    frames++;
+  }
+
+  double elapsed = Seconds(begin, MonotonicNow());
+
+  BenchResult result;
+  result.name = std::string("convert_") + DemosaicMethodName(method) + "_threads_" + std::to_string(threads);
+  result.Add("simd", SimdLevelName(demosaicer.Simd()));
+  result.Add("frames_per_s", frames / elapsed);
+  result.Add("megapixels_per_s", frames * config.width * config.height / 1e6 / elapsed);
+  result.Add("mb_per_s", frames * (source->size + output.size()) / 1e6 / elapsed);
+  result.AddLatency("latency", latency);
+  return result;
+}
+
+// half, quarter and eighth size previews of a raw frame on one thread
+static BenchResult Preview(BenchConfig& config) {
+  std::vector<uint8_t> buffer;
+  FramePtr source = SyntheticFrame(config, buffer);
+  PreviewScaler scaler;
+
+  size_t width = config.width / 2;
+  size_t height = config.height / 2;
+  std::vector<uint8_t> half(width * height * 3);
+  std::vector<uint8_t> quarter(half.size() / 4);
+  std::vector<uint8_t> eighth(quarter.size() / 4);
+
+  LatencyHistogram latency;
+  uint64_t frames = 0;
+  uint64_t begin = MonotonicNow();
+  uint64_t end = begin + config.seconds * 1e9;
+
+  while(MonotonicNow() < end) {
+    uint64_t start = MonotonicNow();
+    scaler.Bin(*source, half.data(), width * 3);
+    scaler.Halve(half.data(), width, height, width * 3, quarter.data(), width / 2 * 3);
+    scaler.Halve(quarter.data(), width / 2, height / 2, width / 2 * 3, eighth.data(), width / 4 * 3);
+    latency.Record(MonotonicNow() - start);
+    frames++;
+  }
+
+  double elapsed = Seconds(begin, MonotonicNow());
+
+  BenchResult result;
+  result.name = "preview_pyramid";
+  result.Add("simd", SimdLevelName(scaler.Simd()));
+  result.Add("frames_per_s", frames / elapsed);
+  result.Add("megapixels_per_s", frames * config.width * config.height / 1e6 / elapsed);
+  result.AddLatency("latency", latency);
+  return result;
+}
+
+// histogram, mean and saturation of a raw frame on one thread
+static BenchResult ImageStatistics(BenchConfig& config, size_t step) {
+  std::vector<uint8_t> buffer;
+  FramePtr source = SyntheticFrame(config, buffer);
+  ImageStats stats;
+  ImageHistogram histogram;
+
+  LatencyHistogram latency;
+  uint64_t frames = 0;
+  uint64_t begin = MonotonicNow();
+  uint64_t end = begin + config.seconds * 1e9;
+
+  while(MonotonicNow() < end) {
+    uint64_t start = MonotonicNow();
+    ComputeImageStats(*source, step, 8, stats, &histogram);
+    latency.Record(MonotonicNow() - start);
+    frames++;
+  }
+
+  double elapsed = Seconds(begin, MonotonicNow());
+
+  BenchResult result;
+  result.name = "image_stats_step_" + std::to_string(step);
+  result.Add("frames_per_s", frames / elapsed);
+  result.Add("megapixels_per_s", frames * config.width * config.height / 1e6 / elapsed);
+  result.Add("green_mean", stats.mean[1]);
+  result.AddLatency("latency", latency);
+  return result;
+}
+
+// motion score of frames alternating between two bar positions on one thread
+static BenchResult MotionScore(BenchConfig& config) {
+  std::vector<uint8_t> buffer;
+  FramePtr moved = SyntheticFrame(config, buffer);
+  std::vector<uint8_t> other(buffer.size());
+  SyntheticSource::RenderPattern(other.data(), config.width, config.height, config.width, PixelFormat::BayerRG8, 1);
+
+  Frame still = *moved;
+  MotionDetector detector;
+  detector.Score(still);
+  float still_score = detector.Score(still);
+
+  LatencyHistogram latency;
+  uint64_t frames = 0;
+  float moving_score = 0;
+  uint64_t begin = MonotonicNow();
+  uint64_t end = begin + config.seconds * 1e9;
+
+  while(MonotonicNow() < end) {
+    moved->data = frames % 2 == 0 ? other.data() : buffer.data();
+
+    uint64_t start = MonotonicNow();
+    moving_score = detector.Score(*moved);
+    latency.Record(MonotonicNow() - start);
+    frames++;
+  }
+
+  double elapsed = Seconds(begin, MonotonicNow());
+  moved->data = buffer.data();
+
+  BenchResult result;
+  result.name = "motion_score";
+  result.Add("simd", SimdLevelName(detector.Simd()));
+  result.Add("frames_per_s", frames / elapsed);
+  result.Add("megapixels_per_s", frames * config.width * config.height / 1e6 / elapsed);
+  result.Add("still_score_percent", still_score);
+  result.Add("moving_score_percent", moving_score);
+  result.AddLatency("latency", latency);
+  return result;
+}
+
+// synthetic source at full speed through capture queue and conversion pool
+static BenchResult EndToEnd(BenchConfig& config, int workers) {
+  std::atomic<bool> run{true};
+
+  SyntheticConfig source_config;
+  source_config.width = config.width;
+  source_config.height = config.height;
+  source_config.fps = 0;
+  SyntheticSource source(run, source_config);
+
+  // blocking queue, we measure how fast the pipeline drains it
+  FrameQueue<FramePtr> queue(64, OverflowPolicy::Block);
+  ConversionPool pool(run, queue, workers);
+
+  std::atomic<uint64_t> converted{0};
+  pool.AddSink([&](const FramePtr& frame, const FramePtr& image) {
+    if(image) {
+      converted++;
+    }
+  });
+  pool.Start();
+
+  std::thread capture(&FrameSource::Capture, &source, std::ref(queue));
+
+  uint64_t begin = MonotonicNow();
+  usleep(config.seconds * 1e6);
+  uint64_t frames = converted.load();
+  double elapsed = Seconds(begin, MonotonicNow());
+
+  run = false;
+  queue.Close();
+  capture.join();
+  pool.Join();
+
+  BenchResult result;
+  result.name = "end_to_end_workers_" + std::to_string(workers);
+  result.Add("frames_per_s", frames / elapsed);
+  result.Add("mb_per_s", frames * config.width * config.height / 1e6 / elapsed);
+  result.Add("missed", (double)source.MissedFrames());
+  result.AddLatency("handoff", source.HandoffLatency());
+  result.AddLatency("queue_wait", pool.QueueWaitLatency());
+  result.AddLatency("convert", pool.ConvertLatency());
+  result.AddLatency("total", pool.TotalLatency());
+  return result;
+}
+
+static std::string Json(BenchConfig& config, std::vector<BenchResult>& results) {
+  std::ostringstream json;
+  json << "{\n";
+  json << "  \"width\": " << config.width << ",\n";
+  json << "  \"height\": " << config.height << ",\n";
+  json << "  \"cpus\": " << CpuCount() << ",\n";
+  json << "  \"simd\": \"" << SimdLevelName(DetectSimdLevel()) << "\",\n";
+  json << "  \"results\": [\n";
+
+  for(size_t i = 0; i < results.size(); i++) {
+    json << "    {\"name\": \"" << results[i].name << "\"";
+    for(auto& field : results[i].fields) {
+      json << ", \"" << field.first << "\": " << field.second;
+    }
+    json << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+  }
+
+  json << "  ]\n";
+  json << "}\n";
+  return json.str();
+}
+
+static void PrintUsage(char* name) {
+  std::cout << "Usage: " << name << " [-s WIDTHxHEIGHT] [-t seconds] [-o file]" << std::endl;
+  std::cout << "  -s size     frame size (default: 2448x2048)" << std::endl;
+  std::cout << "  -t seconds  duration of each benchmark (default: 1)" << std::endl;
+  std::cout << "  -o file     write JSON results to file as well as stdout" << std::endl;
+}
+
+int main(int argc, char **argv) {
+  BenchConfig config;
+  std::string output_path;
+
+  int option;
+  while((option = getopt(argc, argv, "s:t:o:h")) != -1) {
+    switch(option) {
+      case 's': {
+        SyntheticConfig size;
+        if(!ParseSyntheticConfig(optarg, size)) {
+          PrintUsage(argv[0]);
+          return 1;
+        }
+        config.width = size.width;
+        config.height = size.height;
+        break;
+      }
+      case 't':
+        config.seconds = atof(optarg);
+        break;
+      case 'o':
+        output_path = optarg;
+        break;
+      default:
+        PrintUsage(argv[0]);
+        return 1;
+    }
+  }
+
+  std::vector<BenchResult> results;
+  results.push_back(QueueHandoff(config, OverflowPolicy::Block, "queue_handoff_block"));
+  results.push_back(QueueHandoff(config, OverflowPolicy::DropOldest, "queue_handoff_drop_oldest"));
+  results.push_back(PoolCopy(config));
+  results.push_back(HeapCopy(config));
+  results.push_back(ShmPublish(config));
+  results.push_back(Preview(config));
+  results.push_back(ImageStatistics(config, 1));
+  results.push_back(ImageStatistics(config, 2));
+  results.push_back(MotionScore(config));
+
+  std::vector<int> thread_counts = { 1 };
+  if(CpuCount() > 1) {
+    thread_counts.push_back(CpuCount());
+  }
+
+  for(int threads : thread_counts) {
+    results.push_back(Conversion(config, DemosaicMethod::Bilinear, threads));
+    results.push_back(Conversion(config, DemosaicMethod::EdgeAware, threads));
+  }
+
+  for(int workers : thread_counts) {
+    results.push_back(EndToEnd(config, workers));
+  }
+
+  std::string json = Json(config, results);
+  std::cout << json;
+
+  if(!output_path.empty()) {
+    std::ofstream output(output_path);
+    output << json;
+    if(!output) {
+      std::cerr << "cannot write " << output_path << std::endl;
+      return 1;
+    }
+  }
+
+  return 0;
+}
@@ -1,34 +1,98 @@
 #ifndef SRC_CAMERA_H_
 #define SRC_CAMERA_H_
 
+#include <atomic>
 #include <string>
 #include <iostream>
+#include <mutex>
 #include <unistd.h>
-#include <queue>
 #include <signal.h>
 #include <thread>
 #include <Spinnaker.h>
 #include <SpinGenApi/SpinnakerGenApi.h>
+#include "clock_mapper.hpp"
+#include "config_transaction.hpp"
+#include "device_events.hpp"
+#include "frame.hpp"
+#include "frame_pool.hpp"
+#include "frame_queue.hpp"
+#include "frame_source.hpp"
+#include "memory_arena.hpp"
+#include "node_cache.hpp"
+#include "notifier.hpp"
 
-class Camera {
+// how captured frames are passed to the frame queue
+enum class FrameHandoff {
+  ZeroCopy, // lend driver buffers to consumers, copy only when too many are lent
+  Copy      // always copy into a frame pool buffer and release driver buffer right away
+};
+
+// how frames get from the driver to the frame queue
+enum class GrabMode {
+  Polling, // capture thread grabs frames with a bounded timeout
+  Callback // driver event thread queues copies of frames, capture thread only manages camera state
+};
+
+class Camera;
+
+// forwards driver image events to the camera
+class FrameEvents : public Spinnaker::ImageEvent {
   public:
-    Camera(bool& run);
+    FrameEvents(Camera& camera);
+    void OnImageEvent(Spinnaker::ImagePtr image) override;
+
+  private:
+    Camera& camera;
+};
+
+// device lent frames were taken from, shared by them so a lost camera can be
+// dropped while consumers still read its buffers. The last owner ends
+// acquisition when it was still running and deinitializes the device.
+struct LentDevice {
+  LentDevice(Spinnaker::CameraPtr cam);
+  ~LentDevice();
+
+  Spinnaker::CameraPtr cam;
+  bool acquiring = false;
+};
+
+PixelFormat FromSpinnakerPixelFormat(Spinnaker::PixelFormatEnums pixel_format);
+Spinnaker::PixelFormatEnums ToSpinnakerPixelFormat(PixelFormat pixel_format);
+
+class Camera : public FrameSource {
+  public:
+    // empty serial picks first camera, system is created per camera when not shared
+    Camera(std::atomic<bool>& run, std::string serial = "", Spinnaker::SystemPtr shared_system = 0,
+        FrameHandoff handoff = FrameHandoff::ZeroCopy, GrabMode grab_mode = GrabMode::Polling);
     bool IsConnected();
     void Warmup();
 
     void Connect();
     bool ConnectDevice();
+    void Disconnect();
     void MaintainCaptureState();
     bool CloseCamera();
     bool OpenCamera();
-    void IdleSleep();
+    void IdleSleep(uint32_t state);
     void Configure();
+    void EnableChunkData();
+    void SyncClock();
     void PrintDeviceInformation();
     void PrintDeviceConfiguration();
-    void Capture(std::queue<Spinnaker::ImagePtr>& capture_queue);
-    int FPS();
-    void RegisterCaptureStart();
-    void RegisterFrameCapture();
+    void Capture(FrameQueue<FramePtr>& capture_queue) override;
+    void GrabFrame(FrameQueue<FramePtr>& capture_queue);
+    void HandleImageEvent(Spinnaker::ImagePtr raw_frame);
+    void ProcessFrame(Spinnaker::ImagePtr raw_frame, FrameQueue<FramePtr>& capture_queue);
+    FramePtr HandOff(Spinnaker::ImagePtr raw_frame);
+    FramePtr LendFrame(Spinnaker::ImagePtr raw_frame);
+    FramePtr CopyFrame(Spinnaker::ImagePtr raw_frame);
+    void ReleaseRawFrame(Spinnaker::ImagePtr raw_frame);
+    void ReturnLentFrames(FrameQueue<FramePtr>& capture_queue);
+    void WaitLentFrames();
+    std::string Serial() override;
+    int LentFrames() override;
+    bool SetRoi(RoiProfile profile) override;
+    bool SetExposure(double microseconds) override;
     std::string ConfigurationLabel(std::string str, const size_t num = 23, const char padding_char = ' ');
 
     double GetFloatProperty(std::string config_name, Spinnaker::GenApi::INodeMap* map = NULL);
@@ -39,39 +103,120 @@ class Camera {
     bool UpdateProperty(std::string config_name, double config_value, bool exclusive_write, Spinnaker::GenApi::INodeMap* map = NULL);
     bool UpdateProperty(std::string config_name, std::string config_value, bool exclusive_write, Spinnaker::GenApi::INodeMap* map = NULL);
     bool UpdateBoolProperty(std::string config_name, bool config_value, bool exclusive_write = false, Spinnaker::GenApi::INodeMap* map = NULL);
+
+    // applies staged changes with at most one acquisition stop, false when a change failed
+    bool Commit(ConfigTransaction& transaction);
     bool IsWritable();
     bool EnsureWritability();
-    void EnsureExclusiveWrite();
-    void EndExclusiveWrite();
+    bool EnsureExclusiveWrite();
+    void EndExclusiveWrite(bool capturing);
+
+  protected:
+    void ReadLossCounters(uint64_t& link_lost, uint64_t& driver_dropped) override;
 
   private:
+    Spinnaker::GenApi::INode* Node(std::string config_name, Spinnaker::GenApi::INodeMap* map = NULL);
+    bool HasValue(PropertyChange& change);
+    bool Apply(PropertyChange& change);
+    void StageRoi(ConfigTransaction& transaction);
+    int AlignedValue(std::string config_name, double value);
+
+    void ReleaseDevice();
+    void PrepareStreamBuffers();
+    void StopFrameEvents();
+    void UnregisterFrameEvents();
+    CameraChunk ReadChunk(Spinnaker::ImagePtr raw_frame);
+    uint64_t ReadStreamCounter(std::string counter_name);
+
     // see https://www.ptgrey.com/tan/11174
     int SPINNAKER_BUFFER_SIZE = 10;
 
+    // driver buffers which always stay with the driver so acquisition never starves
+    int SPINNAKER_RESERVED_BUFFERS = 4;
+
+    // frames which can be copied while consumer holds all lendable driver buffers
+    static const size_t FRAME_POOL_SIZE = 32;
+
+    // how often a wait for consumers to give back lent buffers is reported
+    int LENT_FRAMES_REPORT_INTERVAL = 1000 * 1000; // 1s
+
     double EXPOSURE_TIME = 1000;
-    int IDLE_SLEEP = 25 * 1000; // 25ms
+    const uint64_t CLOCK_SYNC_INTERVAL = 1000 * 1000 * 1000; // ns, camera timestamp latch period
+    int IDLE_SLEEP = 25 * 1000; // 25ms, upper bound when waiting for capture state change
+    const uint64_t GRAB_TIMEOUT = 100; // ms, bounds how long polling misses pause and shutdown requests
 
     Spinnaker::CameraPtr cam = 0;
+
+    // owner of the connected device, one dropped with frames still lent
+    // must be gone before the camera is opened again
+    std::shared_ptr<LentDevice> lent_device;
+    std::weak_ptr<LentDevice> retired_device;
+
     Spinnaker::SystemPtr system = 0;
     Spinnaker::CameraList cam_list;
     Spinnaker::GenApi::INodeMap* node_map_tl_device;
     Spinnaker::GenApi::INodeMap* node_map;
     Spinnaker::GenApi::INodeMap* stream_node_map;
+    NodeCache node_cache;
+
+    // driver buffers allocated by us, lent frames keep a replaced arena alive
+    std::shared_ptr<MemoryArena> stream_buffers;
+
+    // one transaction at a time, set when acquisition was stopped for one
+    std::mutex config_mutex;
+
+    // held by the capture thread while it sets up or drops the device and by
+    // other threads while they touch its nodes, taken after config_mutex
+    std::mutex device_mutex;
+    std::atomic<uint64_t> reconfigure_begin{0};
+
+    bool Pause();
+    void Restore(bool capturing);
+
+    FrameHandoff handoff;
+    GrabMode grab_mode;
+    std::atomic<int> lent_frames{0};
+
+    // applied on every (re)connect, changed from other threads
+    std::atomic<double> exposure_time;
+
+    bool chunk_data_enabled = false;
+
+    // readout applied on every (re)connect, changed from other threads
+    RoiProfile roi = RoiProfiles().front();
+    std::mutex roi_mutex;
+
+    // camera timestamps to host time, sampled on the capture thread
+    ClockMapper clock_mapper;
+    uint64_t last_clock_sync = 0;
+
+    std::string serial;
+    bool owns_system;
+    // written by the capture thread, read by threads changing configuration and by image events
+    std::atomic<bool> camera_connected{false};
+    std::atomic<bool> capture{true};
+    std::atomic<bool> camera_open{false};
+
+    // signalled whenever capture or camera_open changes
+    Notifier state_changed;
 
-    void Pause();
-    void Resume();
+    // arrival and removal of our device, registered with the system while capturing
+    DeviceEvents device_events;
+    bool device_events_registered = false;
 
-    int fps = 0;
+    // driver image events, only registered in callback mode
+    FrameEvents frame_events;
+    bool frame_events_registered = false;
+    FrameQueue<FramePtr>* event_queue = NULL;
 
-    double exposure_time;
+    // held while an image event is handled, events are dropped until acquisition is fully open
+    std::mutex frame_event_mutex;
+    std::atomic<bool> accept_frame_events{false};
 
-    bool& run;
-    bool camera_connected = false;
-    bool capture = true;
-    bool camera_open = false;
-    long frame_counter = 0;
-    std::time_t time_begin;
+    // when the device was lost, 0 while capturing normally
+    std::atomic<uint64_t> disconnect_time{0};
 
+    // reconnect is event driven, this only bounds how long a missed arrival event delays it
     const int CAMERA_RECONNECT_TIMEOUT = 5; // seconds
 };
 
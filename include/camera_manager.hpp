@@ -0,0 +1,87 @@
+#ifndef SRC_CAMERA_MANAGER_H_
+#define SRC_CAMERA_MANAGER_H_
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <Spinnaker.h>
+#include <SpinGenApi/SpinnakerGenApi.h>
+#include "camera.hpp"
+#include "frame_queue.hpp"
+#include "frame_source.hpp"
+#include "metrics.hpp"
+
+// Runs one capture loop per frame source, cameras share one Spinnaker::System.
+//
+// Every source gets its own frame queue and capture thread, and the thread
+// is pinned to its own cpu so sources do not compete for the same core. The
+// Spinnaker system is only brought up once a camera is involved, synthetic
+// and replay sources work without it.
+class CameraManager {
+  public:
+    CameraManager(std::atomic<bool>& run, size_t queue_size, OverflowPolicy queue_policy);
+    ~CameraManager();
+
+    // serial numbers of all connected cameras
+    std::vector<std::string> Enumerate();
+
+    // empty serial picks first camera, negative cpu leaves thread unpinned
+    void Add(std::string serial, int cpu = -1, GrabMode grab_mode = GrabMode::Polling);
+
+    // takes ownership of any other frame source
+    void AddSource(FrameSource* source, int cpu = -1);
+    size_t Size();
+
+    void Start();
+    void Close();
+    void Join();
+
+    FrameSource* GetSource(size_t index);
+    FrameQueue<FramePtr>& Queue(size_t index);
+
+    // same readout on every source which supports it
+    void SetRoi(RoiProfile profile);
+
+    // false when a source could not take it
+    bool SetExposure(double microseconds);
+
+    // same load shedding on every source, before Start
+    void SetShedding(ShedConfig config);
+
+    // capture threads run SCHED_FIFO at this priority once started, 0 keeps default scheduling
+    void SetRealtime(int priority);
+
+    // cpus capture threads are pinned to
+    std::vector<int> Cpus();
+
+    // queue latency is over the window since the last call starting a new
+    // one, the periodic stats own it and other readers only look
+    void PrintStats(std::ostream& out, bool new_window);
+
+    // prometheus labels identifying a camera, e.g. camera="123"
+    std::string Labels(size_t index);
+    void WriteMetrics(MetricsWriter& metrics);
+
+  private:
+    struct CaptureUnit {
+      std::string serial;
+      int cpu;
+      int priority = 0;
+      std::unique_ptr<FrameSource> source;
+      std::unique_ptr<FrameQueue<FramePtr>> queue;
+      std::thread thread;
+    };
+
+    Spinnaker::SystemPtr System();
+
+    std::atomic<bool>& run;
+    size_t queue_size;
+    OverflowPolicy queue_policy;
+    Spinnaker::SystemPtr system = 0;
+    std::vector<std::unique_ptr<CaptureUnit>> units;
+    int realtime_priority = 0;
+};
+
+#endif  // SRC_CAMERA_MANAGER_H_
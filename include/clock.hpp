@@ -0,0 +1,14 @@
+#ifndef SRC_CLOCK_H_
+#define SRC_CLOCK_H_
+
+#include <cstdint>
+#include <time.h>
+
+// host monotonic time in nanoseconds, cheap enough to call per frame (vDSO)
+inline uint64_t MonotonicNow() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+#endif  // SRC_CLOCK_H_
@@ -0,0 +1,55 @@
+#ifndef SRC_CLOCK_MAPPER_H_
+#define SRC_CLOCK_MAPPER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+
+// Maps camera timestamps onto host monotonic time.
+//
+// Samples pair a latched camera timestamp with the host time before and
+// after the latch command. The host side of a sample is taken as the middle
+// of that window, so samples with a short round trip are the most accurate
+// ones. A line fitted through the recent accurate samples gives offset and
+// drift between the two clocks.
+//
+// Samples are added by the capture thread while frames may be mapped from
+// the driver event thread, all methods are synchronized.
+class ClockMapper {
+  public:
+    void AddSample(uint64_t camera_time, uint64_t host_before, uint64_t host_after);
+    void Reset();
+
+    // host monotonic time in ns, 0 until a sample was added
+    uint64_t ToHost(uint64_t camera_time);
+    bool Synced();
+
+    // round trip of the best sample in the window, bounds mapping error
+    uint64_t Uncertainty();
+
+    // camera clock ns per host ns
+    double Rate();
+
+  private:
+    struct Sample {
+      uint64_t camera_time;
+      uint64_t host_time;
+      uint64_t round_trip;
+    };
+
+    void Fit();
+
+    std::mutex mutex;
+    std::deque<Sample> samples;
+
+    // host = host_reference + (camera - camera_reference) / rate
+    uint64_t camera_reference = 0;
+    uint64_t host_reference = 0;
+    double rate = 1;
+    uint64_t uncertainty = 0;
+
+    static const size_t WINDOW = 16;
+};
+
+#endif  // SRC_CLOCK_MAPPER_H_
@@ -0,0 +1,60 @@
+#ifndef SRC_CONFIG_TRANSACTION_H_
+#define SRC_CONFIG_TRANSACTION_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <Spinnaker.h>
+#include <SpinGenApi/SpinnakerGenApi.h>
+
+enum class PropertyType {
+  Integer,
+  Float,
+  Enumeration,
+  Boolean
+};
+
+// one staged property write
+struct PropertyChange {
+  std::string name;
+  PropertyType type;
+  int64_t int_value = 0;
+  double float_value = 0;
+  std::string string_value;
+  bool bool_value = false;
+
+  // node can only be written while acquisition is stopped
+  bool exclusive_write = false;
+
+  // NULL is the camera node map
+  Spinnaker::GenApi::INodeMap* map = NULL;
+};
+
+// Property changes collected and applied together by Camera::Commit.
+//
+// Acquisition is stopped at most once per commit no matter how many staged
+// nodes need it, and changes are applied in dependency order (modes before
+// the values they unlock, sizes before offsets), so callers may stage them in
+// any order. Changes to the same node keep the order they were staged in,
+// which keeps selector/value pairs like ChunkSelector and ChunkEnable intact.
+class ConfigTransaction {
+  public:
+    void Set(std::string name, int value, bool exclusive_write, Spinnaker::GenApi::INodeMap* map = NULL);
+    void Set(std::string name, double value, bool exclusive_write, Spinnaker::GenApi::INodeMap* map = NULL);
+    void Set(std::string name, std::string value, bool exclusive_write, Spinnaker::GenApi::INodeMap* map = NULL);
+    void SetBool(std::string name, bool value, bool exclusive_write = false, Spinnaker::GenApi::INodeMap* map = NULL);
+
+    // staged changes in the order they have to be applied
+    std::vector<PropertyChange> Ordered();
+
+    bool Empty();
+    size_t Size();
+    void Clear();
+
+  private:
+    void Stage(PropertyChange change);
+
+    std::vector<PropertyChange> changes;
+};
+
+#endif  // SRC_CONFIG_TRANSACTION_H_
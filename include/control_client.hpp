@@ -0,0 +1,34 @@
+#ifndef SRC_CONTROL_CLIENT_H_
+#define SRC_CONTROL_CLIENT_H_
+
+#include <string>
+
+// where capture takes commands unless told otherwise with -u, in the user's
+// runtime directory or /run rather than a world writable one
+std::string DefaultControlSocket();
+
+// Client side of a ControlServer, used by tools/capture_control.cpp.
+class ControlClient {
+  public:
+    ControlClient();
+    ~ControlClient();
+
+    ControlClient(const ControlClient&) = delete;
+    ControlClient& operator=(const ControlClient&) = delete;
+
+    bool Connect(std::string path);
+    void Close();
+    bool IsConnected();
+
+    // sends a command and waits for the reply, false when the connection failed
+    // or the server answered with an error; reply is the text after "ok" or "error: "
+    bool Send(std::string command, std::string& reply);
+
+  private:
+    int socket = -1;
+    std::string input;
+
+    const int REPLY_TIMEOUT = 5000; // milliseconds
+};
+
+#endif  // SRC_CONTROL_CLIENT_H_
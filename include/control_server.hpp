@@ -0,0 +1,97 @@
+#ifndef SRC_CONTROL_SERVER_H_
+#define SRC_CONTROL_SERVER_H_
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+#include "frame_queue.hpp"
+
+// Takes commands from local processes over a Unix domain socket.
+//
+// Clients send one command per line, words separated by spaces, and may keep
+// the connection open for more. Every command is answered with "ok" or
+// "error: reason" on the first line, followed by any output and an empty
+// line ending the reply. Output itself never has empty lines.
+//
+// Immediate commands run on the server thread and should only flip flags or
+// read counters. Deferred commands, like camera settings which stop
+// acquisition for a while, are acknowledged as soon as their arguments are
+// counted and run one after another on a command thread, so neither clients
+// nor the capture threads wait for them; their failures are logged.
+class ControlServer {
+  public:
+    // false with the reason in reply when the command failed
+    typedef std::function<bool(const std::vector<std::string>& arguments, std::string& reply)> Handler;
+
+    ControlServer(std::atomic<bool>& run, std::string path);
+    ~ControlServer();
+
+    ControlServer(const ControlServer&) = delete;
+    ControlServer& operator=(const ControlServer&) = delete;
+
+    // before Start, usage lists the arguments, e.g. "<microseconds>"
+    void Register(std::string name, std::string usage, size_t arguments, bool deferred, Handler handler);
+
+    // binds the socket and starts serving, false when the path cannot be used
+    // or another process serves it already, Execute works either way
+    bool Start();
+    void Join();
+
+    // runs a command line of this process, e.g. from the keyboard, false with
+    // the reason in reply when it failed
+    bool Execute(const std::string& line, std::string& reply);
+
+    std::string Path();
+
+  private:
+    struct Command {
+      std::string usage;
+      size_t arguments;
+      bool deferred;
+      Handler handler;
+    };
+
+    struct DeferredCommand {
+      std::string name;
+      const Command* command = NULL;
+      std::vector<std::string> arguments;
+    };
+
+    // replies wait in output until the socket takes them, no new commands
+    // are read meanwhile
+    struct Client {
+      int socket;
+      std::string input;
+      std::string output;
+    };
+
+    void Serve();
+    void RunDeferred();
+
+    // false when the client is gone or too far behind reading replies
+    bool Receive(Client& client);
+    bool Flush(Client& client);
+    std::string Help();
+
+    std::atomic<bool>& run;
+    std::string path;
+    std::map<std::string, Command> commands;
+
+    int listen_socket = -1;
+    std::thread thread;
+    std::thread command_thread;
+
+    FrameQueue<DeferredCommand> deferred;
+
+    const int POLL_TIMEOUT = 100;       // milliseconds, bounds how long shutdown goes unnoticed
+    const int64_t COMMAND_WAIT_TIMEOUT = 100 * 1000; // microseconds
+    static const size_t DEFERRED_QUEUE_SIZE = 16; // commands, more are refused
+    const size_t MAX_CLIENTS = 16;
+    const size_t MAX_LINE = 4096;        // bytes, longer lines close the connection
+    const size_t MAX_OUTPUT = 1024 * 1024; // bytes of unread replies, more close the connection
+};
+
+#endif  // SRC_CONTROL_SERVER_H_
@@ -0,0 +1,133 @@
+#ifndef SRC_CONVERSION_POOL_H_
+#define SRC_CONVERSION_POOL_H_
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "demosaic.hpp"
+#include "frame.hpp"
+#include "frame_pool.hpp"
+#include "frame_queue.hpp"
+#include "histogram.hpp"
+#include "metrics.hpp"
+#include "notifier.hpp"
+#include "platform.hpp"
+
+// receives every frame in capture order together with its BGR conversion,
+// converted is empty when the frame could not be converted
+typedef std::function<void(const FramePtr& frame, const FramePtr& converted)> ConversionSink;
+
+// receives every frame as soon as it is taken from the capture queue, before
+// conversion, must return quickly
+typedef std::function<void(const FramePtr& frame)> RawSink;
+
+// Converts every frame of a capture queue on a pool of worker threads.
+//
+// A dispatcher thread takes frames from the queue and deals them out to
+// per-worker task queues, idle workers steal tasks from the others. Finished
+// frames go through a reorder buffer so sinks see them in original order no
+// matter which worker was faster. Sinks are called one at a time.
+class ConversionPool {
+  public:
+    ConversionPool(std::atomic<bool>& run, FrameQueue<FramePtr>& input, int workers, DemosaicMethod method = DemosaicMethod::Bilinear);
+    ~ConversionPool();
+
+    ConversionPool(const ConversionPool&) = delete;
+    ConversionPool& operator=(const ConversionPool&) = delete;
+
+    // sinks must be added before Start
+    void AddSink(ConversionSink sink);
+    void AddRawSink(RawSink sink);
+
+    void Start();
+    void Join();
+
+    int Workers();
+    size_t InFlight();
+    uint64_t Converted();
+    uint64_t Failed();
+    uint64_t Stolen();
+    int FPS();
+
+    // time frames wait in the capture queue, take to convert and spend from
+    // grab until they reach the sinks
+    LatencyHistogram& QueueWaitLatency();
+    LatencyHistogram& ConvertLatency();
+    LatencyHistogram& TotalLatency();
+
+    void WriteMetrics(MetricsWriter& metrics, std::string labels);
+
+  private:
+    struct Task {
+      uint64_t sequence;
+      FramePtr frame;
+      FramePtr converted;
+    };
+
+    struct alignas(CACHE_LINE_SIZE) WorkerQueue {
+      std::mutex mutex;
+      std::deque<Task> tasks;
+    };
+
+    struct Result {
+      bool ready = false;
+      FramePtr frame;
+      FramePtr converted;
+    };
+
+    void Dispatch();
+    bool WaitForRoom();
+    FramePtr AcquireOutput(const FramePtr& frame);
+    void Work(size_t index);
+    bool TakeTask(size_t index, Task& task);
+    void Complete(Task& task, bool success);
+    void RegisterConversion();
+
+    std::atomic<bool>& run;
+    FrameQueue<FramePtr>& input;
+    const DemosaicMethod method;
+    const size_t worker_count;
+
+    std::thread dispatcher;
+    std::vector<std::thread> workers;
+    std::vector<std::unique_ptr<WorkerQueue>> worker_queues;
+    Notifier work_available;
+    std::atomic<bool> stopping{false};
+
+    // converted images, only acquired by dispatcher thread
+    FramePool output_pool;
+
+    // reorder buffer, slot is picked by sequence modulo window
+    std::mutex reorder_mutex;
+    std::vector<Result> reorder;
+    std::atomic<uint64_t> next_emit{0};
+    bool delivering = false; // a worker is handing frames to the sinks
+    std::atomic<uint64_t> next_sequence{0};
+    Notifier emitted;
+    std::vector<ConversionSink> sinks;
+    std::vector<RawSink> raw_sinks;
+
+    std::atomic<uint64_t> converted{0};
+    std::atomic<uint64_t> failed{0};
+    std::atomic<uint64_t> stolen{0};
+
+    LatencyHistogram queue_latency;
+    LatencyHistogram convert_latency;
+    LatencyHistogram total_latency;
+
+    std::atomic<int> fps{0};
+    uint64_t second_begin = 0;
+    int frame_counter = 0;
+
+    const int64_t QUEUE_WAIT_TIMEOUT = 100 * 1000; // microseconds, bounds how long shutdown goes unnoticed
+    const int64_t OUTPUT_WAIT_TIMEOUT = 1000;      // microseconds between checks for released output images
+
+    // frames in flight between dispatcher and sinks, per worker
+    static const size_t REORDER_FRAMES_PER_WORKER = 4;
+};
+
+#endif  // SRC_CONVERSION_POOL_H_
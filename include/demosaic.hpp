@@ -0,0 +1,100 @@
+#ifndef SRC_DEMOSAIC_H_
+#define SRC_DEMOSAIC_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "frame.hpp"
+
+enum class DemosaicMethod {
+  Bilinear,  // average of nearest samples of each color
+  EdgeAware  // green interpolated along the direction with smaller gradient
+};
+
+enum class SimdLevel {
+  Scalar,
+  SSE41,
+  AVX2
+};
+
+// best instruction set supported by the cpu we run on
+SimdLevel DetectSimdLevel();
+const char* SimdLevelName(SimdLevel simd);
+const char* DemosaicMethodName(DemosaicMethod method);
+
+// Straightforward per-pixel implementation, used to verify the optimized
+// engine. Borders are mirrored (reflect 101) which keeps the Bayer phase.
+void DemosaicReference(const uint8_t* input, size_t width, size_t height, size_t input_stride,
+    PixelFormat pixel_format, DemosaicMethod method, uint8_t* output, size_t output_stride);
+
+// Converts Bayer frames into BGR8 images.
+//
+// Rows are processed in tiles sized to stay in L2 cache, tiles are spread
+// over a set of persistent worker threads plus the calling thread. Row
+// kernels are picked at runtime by cpu features (AVX2, SSE4.1 or scalar).
+// 16-bit formats are narrowed to their 8 most significant bits, mono formats
+// are replicated into all three channels.
+//
+// One Demosaicer must not be used from several threads at once.
+class Demosaicer {
+  public:
+    Demosaicer(DemosaicMethod method = DemosaicMethod::Bilinear, int threads = 1, SimdLevel simd = DetectSimdLevel());
+    ~Demosaicer();
+
+    Demosaicer(const Demosaicer&) = delete;
+    Demosaicer& operator=(const Demosaicer&) = delete;
+
+    // output must hold frame height rows of width * 3 bytes, output_stride bytes apart
+    bool Process(const Frame& frame, uint8_t* output, size_t output_stride);
+    bool Process(const uint8_t* input, size_t width, size_t height, size_t input_stride,
+        PixelFormat pixel_format, uint8_t* output, size_t output_stride);
+
+    DemosaicMethod Method();
+    SimdLevel Simd();
+    int Threads();
+
+  private:
+    struct Job {
+      const uint8_t* input;
+      size_t width;
+      size_t height;
+      size_t input_stride;
+      size_t bytes_per_pixel;
+      bool mono;
+      bool red_first_row;    // row 0 holds red samples
+      size_t color_x;        // parity of red/blue columns
+      uint8_t* output;
+      size_t output_stride;
+      size_t tile_rows;
+      size_t tiles;
+    };
+
+    void RunTiles(std::vector<uint8_t>& scratch);
+    void ProcessTile(const Job& job, size_t tile, std::vector<uint8_t>& scratch);
+    void Work();
+
+    const DemosaicMethod method;
+    const SimdLevel simd;
+
+    // persistent workers, woken once per frame
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable job_ready;
+    std::condition_variable job_done;
+    uint64_t generation = 0;
+    int busy_workers = 0;
+    bool stopping = false;
+
+    Job job;
+    std::atomic<size_t> next_tile{0};
+    std::vector<uint8_t> caller_scratch;
+
+    // input plus output bytes of one tile should fit in L2 cache
+    static const size_t TILE_CACHE_BYTES = 256 * 1024;
+};
+
+#endif  // SRC_DEMOSAIC_H_
@@ -0,0 +1,52 @@
+#ifndef SRC_DEMOSAIC_KERNELS_H_
+#define SRC_DEMOSAIC_KERNELS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include "demosaic.hpp"
+
+// one BGR output row together with the Bayer rows above and below it
+struct BayerRow {
+  const uint8_t* up;
+  const uint8_t* mid;
+  const uint8_t* down;
+  uint8_t* output;
+  size_t width;
+  bool red_row;   // row holds red samples, otherwise blue
+  size_t color_x; // parity of columns holding red/blue samples
+};
+
+// scalar kernel for a single pixel, mirrors columns at the borders
+void DemosaicPixel(const BayerRow& row, size_t x, DemosaicMethod method);
+
+// Vector kernels convert pixels from x up to x_end and return the first
+// pixel left for the caller. They read one pixel to both sides, so x must be
+// at least 1 and x_end at most width - 1.
+size_t DemosaicRowSSE41(const BayerRow& row, size_t x, size_t x_end, DemosaicMethod method);
+size_t DemosaicRowAVX2(const BayerRow& row, size_t x, size_t x_end, DemosaicMethod method);
+
+// one row of 2x2 Bayer tiles, each binned into a single BGR pixel
+struct BinnedRow {
+  const uint8_t* top;
+  const uint8_t* bottom;
+  uint8_t* output;
+  size_t tiles;
+  bool mono;    // average all four samples into gray
+  size_t red_x; // position of the red sample within a tile
+  size_t red_y;
+};
+
+// scalar kernel for a single tile
+void BinTile(const BinnedRow& row, size_t tile);
+
+// vector kernels bin tiles from tile on and return the first tile left for the caller
+size_t BinRowSSE41(const BinnedRow& row, size_t tile);
+size_t BinRowAVX2(const BinnedRow& row, size_t tile);
+
+// One output row of a BGR image halved in both directions: every pixel is
+// the average of the two vertical averages of a 2x2 block, rounded up. The
+// kernel halves pixels from x on and returns the first one left.
+void HalvePixel(const uint8_t* top, const uint8_t* bottom, uint8_t* output, size_t x);
+size_t HalveRowSSE41(const uint8_t* top, const uint8_t* bottom, uint8_t* output, size_t x, size_t width);
+
+#endif  // SRC_DEMOSAIC_KERNELS_H_
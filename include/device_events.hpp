@@ -0,0 +1,43 @@
+#ifndef SRC_DEVICE_EVENTS_H_
+#define SRC_DEVICE_EVENTS_H_
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <Spinnaker.h>
+#include "notifier.hpp"
+
+// Device arrival and removal notifications for one camera.
+//
+// Spinnaker calls the handlers from its own thread whenever a device shows
+// up on or disappears from any interface. Events for other cameras are
+// ignored, an empty serial follows every device until Follow narrows it
+// down to the device actually opened. The capture thread waits on
+// Changed instead of polling for the camera to come back.
+class DeviceEvents : public Spinnaker::InterfaceEvent {
+  public:
+    DeviceEvents(std::string serial);
+
+    // serial of the device the camera ended up with, empty follows every device
+    void Follow(std::string device_serial);
+
+    void OnDeviceArrival(uint64_t device_serial) override;
+    void OnDeviceRemoval(uint64_t device_serial) override;
+
+    // clears the flag, true when the device went away since the last call
+    bool TakeRemoved();
+
+    // take the epoch before checking for the device, then Wait with it
+    Notifier& Changed();
+
+  private:
+    bool Matches(uint64_t device_serial);
+
+    std::mutex mutex;
+    std::string serial;
+    std::atomic<bool> removed{false};
+    Notifier changed;
+};
+
+#endif  // SRC_DEVICE_EVENTS_H_
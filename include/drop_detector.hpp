@@ -0,0 +1,24 @@
+#ifndef SRC_DROP_DETECTOR_H_
+#define SRC_DROP_DETECTOR_H_
+
+#include <cstdint>
+
+// Finds frames which never arrived from gaps in camera frame ids.
+//
+// Ids are expected to grow by one per frame. A smaller id than expected means
+// the camera restarted counting (acquisition restart, reconnect), which is
+// not treated as a drop.
+class DropDetector {
+  public:
+    // frames missing between the previous id and this one
+    uint64_t Observe(uint64_t frame_id);
+
+    // next id starts a new sequence
+    void Reset();
+
+  private:
+    bool started = false;
+    uint64_t expected = 0;
+};
+
+#endif  // SRC_DROP_DETECTOR_H_
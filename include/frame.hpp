@@ -0,0 +1,98 @@
+#ifndef SRC_FRAME_H_
+#define SRC_FRAME_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// values are stored in recordings, only append new formats
+enum class PixelFormat {
+  Unknown,
+  Mono8,
+  Mono16,
+  BayerRG8,
+  BayerGB8,
+  BayerGR8,
+  BayerBG8,
+  BayerRG16,
+  BayerGB16,
+  BayerGR16,
+  BayerBG16,
+  BGR8
+};
+
+size_t BytesPerPixel(PixelFormat pixel_format);
+bool IsBayer(PixelFormat pixel_format);
+
+// position of the red sample within the 2x2 Bayer tile, false for other formats
+bool BayerPhase(PixelFormat pixel_format, size_t& red_x, size_t& red_y);
+const char* PixelFormatName(PixelFormat pixel_format);
+
+// per frame data the camera sends along with the image (GenICam chunk data)
+struct CameraChunk {
+  bool valid = false;
+  uint64_t frame_id = 0;
+  uint64_t timestamp = 0;   // camera clock in ns
+  double exposure_time = 0; // microseconds
+};
+
+// per channel exposure summary of a raw frame, red, green and blue for Bayer
+// formats and a single channel for mono
+struct ImageStats {
+  bool valid = false;
+  size_t channels = 0;
+  float mean[3] = {};  // 0-255 whatever the bit depth
+  float under[3] = {}; // percent of pixels in the lowest 1/256 of the range
+  float over[3] = {};  // percent of pixels in the highest 1/256 of the range
+};
+
+// Captured frame handed from the capture thread to consumers.
+//
+// Pixel data is not owned by the frame itself: it either points into a driver
+// buffer or into a FramePool slot, and goes back to its owner when the last
+// FramePtr referencing the frame is dropped.
+struct Frame {
+  uint8_t* data = nullptr;
+  size_t size = 0;
+  size_t width = 0;
+  size_t height = 0;
+  size_t stride = 0;
+  PixelFormat pixel_format = PixelFormat::Unknown;
+
+  // sequence number assigned by the capture thread
+  uint64_t id = 0;
+
+  // true when data is a driver buffer lent to the consumer
+  bool zero_copy = false;
+
+  // monotonic time in ns the frame reached each stage, 0 until it does
+  uint64_t grab_time = 0;    // returned by the driver
+  uint64_t enqueue_time = 0; // pushed to the capture queue
+  uint64_t dequeue_time = 0; // taken from the capture queue by a consumer
+  uint64_t convert_time = 0; // conversion finished
+
+  CameraChunk chunk;
+
+  // chunk timestamp mapped onto host monotonic time, 0 while clocks are not synced
+  uint64_t sensor_time = 0;
+
+  // changed share of the frame in percent set by a motion stage, negative when not scored
+  float motion_score = -1;
+
+  // a motion stage found no motion around the frame, set when it passes such frames on
+  bool still = false;
+
+  // set by a stats stage
+  ImageStats stats;
+};
+
+typedef std::shared_ptr<Frame> FramePtr;
+
+// id, capture times and analysis results of a frame onto an image made from it
+void CopyFrameMetadata(const Frame& from, Frame& to);
+
+// frame of its own sharing the image of frame, which stays alive as long as it
+// does; stages write results onto it since siblings may read frame meanwhile
+FramePtr AnnotatedFrame(const FramePtr& frame);
+
+#endif  // SRC_FRAME_H_
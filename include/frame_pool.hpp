@@ -0,0 +1,77 @@
+#ifndef SRC_FRAME_POOL_H_
+#define SRC_FRAME_POOL_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "frame.hpp"
+#include "memory_arena.hpp"
+
+// Fixed set of pre-allocated frame buffers which are recycled instead of
+// being allocated per frame.
+//
+// All buffers of a Reserve call live in one prefaulted memory arena, huge
+// pages when available, so copies into them take no page faults.
+//
+// Acquire and Reserve must be called from a single thread (the capture
+// thread), frames may be released from any thread.
+class FramePool {
+  public:
+    FramePool(size_t capacity);
+
+    // allocate all buffers for frames of given size, keeps current buffers if they are big enough
+    // and not much bigger than needed
+    bool Reserve(size_t frame_size);
+
+    // take free frame, returns empty pointer when every frame is in use
+    FramePtr Acquire();
+
+    size_t Capacity();
+    size_t Available();
+    size_t FrameSize();
+    uint64_t Exhausted();
+
+    // bytes mapped for this pool including storage still held by frames after
+    // a Reserve replaced it, and bytes of frames currently acquired
+    size_t ReservedBytes();
+    size_t InUseBytes();
+    bool HugePages();
+
+  private:
+    struct Accounting {
+      std::atomic<size_t> reserved{0};
+      std::atomic<size_t> in_use{0};
+    };
+
+    // buffers of one Reserve call, kept alive until the last of its frames is released
+    struct Storage {
+      Storage(size_t capacity, size_t frame_size, size_t buffer_stride, std::shared_ptr<Accounting> accounting);
+      ~Storage();
+
+      size_t frame_size;
+      MemoryArena arena;
+      std::shared_ptr<Accounting> accounting;
+      std::vector<uint8_t*> buffers;
+      std::vector<Frame> frames;
+      std::unique_ptr<std::atomic<bool>[]> in_use;
+      std::atomic<size_t> available;
+    };
+
+    const size_t capacity;
+    size_t next_slot = 0;
+    std::shared_ptr<Storage> storage;
+    std::atomic<uint64_t> exhausted{0};
+
+    // shared with storages, they may outlive the pool
+    std::shared_ptr<Accounting> accounting;
+
+    // buffers are page aligned so they are usable for direct I/O and SIMD loads
+    const size_t BUFFER_ALIGNMENT = 4096;
+
+    // buffers this many times larger than requested are reallocated
+    const size_t SHRINK_FACTOR = 2;
+};
+
+#endif  // SRC_FRAME_POOL_H_
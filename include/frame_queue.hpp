@@ -0,0 +1,413 @@
+#ifndef SRC_FRAME_QUEUE_H_
+#define SRC_FRAME_QUEUE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <utility>
+#include "clock.hpp"
+#include "notifier.hpp"
+#include "platform.hpp"
+
+// what Push does when the queue is full
+enum class OverflowPolicy {
+  Block,      // wait for the consumer to make room
+  DropOldest, // discard the oldest queued item to make room
+  DropNewest  // discard the item being pushed
+};
+
+// time items spent in the queue since the last TakeLatency call
+struct QueueLatency {
+  uint64_t count = 0;
+  uint64_t average_ns = 0;
+  uint64_t max_ns = 0;
+};
+
+// Bounded lock-free multi-producer/multi-consumer ring buffer.
+//
+// Every slot carries a sequence number telling whether it is free for a
+// producer or filled for a consumer. Producers claim slots with a CAS on the
+// tail index and consumers with a CAS on the head index, which also lets a
+// producer safely discard the oldest item itself under
+// OverflowPolicy::DropOldest. Parallel pipeline stages push into the same
+// queue this way.
+//
+// WaitPop parks the consumer until a producer pushes, so frames are picked
+// up right after they are queued without polling.
+template<typename T>
+class FrameQueue {
+  public:
+    FrameQueue(size_t capacity, OverflowPolicy policy = OverflowPolicy::DropOldest);
+    ~FrameQueue();
+
+    FrameQueue(const FrameQueue&) = delete;
+    FrameQueue& operator=(const FrameQueue&) = delete;
+
+    // producer side
+    bool Push(T item);
+    void Close();
+
+    // takes out everything waiting without counting it as popped, so consumer
+    // statistics only see what consumers took, returns how many items went
+    size_t Discard();
+
+    // consumer side
+    bool Pop(T& item);
+    bool WaitPop(T& item, int64_t timeout_us);
+
+    bool Empty();
+    bool IsClosed();
+    size_t Size();
+    size_t Capacity();
+    OverflowPolicy Policy();
+
+    uint64_t Pushed();
+    uint64_t Popped();
+    uint64_t Dropped();
+    uint64_t DroppedOldest();
+    uint64_t DroppedNewest();
+    uint64_t Discarded();
+    size_t HighWaterMark();
+    QueueLatency TakeLatency();
+
+    // same window as TakeLatency without starting a new one, for readers
+    // other than the one owning the window
+    QueueLatency PeekLatency();
+
+  private:
+    struct alignas(CACHE_LINE_SIZE) Slot {
+      std::atomic<size_t> sequence;
+      uint64_t enqueue_time;
+      T item;
+    };
+
+    bool TryEnqueue(T& item);
+    bool TryDequeue(T& item, uint64_t* enqueue_time = NULL);
+    void UpdateHighWaterMark();
+    void RegisterLatency(uint64_t enqueue_time);
+
+    static size_t RoundUpToPowerOfTwo(size_t value);
+
+    const size_t capacity;
+    const size_t mask;
+    const OverflowPolicy policy;
+    Slot* slots;
+
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> head{0};
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> tail{0};
+
+    // producer side counters
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> pushed{0};
+    std::atomic<uint64_t> dropped_oldest{0};
+    std::atomic<uint64_t> dropped_newest{0};
+    std::atomic<uint64_t> discarded{0};
+    std::atomic<size_t> high_water_mark{0};
+    std::atomic<bool> closed{false};
+
+    // consumer side counters
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> popped{0};
+    std::atomic<uint64_t> latency_count{0};
+    std::atomic<uint64_t> latency_total{0};
+    std::atomic<uint64_t> latency_max{0};
+
+    Notifier not_empty;
+    Notifier not_full;
+};
+
+template<typename T>
+FrameQueue<T>::FrameQueue(size_t capacity, OverflowPolicy policy) :
+  capacity( RoundUpToPowerOfTwo(capacity) ),
+  mask( this->capacity - 1 ),
+  policy( policy ),
+  slots( new Slot[this->capacity] ) {
+  for(size_t i = 0; i < this->capacity; i++) {
+    slots[i].sequence.store(i, std::memory_order_relaxed);
+  }
+}
+
+template<typename T>
+FrameQueue<T>::~FrameQueue() {
+  delete[] slots;
+}
+
+template<typename T>
+size_t FrameQueue<T>::RoundUpToPowerOfTwo(size_t value) {
+  size_t result = 2;
+  while(result < value) {
+    result <<= 1;
+  }
+  return result;
+}
+
+template<typename T>
+bool FrameQueue<T>::TryEnqueue(T& item) {
+  size_t position = tail.load(std::memory_order_relaxed);
+
+  while(true) {
+    Slot& slot = slots[position & mask];
+    size_t sequence = slot.sequence.load(std::memory_order_acquire);
+    intptr_t difference = (intptr_t)sequence - (intptr_t)position;
+
+    if(difference == 0) {
+      if(tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+        slot.item = std::move(item);
+        slot.enqueue_time = MonotonicNow();
+        slot.sequence.store(position + 1, std::memory_order_release);
+        return true;
+      }
+    }
+    else if(difference < 0) {
+      // slot is still owned by a consumer
+      return false;
+    }
+    else {
+      // another producer took this slot
+      position = tail.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+template<typename T>
+bool FrameQueue<T>::TryDequeue(T& item, uint64_t* enqueue_time) {
+  size_t position = head.load(std::memory_order_relaxed);
+
+  while(true) {
+    Slot& slot = slots[position & mask];
+    size_t sequence = slot.sequence.load(std::memory_order_acquire);
+    intptr_t difference = (intptr_t)sequence - (intptr_t)(position + 1);
+
+    if(difference == 0) {
+      if(head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+        item = std::move(slot.item);
+        if(enqueue_time != NULL) {
+          *enqueue_time = slot.enqueue_time;
+        }
+        // drop our reference right away so the slot does not pin the item
+        slot.item = T();
+        slot.sequence.store(position + capacity, std::memory_order_release);
+        return true;
+      }
+    }
+    else if(difference < 0) {
+      // queue is empty
+      return false;
+    }
+    else {
+      position = head.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+template<typename T>
+bool FrameQueue<T>::Push(T item) {
+  while(true) {
+    if(TryEnqueue(item)) {
+      pushed.fetch_add(1, std::memory_order_relaxed);
+      UpdateHighWaterMark();
+      not_empty.Notify();
+      return true;
+    }
+
+    // consumer is in the middle of reading a slot, room is about to appear
+    if(Size() < capacity) {
+      std::this_thread::yield();
+      continue;
+    }
+
+    if(policy == OverflowPolicy::DropNewest) {
+      dropped_newest.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    else if(policy == OverflowPolicy::DropOldest) {
+      T oldest;
+      if(TryDequeue(oldest)) {
+        dropped_oldest.fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+    else {
+      uint32_t epoch = not_full.Prepare();
+      if(IsClosed()) {
+        return false;
+      }
+      if(Size() >= capacity) {
+        not_full.Wait(epoch, -1);
+      }
+    }
+  }
+}
+
+template<typename T>
+bool FrameQueue<T>::Pop(T& item) {
+  uint64_t enqueue_time;
+
+  if(TryDequeue(item, &enqueue_time)) {
+    popped.fetch_add(1, std::memory_order_relaxed);
+    RegisterLatency(enqueue_time);
+
+    if(policy == OverflowPolicy::Block) {
+      not_full.Notify();
+    }
+    return true;
+  }
+  return false;
+}
+
+template<typename T>
+bool FrameQueue<T>::WaitPop(T& item, int64_t timeout_us) {
+  while(true) {
+    if(Pop(item)) {
+      return true;
+    }
+
+    uint32_t epoch = not_empty.Prepare();
+
+    // recheck after taking epoch so a push in between is not missed
+    if(Pop(item)) {
+      return true;
+    }
+
+    if(IsClosed()) {
+      return false;
+    }
+
+    if(!not_empty.Wait(epoch, timeout_us)) {
+      return Pop(item);
+    }
+  }
+}
+
+template<typename T>
+size_t FrameQueue<T>::Discard() {
+  size_t count = 0;
+  T item;
+  while(TryDequeue(item)) {
+    item = T();
+    count++;
+  }
+
+  if(count > 0) {
+    discarded.fetch_add(count, std::memory_order_relaxed);
+    if(policy == OverflowPolicy::Block) {
+      not_full.NotifyAll();
+    }
+  }
+  return count;
+}
+
+template<typename T>
+void FrameQueue<T>::Close() {
+  closed.store(true, std::memory_order_release);
+  not_empty.NotifyAll();
+  not_full.NotifyAll();
+}
+
+template<typename T>
+void FrameQueue<T>::RegisterLatency(uint64_t enqueue_time) {
+  uint64_t latency = MonotonicNow() - enqueue_time;
+
+  latency_count.fetch_add(1, std::memory_order_relaxed);
+  latency_total.fetch_add(latency, std::memory_order_relaxed);
+
+  uint64_t max = latency_max.load(std::memory_order_relaxed);
+  while(latency > max && !latency_max.compare_exchange_weak(max, latency, std::memory_order_relaxed)) {}
+}
+
+template<typename T>
+QueueLatency FrameQueue<T>::TakeLatency() {
+  QueueLatency latency;
+  latency.count = latency_count.exchange(0, std::memory_order_relaxed);
+  uint64_t total = latency_total.exchange(0, std::memory_order_relaxed);
+  latency.max_ns = latency_max.exchange(0, std::memory_order_relaxed);
+
+  if(latency.count > 0) {
+    latency.average_ns = total / latency.count;
+  }
+
+  return latency;
+}
+
+template<typename T>
+QueueLatency FrameQueue<T>::PeekLatency() {
+  QueueLatency latency;
+  latency.count = latency_count.load(std::memory_order_relaxed);
+  uint64_t total = latency_total.load(std::memory_order_relaxed);
+  latency.max_ns = latency_max.load(std::memory_order_relaxed);
+
+  if(latency.count > 0) {
+    latency.average_ns = total / latency.count;
+  }
+
+  return latency;
+}
+
+template<typename T>
+void FrameQueue<T>::UpdateHighWaterMark() {
+  size_t size = Size();
+  size_t high = high_water_mark.load(std::memory_order_relaxed);
+  while(size > high && !high_water_mark.compare_exchange_weak(high, size, std::memory_order_relaxed)) {}
+}
+
+template<typename T>
+bool FrameQueue<T>::Empty() {
+  return Size() == 0;
+}
+
+template<typename T>
+bool FrameQueue<T>::IsClosed() {
+  return closed.load(std::memory_order_acquire);
+}
+
+template<typename T>
+size_t FrameQueue<T>::Size() {
+  size_t current_head = head.load(std::memory_order_acquire);
+  size_t current_tail = tail.load(std::memory_order_acquire);
+  return current_tail > current_head ? current_tail - current_head : 0;
+}
+
+template<typename T>
+size_t FrameQueue<T>::Capacity() {
+  return capacity;
+}
+
+template<typename T>
+OverflowPolicy FrameQueue<T>::Policy() {
+  return policy;
+}
+
+template<typename T>
+uint64_t FrameQueue<T>::Pushed() {
+  return pushed.load(std::memory_order_relaxed);
+}
+
+template<typename T>
+uint64_t FrameQueue<T>::Popped() {
+  return popped.load(std::memory_order_relaxed);
+}
+
+template<typename T>
+uint64_t FrameQueue<T>::Dropped() {
+  return DroppedOldest() + DroppedNewest();
+}
+
+template<typename T>
+uint64_t FrameQueue<T>::DroppedOldest() {
+  return dropped_oldest.load(std::memory_order_relaxed);
+}
+
+template<typename T>
+uint64_t FrameQueue<T>::DroppedNewest() {
+  return dropped_newest.load(std::memory_order_relaxed);
+}
+
+template<typename T>
+uint64_t FrameQueue<T>::Discarded() {
+  return discarded.load(std::memory_order_relaxed);
+}
+
+template<typename T>
+size_t FrameQueue<T>::HighWaterMark() {
+  return high_water_mark.load(std::memory_order_relaxed);
+}
+
+#endif  // SRC_FRAME_QUEUE_H_
@@ -0,0 +1,137 @@
+#ifndef SRC_FRAME_SOURCE_H_
+#define SRC_FRAME_SOURCE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "drop_detector.hpp"
+#include "frame.hpp"
+#include "frame_pool.hpp"
+#include "frame_queue.hpp"
+#include "histogram.hpp"
+#include "load_shedder.hpp"
+#include "roi_profile.hpp"
+
+// Anything that produces frames for the capture pipeline: a camera, a
+// synthetic pattern generator or a replayed recording.
+//
+// Capture runs on its own thread until `run` turns false and pushes every
+// frame into the capture queue. Sources pass finished frames to Deliver which
+// stamps and counts them the same way for every backend, so statistics and
+// metrics do not depend on where frames come from.
+class FrameSource {
+  public:
+    FrameSource(std::atomic<bool>& run, size_t pool_size);
+    virtual ~FrameSource();
+
+    FrameSource(const FrameSource&) = delete;
+    FrameSource& operator=(const FrameSource&) = delete;
+
+    virtual void Capture(FrameQueue<FramePtr>& capture_queue) = 0;
+    virtual std::string Serial() = 0;
+
+    // driver buffers currently held by consumers
+    virtual int LentFrames();
+
+    // switch sensor readout, false when the source cannot do it
+    virtual bool SetRoi(RoiProfile profile);
+
+    // fixed exposure time, false when the source cannot do it
+    virtual bool SetExposure(double microseconds);
+
+    int FPS();
+    uint64_t CapturedFrames();
+    uint64_t IncompleteFrames();
+    uint64_t MissedFrames();
+    LatencyHistogram& HandoffLatency();
+    FramePool& Pool();
+
+    // frames given up before the capture queue when consumers fall behind,
+    // configure before capture starts
+    LoadShedder& Shedder();
+
+    // frames which never reached us, found from camera frame id gaps, split
+    // by where they got lost as far as the source can tell
+    uint64_t DroppedFrames();
+    uint64_t LinkLostFrames();
+    uint64_t DriverDroppedFrames();
+
+    // time from exposure (camera timestamp) to the frame arriving on the host
+    LatencyHistogram& SensorLatency();
+
+    // time between consecutive frames arriving on the host, and how far each
+    // interval is off the running average frame period; gaps from lost frames
+    // and acquisition restarts are left out
+    LatencyHistogram& ArrivalInterval();
+    LatencyHistogram& ArrivalJitter();
+
+    // time acquisition was stopped to apply configuration changes
+    LatencyHistogram& ReconfigureDowntime();
+
+    // time from losing the device until frames flow again, one sample per reconnect
+    LatencyHistogram& RecoveryTime();
+
+  protected:
+    // stamps frame and pushes it, an empty frame counts as missed
+    void Deliver(FramePtr frame, uint64_t grab_time, FrameQueue<FramePtr>& capture_queue);
+
+    void RegisterCaptureStart();
+    void RegisterFrameCapture();
+    void RegisterIncompleteFrame();
+
+    // every frame arriving from the driver, Deliver calls it for frames it gets
+    void RegisterArrival(uint64_t grab_time);
+
+    // every frame the camera sent, delivered or not
+    void RegisterCameraFrame(uint64_t camera_frame_id);
+    void RestartCameraFrames();
+    void RegisterReconfiguration(uint64_t downtime);
+    void RegisterRecovery(uint64_t recovery);
+
+    // running totals of frames lost on the link and discarded by the driver,
+    // read when a frame id gap shows up
+    virtual void ReadLossCounters(uint64_t& link_lost, uint64_t& driver_dropped);
+
+    std::atomic<bool>& run;
+
+    // frames which are copied instead of lent
+    FramePool frame_pool;
+
+  private:
+    uint64_t frame_sequence = 0;
+
+    std::atomic<int> fps{0};
+    long frame_counter = 0;
+    uint64_t second_begin = 0;
+
+    // counted on the capture thread, read by the stats and metrics threads
+    std::atomic<uint64_t> captured_frames{0};
+    std::atomic<uint64_t> incomplete_frames{0};
+    std::atomic<uint64_t> missed_frames{0}; // complete frames with no pool buffer to copy into
+
+    // time from a frame being grabbed to it being queued
+    LatencyHistogram handoff_latency;
+    LatencyHistogram sensor_latency;
+    LatencyHistogram arrival_interval;
+    LatencyHistogram arrival_jitter;
+    LatencyHistogram reconfigure_downtime;
+    LatencyHistogram recovery_time;
+
+    LoadShedder load_shedder;
+
+    uint64_t last_arrival = 0;
+    uint64_t average_interval = 0;
+
+    // weight of a new interval in the running average period is 1/N
+    const int64_t INTERVAL_AVERAGE_WEIGHT = 16;
+
+    DropDetector drop_detector;
+    uint64_t last_link_lost = 0;
+    uint64_t last_driver_dropped = 0;
+    std::atomic<uint64_t> dropped_frames{0};
+    std::atomic<uint64_t> link_lost_frames{0};
+    std::atomic<uint64_t> driver_dropped_frames{0};
+};
+
+#endif  // SRC_FRAME_SOURCE_H_
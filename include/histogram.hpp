@@ -0,0 +1,45 @@
+#ifndef SRC_HISTOGRAM_H_
+#define SRC_HISTOGRAM_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// Lock-free latency histogram with log-linear buckets (HDR style).
+//
+// Every power of two range is split into SUB_BUCKETS linear buckets, so any
+// recorded value is reported within 1/SUB_BUCKETS (about 3%) of its real
+// value while the full 64-bit range fits into a fixed bucket array. Record is
+// a few relaxed atomic adds and may be called from any number of threads.
+class LatencyHistogram {
+  public:
+    LatencyHistogram();
+
+    LatencyHistogram(const LatencyHistogram&) = delete;
+    LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+    void Record(uint64_t value);
+
+    // smallest value at least `quantile` (0..1) of recorded values do not exceed
+    uint64_t Percentile(double quantile);
+
+    uint64_t Count();
+    uint64_t Sum();
+    uint64_t Max();
+
+  private:
+    static size_t BucketIndex(uint64_t value);
+    static uint64_t BucketUpperBound(size_t index);
+
+    static const int SUB_BUCKET_BITS = 5;
+    static const size_t SUB_BUCKETS = (size_t)1 << SUB_BUCKET_BITS;
+    static const size_t BUCKETS = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+    std::unique_ptr<std::atomic<uint64_t>[]> buckets;
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> sum{0};
+    std::atomic<uint64_t> max{0};
+};
+
+#endif  // SRC_HISTOGRAM_H_
@@ -0,0 +1,26 @@
+#ifndef SRC_IMAGE_STATS_H_
+#define SRC_IMAGE_STATS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include "frame.hpp"
+
+// 256 bins per channel, 16-bit samples are binned by their significant bits
+struct ImageHistogram {
+  size_t channels = 0;
+  uint64_t samples[3] = {};
+  uint32_t bins[3][256] = {};
+};
+
+const char* ImageChannelName(size_t channels, size_t channel);
+
+// Histogram, mean and under/over saturation of every channel in a single
+// pass over a raw Mono or Bayer frame, without demosaicing.
+//
+// step samples every step-th 2x2 tile in both directions, 1 reads every
+// pixel. bits is the significant bit depth of 16-bit formats, e.g. 10 or 12
+// for data in the low bits of each sample; 8-bit formats ignore it. Values
+// beyond that depth count as over saturated. histogram may be null.
+bool ComputeImageStats(const Frame& frame, size_t step, int bits, ImageStats& stats, ImageHistogram* histogram);
+
+#endif  // SRC_IMAGE_STATS_H_
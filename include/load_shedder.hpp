@@ -0,0 +1,106 @@
+#ifndef SRC_LOAD_SHEDDER_H_
+#define SRC_LOAD_SHEDDER_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "frame.hpp"
+#include "frame_queue.hpp"
+
+// which frames are given up before they reach the capture queue
+enum class ShedMode {
+  Off,        // queue everything, the queue overflow policy decides
+  EveryNth,   // keep every Nth frame
+  NewestOnly, // a new frame replaces whatever still waits in the queue
+  Adaptive    // decimate as much as needed to keep queue wait within a latency budget
+};
+
+// why a frame was shed, values index the counters
+enum class ShedReason {
+  Decimated,  // skipped by fixed every Nth decimation
+  Superseded, // replaced in the queue by a newer frame
+  Adaptive,   // skipped by adaptive decimation
+  OverBudget, // queue wait would exceed the latency budget
+  Count
+};
+
+const char* ShedReasonName(ShedReason reason);
+
+struct ShedConfig {
+  ShedMode mode = ShedMode::Off;
+  int keep_every = 1;              // EveryNth
+  uint64_t latency_budget = 0;     // Adaptive, ns of queue wait
+};
+
+// "every:N", "newest" or "adaptive:MS", false when text is none of them
+bool ParseShedConfig(std::string text, ShedConfig& config);
+
+// Decides per frame whether it enters the capture queue.
+//
+// Adaptive mode predicts how long a new frame would wait from queue depth and
+// the pace consumers take frames out at. With a pipeline fanning the capture
+// queue out, frames wait in the channels it feeds instead, so those are
+// watched as well and the slowest one decides. Once per control interval decimation
+// doubles when over budget and steps back by one when well under it, frames
+// which would still wait too long are shed right away. A slow consumer sees
+// fresh frames at bounded delay this way instead of a backlog.
+//
+// Admit is called by the thread delivering frames, counters are read from
+// any thread.
+class LoadShedder {
+  public:
+    // must not change while frames are delivered
+    void Configure(ShedConfig config);
+    ShedConfig Config();
+
+    // channel fed from the capture queue which frames wait in as well, it must
+    // outlive delivery and is added before frames are delivered
+    void Watch(FrameQueue<FramePtr>* channel);
+
+    // false when the frame has to be given up
+    bool Admit(FrameQueue<FramePtr>& queue);
+
+    uint64_t Shed(ShedReason reason);
+    uint64_t ShedTotal();
+
+    // keep one of this many frames, 1 while adaptive shedding is idle
+    int Decimation();
+
+    // last predicted queue wait of adaptive mode
+    uint64_t PredictedWait();
+
+  private:
+    // queue frames wait in and the pace its consumer takes them out at
+    struct Channel {
+      FrameQueue<FramePtr>* queue = NULL;
+      uint64_t control_popped = 0;
+      uint64_t consumer_interval = 0; // ns per frame taken out, 0 while unknown
+    };
+
+    bool Decimate(int factor);
+    void Control(FrameQueue<FramePtr>& queue);
+    void Pace(Channel& channel, uint64_t elapsed);
+    size_t Supersede(FrameQueue<FramePtr>& queue);
+    uint64_t Wait();
+    void Count(ShedReason reason);
+
+    ShedConfig config;
+    uint64_t sequence = 0;
+
+    // adaptive control state, only touched by the delivering thread
+    uint64_t control_begin = 0;
+    Channel capture;
+    std::vector<Channel> channels;
+
+    std::atomic<int> decimation{1};
+    std::atomic<uint64_t> predicted_wait{0};
+    std::atomic<uint64_t> shed[(size_t)ShedReason::Count] = {};
+
+    const uint64_t CONTROL_INTERVAL = 100 * 1000 * 1000; // ns between decimation changes
+    const uint64_t MIN_PACE_WINDOW = 10 * 1000 * 1000;   // ns of pops needed before consumer pace is trusted
+    const int MAX_DECIMATION = 64;
+};
+
+#endif  // SRC_LOAD_SHEDDER_H_
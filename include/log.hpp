@@ -0,0 +1,258 @@
+#ifndef SRC_LOG_H_
+#define SRC_LOG_H_
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+enum class LogLevel : uint8_t {
+  Info,
+  Warning, // printed with a "Warning: " prefix
+  Error    // printed with an "Error: " prefix
+};
+
+enum class LogArgumentType : uint8_t {
+  Signed,
+  Unsigned,
+  Float,
+  Text
+};
+
+// One message as the calling thread leaves it, formatted later by the logger
+// thread. Arguments are kept by value, text is copied into the record and cut
+// where it does not fit any more.
+struct LogRecord {
+  static const size_t MAX_ARGUMENTS = 8;
+  static const size_t TEXT_BYTES = 160;
+
+  uint64_t time;
+  const char* format; // string literal, each {} stands for the next argument
+  uint32_t suppressed; // messages of the same format left out right before this one
+  LogLevel level;
+  uint8_t argument_count;
+  uint16_t text_used;
+  LogArgumentType types[MAX_ARGUMENTS];
+
+  union {
+    int64_t signed_value;
+    uint64_t unsigned_value;
+    double float_value;
+    struct {
+      uint16_t offset;
+      uint16_t length;
+    } text;
+  } values[MAX_ARGUMENTS];
+
+  char text[TEXT_BYTES];
+};
+
+static_assert(sizeof(LogRecord) == 256, "log records are meant to be four cache lines");
+
+// Records of one thread, it writes and the logger thread reads.
+class LogRing {
+  public:
+    LogRing(size_t capacity);
+
+    // free record or null when the logger thread fell behind, Commit publishes it
+    LogRecord* Reserve();
+    void Commit();
+
+    // oldest record or null, Release frees it
+    LogRecord* Peek();
+    void Release();
+
+    uint64_t Dropped();
+
+    // set when the writing thread ended, the ring goes once it is empty
+    std::atomic<bool> closed{false};
+
+  private:
+    const size_t capacity;
+    std::unique_ptr<LogRecord[]> records;
+
+    alignas(64) std::atomic<uint64_t> head{0};
+    alignas(64) std::atomic<uint64_t> tail{0};
+    std::atomic<uint64_t> dropped{0};
+};
+
+// Asynchronous log writer.
+//
+// Every thread logs into a ring of its own, so logging takes no lock and never
+// waits: a full ring loses the message and counts it as dropped. A background
+// thread collects records of all threads every few milliseconds, orders them
+// by time, formats them and writes them to stdout in one go.
+//
+// Repeated messages are rate limited per thread and format, messages left out
+// are reported along with the next one of that format which gets through, or
+// on their own once their window passed and the thread logs anything else.
+class Logger {
+  public:
+    static Logger& Instance();
+    ~Logger();
+
+    Logger(const Logger&) = delete;
+    Logger& operator=(const Logger&) = delete;
+
+    // ring of the calling thread, created on first use
+    LogRing* ThreadRing();
+
+    // false when the message is over the rate limit, suppressed is set to the
+    // number of messages left out before one which passes
+    static bool Admit(const char* format, uint64_t now, uint32_t& suppressed);
+
+    // writes everything logged so far, e.g. before the process ends
+    void Flush();
+
+    // queues text to be written as it is, in order with the records logged
+    // before, without waiting for it; lost when too much text is waiting
+    void Write(const std::string& text);
+
+    uint64_t Written();
+    uint64_t Dropped();
+    uint64_t Suppressed();
+
+    // messages of one format per thread within a window before they are left out
+    static const uint32_t RATE_LIMIT_MESSAGES = 10;
+    static const uint64_t RATE_LIMIT_WINDOW = 1000 * 1000 * 1000; // ns
+
+  private:
+    Logger();
+
+    void Run();
+    void Drain();
+    void DrainLocked();
+    void Format(const LogRecord& record, std::string& output);
+
+    struct TextBlock {
+      uint64_t time;
+      std::string text;
+    };
+
+    std::mutex rings_mutex;
+    std::vector<std::shared_ptr<LogRing>> rings;
+
+    // serializes readers of the rings, the logger thread and Flush
+    std::mutex drain_mutex;
+    std::vector<LogRecord> batch;
+    std::string output;
+    uint64_t retired_drops = 0; // of rings of threads which ended
+    uint64_t reported_drops = 0;
+    std::vector<TextBlock> text_batch;
+
+    // blocks of LogText waiting for the logger thread
+    std::mutex text_mutex;
+    std::vector<TextBlock> texts;
+    size_t text_bytes = 0;
+    uint64_t text_drops = 0;
+
+    std::mutex wake_mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+    std::thread thread;
+
+    std::atomic<uint64_t> written{0};
+    std::atomic<uint64_t> suppressed{0};
+
+    const size_t RING_RECORDS = 256;
+    const size_t MAX_TEXT_BYTES = 1024 * 1024; // waiting in texts
+    const int64_t FLUSH_INTERVAL = 10; // ms
+};
+
+template<typename T>
+void AppendLogArgument(LogRecord& record, const T& value) {
+  size_t index = record.argument_count++;
+
+  if constexpr(std::is_same<T, bool>::value) {
+    record.types[index] = LogArgumentType::Unsigned;
+    record.values[index].unsigned_value = value ? 1 : 0;
+  }
+  else if constexpr(std::is_enum<T>::value) {
+    record.types[index] = LogArgumentType::Signed;
+    record.values[index].signed_value = (int64_t)value;
+  }
+  else if constexpr(std::is_integral<T>::value && std::is_signed<T>::value) {
+    record.types[index] = LogArgumentType::Signed;
+    record.values[index].signed_value = value;
+  }
+  else if constexpr(std::is_integral<T>::value) {
+    record.types[index] = LogArgumentType::Unsigned;
+    record.values[index].unsigned_value = value;
+  }
+  else if constexpr(std::is_floating_point<T>::value) {
+    record.types[index] = LogArgumentType::Float;
+    record.values[index].float_value = value;
+  }
+  else {
+    const char* text;
+    size_t length;
+    if constexpr(std::is_convertible<const T&, const char*>::value) {
+      text = value;
+      length = text != nullptr ? std::char_traits<char>::length(text) : 0;
+    }
+    else {
+      text = value.data();
+      length = value.size();
+    }
+
+    size_t space = LogRecord::TEXT_BYTES - record.text_used;
+    length = std::min(length, space);
+    std::char_traits<char>::copy(record.text + record.text_used, text, length);
+
+    record.types[index] = LogArgumentType::Text;
+    record.values[index].text.offset = record.text_used;
+    record.values[index].text.length = length;
+    record.text_used += length;
+  }
+}
+
+LogRecord* BeginLogRecord(LogLevel level, const char* format);
+void CommitLogRecord();
+
+// writes out what was logged so far
+void FlushLog();
+
+// reports of many lines like the periodic stats, in order with the messages
+// logged before and not rate limited; never waits for output but copies the
+// text, so keep it to occasional blocks
+void LogText(const std::string& text);
+
+// Log(LogLevel::Info, "camera {} recovered after {} us", serial, recovery),
+// format has to be a string literal; integers, floats, bools, enums, C strings
+// and std::string are taken as arguments
+template<typename... Args>
+void Log(LogLevel level, const char* format, const Args&... args) {
+  static_assert(sizeof...(Args) <= LogRecord::MAX_ARGUMENTS, "too many log arguments");
+
+  LogRecord* record = BeginLogRecord(level, format);
+  if(record == nullptr) {
+    return;
+  }
+
+  (AppendLogArgument(*record, args), ...);
+  CommitLogRecord();
+}
+
+template<typename... Args>
+void LogInfo(const char* format, const Args&... args) {
+  Log(LogLevel::Info, format, args...);
+}
+
+template<typename... Args>
+void LogWarning(const char* format, const Args&... args) {
+  Log(LogLevel::Warning, format, args...);
+}
+
+template<typename... Args>
+void LogError(const char* format, const Args&... args) {
+  Log(LogLevel::Error, format, args...);
+}
+
+#endif  // SRC_LOG_H_
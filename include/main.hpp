@@ -1,13 +1,31 @@
 #ifndef SRC_MAIN_H_
 #define SRC_MAIN_H_
 
+#include <atomic>
+#include <cstring>
 #include <iostream>
+#include <sstream>
 #include <signal.h>
 #include <sysexits.h>
 #include <sys/sysinfo.h>
-#include <sys/resource.h>
 #include <opencv2/opencv.hpp>
+#include <poll.h>
 #include <termios.h>
 #include "camera.hpp"
+#include "camera_manager.hpp"
+#include "control_client.hpp"
+#include "control_server.hpp"
+#include "demosaic.hpp"
+#include "log.hpp"
+#include "memory_arena.hpp"
+#include "metrics.hpp"
+#include "metrics_server.hpp"
+#include "pipeline.hpp"
+#include "pipeline_config.hpp"
+#include "pipeline_stages.hpp"
+#include "replay_source.hpp"
+#include "roi_profile.hpp"
+#include "scheduling.hpp"
+#include "synthetic_source.hpp"
 
 #endif  // SRC_MAIN_H_
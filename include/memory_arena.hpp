@@ -0,0 +1,58 @@
+#ifndef SRC_MEMORY_ARENA_H_
+#define SRC_MEMORY_ARENA_H_
+
+#include <cstddef>
+#include <cstdint>
+
+// how frame memory is mapped, set once at startup before any pool allocates
+struct ArenaOptions {
+  bool huge_pages = true; // try 2 MB pages first, normal pages when none are reserved
+  bool lock = false;      // keep arenas resident with mlock
+};
+
+void SetArenaOptions(ArenaOptions options);
+ArenaOptions GetArenaOptions();
+
+// process wide totals over every live arena
+size_t ArenaMappedBytes();
+size_t ArenaHugePageBytes();
+size_t ArenaLockedBytes();
+
+// One anonymous mapping for many frame buffers.
+//
+// Mapped with explicit 2 MB huge pages when the system has them reserved,
+// otherwise with normal pages and a transparent huge page hint. Every page is
+// faulted in by the constructor so the capture path never takes a page fault
+// on a fresh buffer. Memory is zeroed and page aligned.
+class MemoryArena {
+  public:
+    MemoryArena(size_t size);
+    ~MemoryArena();
+
+    MemoryArena(const MemoryArena&) = delete;
+    MemoryArena& operator=(const MemoryArena&) = delete;
+
+    // false when the mapping failed, data is null then
+    bool Valid();
+    uint8_t* Data();
+
+    // requested size, mapped size is rounded up to whole pages
+    size_t Size();
+    size_t MappedSize();
+    bool HugePages();
+    bool Locked();
+
+  private:
+    void Prefault();
+    void Lock();
+
+    uint8_t* data = nullptr;
+    size_t size;
+    size_t mapped_size = 0;
+    bool huge_pages = false;
+    bool locked = false;
+
+    static const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+};
+
+#endif  // SRC_MEMORY_ARENA_H_
@@ -0,0 +1,43 @@
+#ifndef SRC_METRICS_H_
+#define SRC_METRICS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "histogram.hpp"
+
+// current resident set size of this process in bytes
+size_t ResidentMemory();
+
+// Collects samples and renders them in the Prometheus text format.
+//
+// Samples of the same metric may be added from different places (one per
+// camera for example), they are grouped under a single HELP/TYPE header as
+// the format requires. Labels are passed preformatted, e.g. `camera="123"`.
+class MetricsWriter {
+  public:
+    void Counter(std::string name, std::string help, std::string labels, uint64_t value);
+    void Gauge(std::string name, std::string help, std::string labels, double value);
+
+    // p50/p99/p999 quantiles plus sum and count, histogram values are nanoseconds
+    // and reported in seconds
+    void Summary(std::string name, std::string help, std::string labels, LatencyHistogram& histogram);
+
+    std::string Text();
+
+  private:
+    struct Family {
+      std::string name;
+      std::string help;
+      std::string type;
+      std::vector<std::string> samples;
+    };
+
+    Family& GetFamily(std::string name, std::string help, std::string type);
+    static std::string Sample(std::string name, std::string labels, std::string value);
+
+    std::vector<Family> families;
+};
+
+#endif  // SRC_METRICS_H_
@@ -0,0 +1,42 @@
+#ifndef SRC_METRICS_SERVER_H_
+#define SRC_METRICS_SERVER_H_
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+
+// Serves metrics to Prometheus over plain HTTP on localhost.
+//
+// Every request, whatever its path, is answered with the text returned by the
+// collect callback. Requests are handled one at a time on a single thread, so
+// the callback never runs concurrently with itself.
+class MetricsServer {
+  public:
+    MetricsServer(std::atomic<bool>& run, int port, std::function<std::string()> collect);
+    ~MetricsServer();
+
+    MetricsServer(const MetricsServer&) = delete;
+    MetricsServer& operator=(const MetricsServer&) = delete;
+
+    // binds the port and starts serving, false when the port cannot be used
+    bool Start();
+    void Join();
+
+    int Port();
+
+  private:
+    void Serve();
+    void Respond(int connection);
+
+    std::atomic<bool>& run;
+    int port;
+    std::function<std::string()> collect;
+    int listen_socket = -1;
+    std::thread thread;
+
+    const int ACCEPT_TIMEOUT = 100;   // milliseconds, bounds how long shutdown goes unnoticed
+    const int REQUEST_TIMEOUT = 1000; // milliseconds to wait for a client to send its request
+};
+
+#endif  // SRC_METRICS_SERVER_H_
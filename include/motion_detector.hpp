@@ -0,0 +1,51 @@
+#ifndef SRC_MOTION_DETECTOR_H_
+#define SRC_MOTION_DETECTOR_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "demosaic.hpp"
+#include "frame.hpp"
+
+// Scores how much of a raw frame changed since the previous one.
+//
+// Every row_step-th row is compared against the same row of the previous
+// frame in blocks of 32 pixels. A block counts as changed when its mean
+// absolute difference exceeds sensitivity, the score is the share of changed
+// blocks in percent. Comparing same positions keeps Bayer colors apart, so
+// frames are scored without demosaicing; 16-bit formats are narrowed to their
+// 8 most significant bits. Only the sampled rows are kept as reference.
+//
+// One MotionDetector must not be used from several threads at once.
+class MotionDetector {
+  public:
+    MotionDetector(int sensitivity = DEFAULT_SENSITIVITY, size_t row_step = DEFAULT_ROW_STEP, SimdLevel simd = DetectSimdLevel());
+
+    // negative for the first frame and after the frame format changed
+    float Score(const Frame& frame);
+
+    // next frame is compared against nothing
+    void Reset();
+
+    SimdLevel Simd();
+
+    static const int DEFAULT_SENSITIVITY = 16;
+    static const size_t DEFAULT_ROW_STEP = 4;
+    static const size_t BLOCK_PIXELS = 32;
+
+  private:
+    const int sensitivity;
+    const size_t row_step;
+    const SimdLevel simd;
+
+    std::vector<uint8_t> reference;
+    std::vector<uint8_t> narrowed;
+    size_t width = 0;
+    size_t height = 0;
+    PixelFormat pixel_format = PixelFormat::Unknown;
+};
+
+// changed blocks among width bytes of a row, copies the row into reference on the way
+size_t CountChangedBlocks(const uint8_t* row, uint8_t* reference, size_t width, int sensitivity, SimdLevel simd);
+
+#endif  // SRC_MOTION_DETECTOR_H_
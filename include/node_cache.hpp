@@ -0,0 +1,27 @@
+#ifndef SRC_NODE_CACHE_H_
+#define SRC_NODE_CACHE_H_
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <Spinnaker.h>
+#include <SpinGenApi/SpinnakerGenApi.h>
+
+// GenICam nodes resolved by name once per node map.
+//
+// A name lookup walks the node map on every call, while node handles stay
+// valid for as long as the camera is initialized. Clear the cache whenever
+// the node maps are replaced (camera deinitialized or reconnected).
+class NodeCache {
+  public:
+    // null when the node map has no such node
+    Spinnaker::GenApi::INode* Get(Spinnaker::GenApi::INodeMap* map, std::string name);
+    void Clear();
+
+  private:
+    std::mutex mutex;
+    std::map<std::pair<Spinnaker::GenApi::INodeMap*, std::string>, Spinnaker::GenApi::INode*> nodes;
+};
+
+#endif  // SRC_NODE_CACHE_H_
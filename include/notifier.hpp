@@ -0,0 +1,41 @@
+#ifndef SRC_NOTIFIER_H_
+#define SRC_NOTIFIER_H_
+
+#include <atomic>
+#include <cstdint>
+#include "platform.hpp"
+
+// Wakes up threads waiting for an event, e.g. a frame being queued.
+//
+// Waiters first spin for a short, adaptive time and then park on a futex.
+// Notify only enters the kernel when somebody is actually parked, so it is
+// cheap enough for the capture hot path.
+//
+// To avoid lost wakeups take the epoch with Prepare, check the condition and
+// only then Wait with that epoch.
+class Notifier {
+  public:
+    uint32_t Prepare();
+
+    // returns false on timeout, timeout_us < 0 waits forever
+    bool Wait(uint32_t epoch, int64_t timeout_us);
+
+    void Notify();
+    void NotifyAll();
+
+  private:
+    bool Spin(uint32_t epoch);
+    bool Park(uint32_t epoch, int64_t timeout_us);
+    void Wake(int count);
+
+    alignas(CACHE_LINE_SIZE) std::atomic<uint32_t> epoch{0};
+    std::atomic<int> waiters{0};
+    std::atomic<int> spin_limit{SPIN_START};
+
+    // spin iterations before parking, adapted to how often spinning pays off
+    static const int SPIN_START = 1000;
+    static const int SPIN_MIN = 50;
+    static const int SPIN_MAX = 20000;
+};
+
+#endif  // SRC_NOTIFIER_H_
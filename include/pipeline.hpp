@@ -0,0 +1,177 @@
+#ifndef SRC_PIPELINE_H_
+#define SRC_PIPELINE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "frame.hpp"
+#include "frame_queue.hpp"
+#include "frame_source.hpp"
+#include "histogram.hpp"
+#include "metrics.hpp"
+#include "pipeline_config.hpp"
+
+// what travels through a channel, checked when a pipeline is built
+enum class FrameKind {
+  Raw,      // frames as captured, any pixel format
+  Converted // BGR8 frames from a convert stage
+};
+
+const char* FrameKindName(FrameKind kind);
+
+// One processing step of a pipeline.
+//
+// A stage takes frames from its input channel and passes what it produces
+// to Emit, which pushes into the channel of every stage fed by it. Channel
+// overflow policy decides whether a slow stage holds up its producer or
+// loses frames.
+class Stage {
+  public:
+    virtual ~Stage();
+
+    // frames the stage takes, and what it emits for input of that kind
+    virtual bool Accepts(FrameKind kind) = 0;
+    virtual FrameKind Produces(FrameKind input);
+
+    virtual void Start(FrameQueue<FramePtr>& input) = 0;
+    virtual void Join() = 0;
+
+    // threads frames are processed on, which a stage may fix regardless of its config
+    virtual int Workers() = 0;
+
+    // stage specific details, the pipeline prints and exports the common ones
+    virtual void PrintStats(std::ostream& out);
+    virtual void WriteMetrics(MetricsWriter& metrics, std::string labels);
+
+    void AddOutput(FrameQueue<FramePtr>* output);
+    uint64_t Processed();
+    LatencyHistogram& ProcessLatency();
+
+  protected:
+    void Emit(const FramePtr& frame);
+
+    std::atomic<uint64_t> processed{0};
+    LatencyHistogram process_latency;
+
+  private:
+    std::vector<FrameQueue<FramePtr>*> outputs;
+};
+
+// Stage running a number of threads which all take frames from the input
+// and pass them through Process. With more than one worker frames leave in
+// the order they finish.
+class WorkerStage : public Stage {
+  public:
+    WorkerStage(std::atomic<bool>& run, int workers);
+    ~WorkerStage();
+
+    void Start(FrameQueue<FramePtr>& input) override;
+    void Join() override;
+    int Workers() override;
+
+  protected:
+    // called from every worker at once, an empty result is not passed on
+    virtual FramePtr Process(const FramePtr& frame) = 0;
+
+  private:
+    void Work(FrameQueue<FramePtr>& input);
+
+    std::atomic<bool>& run;
+    int workers;
+    std::vector<std::thread> threads;
+
+    const int64_t QUEUE_WAIT_TIMEOUT = 100 * 1000; // microseconds, how often workers check run
+};
+
+// worker stage calling a function for every frame and passing the frame on
+class CallbackStage : public WorkerStage {
+  public:
+    typedef std::function<void(const FramePtr& frame)> Callback;
+
+    CallbackStage(std::atomic<bool>& run, int workers, FrameKind kind, Callback callback);
+
+    bool Accepts(FrameKind kind) override;
+
+  protected:
+    FramePtr Process(const FramePtr& frame) override;
+
+  private:
+    FrameKind kind;
+    Callback callback;
+};
+
+// what a stage factory gets to know about the source a pipeline belongs to
+struct StageContext {
+  std::atomic<bool>& run;
+  FrameSource* source;
+  std::string serial;
+};
+
+// creates a stage from its config, null with an error printed when the config is unusable
+typedef std::function<Stage*(const StageConfig& config, StageContext& context)> StageFactory;
+
+// Stages of one frame source connected by bounded channels.
+//
+// Stage types are registered by name and instantiated from a PipelineConfig,
+// so processing steps are added without touching the capture code. Every
+// stage gets its own channel with the size and overflow policy from its
+// config. The capture queue feeds stages with input "source", directly when
+// there is a single one and through a fan-out thread otherwise.
+class Pipeline {
+  public:
+    Pipeline(std::atomic<bool>& run, FrameSource* source, FrameQueue<FramePtr>& source_queue);
+    ~Pipeline();
+
+    Pipeline(const Pipeline&) = delete;
+    Pipeline& operator=(const Pipeline&) = delete;
+
+    static void RegisterStage(std::string type, StageFactory factory);
+
+    // false when a stage type or input is unknown, kinds do not match or inputs form a cycle
+    bool Build(const PipelineConfig& config);
+
+    void Start();
+
+    // releases stages waiting for room in a full channel
+    void Close();
+
+    // stops stages upstream first and drops frames left in channels
+    void Join();
+
+    // stages of a registered type, e.g. "record", to control them while running
+    std::vector<Stage*> Stages(std::string type);
+
+    void PrintStats(std::ostream& out);
+    void WriteMetrics(MetricsWriter& metrics, std::string labels);
+
+  private:
+    struct Node {
+      StageConfig config;
+      std::unique_ptr<Stage> stage;
+      std::unique_ptr<FrameQueue<FramePtr>> channel; // empty when fed by the capture queue directly
+      FrameQueue<FramePtr>* input = NULL;
+    };
+
+    static std::map<std::string, StageFactory>& Registry();
+
+    void FanOut();
+
+    std::atomic<bool>& run;
+    FrameSource* source;
+    FrameQueue<FramePtr>& source_queue;
+
+    // in dependency order, producers before consumers
+    std::vector<std::unique_ptr<Node>> nodes;
+    std::vector<FrameQueue<FramePtr>*> source_outputs;
+    std::thread fan_out;
+
+    const int64_t QUEUE_WAIT_TIMEOUT = 100 * 1000; // microseconds
+};
+
+#endif  // SRC_PIPELINE_H_
@@ -0,0 +1,54 @@
+#ifndef SRC_PIPELINE_CONFIG_H_
+#define SRC_PIPELINE_CONFIG_H_
+
+#include <cstddef>
+#include <map>
+#include <string>
+#include <vector>
+#include "frame_queue.hpp"
+
+// upper bounds of workers and queue in a pipeline description
+const size_t MAX_STAGE_WORKERS = 256;
+const size_t MAX_STAGE_QUEUE_SIZE = 1 << 16; // frames
+
+// one stage of a pipeline and the channel feeding it
+struct StageConfig {
+  std::string name;
+  std::string type;
+  std::string input = "source"; // name of the stage whose output this one takes
+  int workers = 1;
+  size_t queue_size = 64;
+  OverflowPolicy policy = OverflowPolicy::Block;
+
+  // stage type specific settings, e.g. method for convert
+  std::map<std::string, std::string> options;
+
+  std::string Option(std::string key, std::string fallback = "") const;
+};
+
+struct PipelineConfig {
+  std::vector<StageConfig> stages;
+};
+
+// Reads a pipeline description, one section per stage:
+//
+//   # comment
+//   [convert]
+//   type = convert
+//   input = source
+//   workers = 4
+//   queue = 16
+//   policy = block | drop_oldest | drop_newest
+//   method = bilinear
+//
+// The section name names the stage, keys other than the ones above are stage
+// options. Problems are reported on stdout with their line number.
+bool LoadPipelineConfig(std::string path, PipelineConfig& config);
+
+bool ParseOverflowPolicy(std::string name, OverflowPolicy& policy);
+
+// whole number from minimum to maximum, signs and trailing text are rejected,
+// for numeric stage options as well
+bool ParseCount(const std::string& text, size_t minimum, size_t maximum, size_t& count);
+
+#endif  // SRC_PIPELINE_CONFIG_H_
@@ -0,0 +1,231 @@
+#ifndef SRC_PIPELINE_STAGES_H_
+#define SRC_PIPELINE_STAGES_H_
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "conversion_pool.hpp"
+#include "demosaic.hpp"
+#include "frame_pool.hpp"
+#include "image_stats.hpp"
+#include "motion_detector.hpp"
+#include "pipeline.hpp"
+#include "preview.hpp"
+#include "recorder.hpp"
+#include "shm_publisher.hpp"
+
+// Bayer to BGR on a conversion pool, converted frames leave in capture order
+class ConvertStage : public Stage {
+  public:
+    ConvertStage(std::atomic<bool>& run, int workers, DemosaicMethod method);
+    ~ConvertStage();
+
+    bool Accepts(FrameKind kind) override;
+    FrameKind Produces(FrameKind input) override;
+
+    void Start(FrameQueue<FramePtr>& input) override;
+    void Join() override;
+    int Workers() override;
+
+    void PrintStats(std::ostream& out) override;
+    void WriteMetrics(MetricsWriter& metrics, std::string labels) override;
+
+  private:
+    std::atomic<bool>& run;
+    int workers;
+    DemosaicMethod method;
+    std::unique_ptr<ConversionPool> pool;
+};
+
+// raw frames into a recording file, the file is finished when the stage stops,
+// always a single worker so frames are written in order
+class RecordStage : public WorkerStage {
+  public:
+    RecordStage(std::atomic<bool>& run, std::string path, std::string camera);
+
+    bool Accepts(FrameKind kind) override;
+
+    void Start(FrameQueue<FramePtr>& input) override;
+    void Join() override;
+
+    // frames passing while paused are left out, the file stays open
+    void SetPaused(bool paused);
+    bool Paused();
+
+    void PrintStats(std::ostream& out) override;
+    void WriteMetrics(MetricsWriter& metrics, std::string labels) override;
+
+  protected:
+    FramePtr Process(const FramePtr& frame) override;
+
+  private:
+    Recorder recorder;
+    std::atomic<bool> paused{false};
+};
+
+// frames of either kind into a shared memory ring for other local processes,
+// a single worker since the ring has one writer
+class PublishStage : public WorkerStage {
+  public:
+    PublishStage(std::atomic<bool>& run, std::string name, std::string camera, size_t slots);
+
+    bool Accepts(FrameKind kind) override;
+
+    void PrintStats(std::ostream& out) override;
+    void WriteMetrics(MetricsWriter& metrics, std::string labels) override;
+
+  protected:
+    FramePtr Process(const FramePtr& frame) override;
+
+  private:
+    ShmPublisher publisher;
+};
+
+// upper bounds of motion options, held pre-roll frames are copies of full frames
+const size_t MAX_MOTION_SENSITIVITY = 255;
+const size_t MAX_MOTION_ROW_STEP = 256;
+const size_t MAX_MOTION_PRE_ROLL = 100;   // frames
+const size_t MAX_MOTION_POST_ROLL = 10000; // frames
+
+struct MotionConfig {
+  float threshold = 0.5;  // changed share of a frame in percent which counts as motion
+  int sensitivity = MotionDetector::DEFAULT_SENSITIVITY;
+  size_t row_step = MotionDetector::DEFAULT_ROW_STEP;
+  size_t pre_roll = 10;   // still frames kept back and passed on ahead of motion
+  size_t post_roll = 30;  // still frames passed on after motion
+  bool drop = true;       // give up still frames, otherwise pass them on marked still
+};
+
+// Gate placed right after the capture queue which lets through frames with
+// motion and gives up the static ones before they reach conversion or sinks.
+// Frames are scored on raw data by a MotionDetector, pre-roll and post-roll
+// keep motion events whole. While the scene is static the pre-roll frames are
+// held as copies in a pool of the stage, never as lent driver buffers.
+// Marking instead of dropping passes every frame on at once, pre-roll does
+// not apply then. Always a single worker, frames are compared in order.
+class MotionStage : public WorkerStage {
+  public:
+    MotionStage(std::atomic<bool>& run, MotionConfig config);
+
+    bool Accepts(FrameKind kind) override;
+
+    void Join() override;
+
+    void PrintStats(std::ostream& out) override;
+    void WriteMetrics(MetricsWriter& metrics, std::string labels) override;
+
+  protected:
+    FramePtr Process(const FramePtr& frame) override;
+
+  private:
+    // frame to keep in the pre-roll, lent camera buffers are copied out so
+    // a still scene or an unplugged camera doesn't hold the lend budget
+    FramePtr Hold(const FramePtr& frame);
+
+    const MotionConfig config;
+    MotionDetector detector;
+    std::deque<FramePtr> pre_roll;
+    FramePool pre_roll_pool;
+    size_t post_roll_left = 0;
+
+    // read by stats and metrics threads
+    std::atomic<uint64_t> events{0};
+    std::atomic<uint64_t> passed{0};
+    std::atomic<uint64_t> discarded{0};
+    std::atomic<uint64_t> marked{0};
+    std::atomic<float> last_score{-1};
+};
+
+// Exposure statistics of raw frames stored in Frame::stats before they are
+// passed on. The last frame's summary and histogram go to stats and metrics.
+class StatsStage : public WorkerStage {
+  public:
+    StatsStage(std::atomic<bool>& run, int workers, size_t step, int bits);
+
+    bool Accepts(FrameKind kind) override;
+
+    void PrintStats(std::ostream& out) override;
+    void WriteMetrics(MetricsWriter& metrics, std::string labels) override;
+
+  protected:
+    FramePtr Process(const FramePtr& frame) override;
+
+  private:
+    const size_t step;
+    const int bits;
+
+    std::mutex mutex;
+    ImageStats last_stats;
+    ImageHistogram last_histogram;
+    std::atomic<uint64_t> unsupported{0};
+
+    // coarse histogram buckets exported as metrics
+    const size_t METRIC_BUCKETS = 16;
+};
+
+// Downscaled previews of raw frames at a limited rate, see PreviewScaler.
+// Every listed scale of 2, 4 and 8 leaves as a frame of its own, largest
+// first. Frames arriving sooner than the rate allows are not looked at, and a
+// preview is left out rather than waited for while consumers hold every
+// buffer. Always a single worker.
+class PreviewStage : public WorkerStage {
+  public:
+    PreviewStage(std::atomic<bool>& run, std::vector<size_t> scales, double fps);
+
+    bool Accepts(FrameKind kind) override;
+    FrameKind Produces(FrameKind input) override;
+
+    void PrintStats(std::ostream& out) override;
+    void WriteMetrics(MetricsWriter& metrics, std::string labels) override;
+
+  protected:
+    FramePtr Process(const FramePtr& frame) override;
+
+  private:
+    // every level down to the smallest emitted one, levels not emitted go to scratch
+    struct Level {
+      size_t scale;
+      bool emit;
+      std::unique_ptr<FramePool> pool;
+      std::vector<uint8_t> scratch;
+    };
+
+    std::vector<Level> levels;
+    PreviewScaler scaler;
+    const uint64_t interval; // ns between previews, 0 for every frame
+    uint64_t last_preview = 0;
+
+    // read by stats and metrics threads
+    std::atomic<uint64_t> previews{0};
+    std::atomic<uint64_t> rate_limited{0};
+    std::atomic<uint64_t> unavailable{0};
+    std::atomic<uint64_t> unsupported{0};
+
+    // buffers per emitted scale which consumers may hold at once
+    const size_t POOL_FRAMES = 4;
+};
+
+// <directory>/<serial>_<YYYYmmdd-HHMMSS>.rec
+std::string RecordingPath(std::string directory, std::string serial);
+
+bool ParseDemosaicMethod(std::string name, DemosaicMethod& method);
+
+// motion options of a stage config over the defaults in config
+bool ParseMotionConfig(const StageConfig& stage, MotionConfig& config);
+
+// preview scales like "2,4,8", each of them 2, 4 or 8
+bool ParsePreviewScales(std::string list, std::vector<size_t>& scales);
+
+// /spinnaker_capture_<serial>
+std::string PublishName(std::string serial);
+
+// registers convert (option method), record (option directory), publish
+// (options name and slots) and motion (options threshold, sensitivity,
+// row_step, pre_roll, post_roll and mode drop or mark), stats (options step
+// and bits) and preview (options scales and fps); publish takes a suffix to
+// its default name as well
+void RegisterBuiltinStages();
+
+#endif  // SRC_PIPELINE_STAGES_H_
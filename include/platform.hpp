@@ -0,0 +1,19 @@
+#ifndef SRC_PLATFORM_H_
+#define SRC_PLATFORM_H_
+
+#include <cstddef>
+#include <thread>
+
+// keep data written by different threads on separate cache lines
+constexpr size_t CACHE_LINE_SIZE = 64;
+
+// hint to the cpu that we are busy waiting
+inline void CpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#else
+  std::this_thread::yield();
+#endif
+}
+
+#endif  // SRC_PLATFORM_H_
@@ -0,0 +1,36 @@
+#ifndef SRC_PREVIEW_H_
+#define SRC_PREVIEW_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "demosaic.hpp"
+#include "frame.hpp"
+
+// Builds downscaled BGR8 previews straight from raw frames.
+//
+// The half size level bins every 2x2 Bayer tile into one pixel, red and blue
+// from their sample and green from the average of both, so demosaicing and
+// downscaling take a single read of the frame. Smaller levels average 2x2
+// pixels of the level above, by pairs which rounds up. Mono formats are averaged into gray, 16-bit
+// formats are narrowed to their 8 most significant bits.
+//
+// One PreviewScaler must not be used from several threads at once.
+class PreviewScaler {
+  public:
+    PreviewScaler(SimdLevel simd = DetectSimdLevel());
+
+    // half size level, output holds height / 2 rows of width / 2 * 3 bytes
+    bool Bin(const Frame& frame, uint8_t* output, size_t output_stride);
+
+    // BGR8 image into one of half its size, odd last rows and columns are left out
+    void Halve(const uint8_t* input, size_t width, size_t height, size_t input_stride, uint8_t* output, size_t output_stride);
+
+    SimdLevel Simd();
+
+  private:
+    const SimdLevel simd;
+    std::vector<uint8_t> narrowed;
+};
+
+#endif  // SRC_PREVIEW_H_
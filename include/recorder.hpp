@@ -0,0 +1,85 @@
+#ifndef SRC_RECORDER_H_
+#define SRC_RECORDER_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+#include "frame.hpp"
+#include "frame_queue.hpp"
+#include "histogram.hpp"
+#include "metrics.hpp"
+#include "recording_format.hpp"
+
+// Writes raw frames into a recording file (see recording_format.hpp).
+//
+// Record only queues the frame, a dedicated writer thread copies frames into
+// block aligned chunk buffers and writes each chunk with a single large
+// write, using O_DIRECT when the file system supports it. When the writer
+// falls behind, new frames are dropped instead of stalling the caller.
+class Recorder {
+  public:
+    Recorder(std::string path, std::string camera = "", size_t queue_size = RECORD_QUEUE_SIZE);
+    ~Recorder();
+
+    Recorder(const Recorder&) = delete;
+    Recorder& operator=(const Recorder&) = delete;
+
+    // creates the file and starts writer thread
+    bool Start();
+
+    // writes remaining frames, index and closes the file
+    void Stop();
+
+    // never blocks, false when the frame was dropped
+    bool Record(const FramePtr& frame);
+
+    std::string Path();
+    bool DirectIO();
+    uint64_t Recorded();
+    uint64_t Dropped();
+    uint64_t BytesWritten();
+    bool Failed();
+    LatencyHistogram& WriteLatency();
+
+    void WriteMetrics(MetricsWriter& metrics, std::string labels);
+
+  private:
+    void Write();
+    bool Append(const FramePtr& frame);
+    bool FlushChunk();
+    bool WriteIndex();
+    bool WriteBlocks(const uint8_t* data, size_t size);
+    bool EnsureChunkSize(size_t size);
+
+    std::string path;
+    std::string camera;
+    FrameQueue<FramePtr> queue;
+    std::thread writer;
+
+    int fd = -1;
+    std::atomic<bool> direct_io{false};
+    uint64_t file_offset = 0;
+
+    // chunk being filled, block aligned
+    uint8_t* chunk = nullptr;
+    size_t chunk_capacity = 0;
+    size_t chunk_used = 0;
+    uint32_t chunk_records = 0;
+
+    std::vector<RecordHeader> index;
+
+    std::atomic<uint64_t> recorded{0};
+    std::atomic<uint64_t> bytes_written{0};
+    std::atomic<bool> failed{false};
+    LatencyHistogram write_latency;
+
+    const int64_t QUEUE_WAIT_TIMEOUT = 100 * 1000; // microseconds, bounds how long Stop goes unnoticed
+
+    static const size_t RECORD_QUEUE_SIZE = 64;       // frames waiting for the writer
+    static const size_t CHUNK_SIZE = 8 * 1024 * 1024; // bytes per write, grows for larger frames
+};
+
+#endif  // SRC_RECORDER_H_
@@ -0,0 +1,73 @@
+#ifndef SRC_RECORDING_FORMAT_H_
+#define SRC_RECORDING_FORMAT_H_
+
+#include <cstddef>
+#include <cstdint>
+
+// On-disk layout of raw recordings.
+//
+//   file header, padded to RECORDING_BLOCK_SIZE
+//   chunk: chunk header, records, padding up to RECORDING_BLOCK_SIZE
+//   chunk ...
+//   index: one RecordHeader per frame, padding, footer ending the file
+//
+// A record is a RecordHeader followed by the raw pixel data, records start at
+// RECORD_ALIGNMENT boundaries. Chunks are whole blocks so they can be written
+// with O_DIRECT. The index lets readers seek without scanning, when it is
+// missing (recording was cut off) chunks can still be walked one by one.
+//
+// All fields are little endian, as written by the host.
+
+const uint64_t RECORDING_MAGIC = 0x314345524e495053ULL; // "SPINREC1"
+const uint32_t RECORDING_VERSION = 1;
+const uint32_t CHUNK_MAGIC = 0x4b4e4843;                // "CHNK"
+const uint32_t RECORD_MAGIC = 0x4d415246;               // "FRAM"
+const uint64_t INDEX_MAGIC = 0x3158444e49434552ULL;     // "RECINDX1"
+
+// unit of every write, matches logical block size of common disks
+const size_t RECORDING_BLOCK_SIZE = 4096;
+
+// start of every record and its pixel data
+const size_t RECORD_ALIGNMENT = 64;
+
+struct RecordingHeader {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t block_size;
+  uint64_t created;    // wall clock time in ns since epoch
+  char camera[64];     // serial number, zero terminated
+};
+
+struct ChunkHeader {
+  uint32_t magic;
+  uint32_t records;
+  uint64_t size;       // whole chunk including this header and padding
+  uint64_t reserved[6];
+};
+
+// precedes pixel data inside chunks and makes up the index
+struct RecordHeader {
+  uint32_t magic;
+  uint32_t pixel_format; // PixelFormat value
+  uint64_t id;
+  uint64_t grab_time;    // host monotonic time in ns
+  uint64_t offset;       // file offset of pixel data
+  uint64_t size;         // pixel data bytes
+  uint32_t width;
+  uint32_t height;
+  uint32_t stride;
+  uint32_t reserved[3];
+};
+
+// last bytes of a finished recording
+struct IndexFooter {
+  uint64_t magic;
+  uint64_t index_offset;
+  uint64_t records;
+  uint64_t reserved;
+};
+
+static_assert(sizeof(ChunkHeader) == RECORD_ALIGNMENT, "chunk header must keep records aligned");
+static_assert(sizeof(RecordHeader) == RECORD_ALIGNMENT, "record header must keep pixel data aligned");
+
+#endif  // SRC_RECORDING_FORMAT_H_
@@ -0,0 +1,61 @@
+#ifndef SRC_RECORDING_READER_H_
+#define SRC_RECORDING_READER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "frame.hpp"
+#include "recording_format.hpp"
+
+// Random access to recordings written by Recorder.
+//
+// The file is memory mapped read only, frames point straight into the
+// mapping so reading one costs no copy and only touches its own pages. The
+// index at the end of the file is used when present, otherwise it is rebuilt
+// by walking the chunks, which recovers recordings that were cut off.
+class RecordingReader {
+  public:
+    RecordingReader();
+    ~RecordingReader();
+
+    RecordingReader(const RecordingReader&) = delete;
+    RecordingReader& operator=(const RecordingReader&) = delete;
+
+    bool Open(std::string path);
+    void Close();
+
+    size_t Frames();
+    std::string CameraSerial();
+
+    // false when the recording had no index and chunks were scanned instead
+    bool Indexed();
+
+    // frame data is read only and stays valid until the reader is closed
+    bool Read(size_t index, Frame& frame);
+    const RecordHeader& Record(size_t index);
+
+    // position of first frame with id or grab time at least the given one,
+    // Frames() when there is none
+    size_t FindId(uint64_t id);
+    size_t FindTime(uint64_t grab_time);
+
+  private:
+    bool LoadIndex();
+    bool ScanChunks();
+    bool ValidRecord(const RecordHeader& record);
+
+    std::string path;
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+
+    std::string camera;
+    bool indexed = false;
+
+    // points into the mapping when the file has an index
+    const RecordHeader* records = nullptr;
+    size_t record_count = 0;
+    std::vector<RecordHeader> scanned;
+};
+
+#endif  // SRC_RECORDING_READER_H_
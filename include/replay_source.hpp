@@ -0,0 +1,42 @@
+#ifndef SRC_REPLAY_SOURCE_H_
+#define SRC_REPLAY_SOURCE_H_
+
+#include <string>
+#include "frame.hpp"
+#include "frame_source.hpp"
+#include "recording_reader.hpp"
+
+// Streams frames from a recording written by Recorder.
+//
+// Frames keep the spacing they were grabbed with, scaled by `speed`, so a
+// production sequence can be reproduced offline with its original timing.
+// Every frame is copied out of the mapped file into a pool buffer, consumers
+// never see pointers into the recording.
+class ReplaySource : public FrameSource {
+  public:
+    // speed 0 replays as fast as the pipeline takes frames
+    ReplaySource(std::atomic<bool>& run, std::string path, double speed = 1, bool loop = true);
+
+    // false when the recording could not be opened
+    bool IsOpen();
+
+    void Capture(FrameQueue<FramePtr>& capture_queue) override;
+    std::string Serial() override;
+
+  private:
+    // false for records which cannot be a frame, frame stays empty without a pool buffer
+    bool Load(size_t index, FramePtr& frame);
+    void WaitUntil(uint64_t deadline);
+
+    std::string path;
+    double speed;
+    bool loop;
+    bool open;
+    RecordingReader reader;
+
+    const uint64_t MAX_SLEEP = 100 * 1000 * 1000; // ns, bounds how long shutdown goes unnoticed
+
+    static const size_t FRAME_POOL_SIZE = 32;
+};
+
+#endif  // SRC_REPLAY_SOURCE_H_
@@ -0,0 +1,28 @@
+#ifndef SRC_ROI_PROFILE_H_
+#define SRC_ROI_PROFILE_H_
+
+#include <string>
+#include <vector>
+
+// Part of the sensor to read out and how pixels are combined, applied to a
+// camera as one reconfiguration. A smaller readout cuts link bandwidth and
+// lets the camera run at a higher frame rate.
+struct RoiProfile {
+  std::string name;
+
+  // centered region as fraction of the binned and decimated sensor
+  double width = 1;
+  double height = 1;
+
+  // same factor horizontally and vertically, 1 turns it off
+  int binning = 1;
+  int decimation = 1;
+};
+
+// predefined profiles, the first one is the full sensor
+std::vector<RoiProfile> RoiProfiles();
+
+// position of the profile called name, false when there is none
+bool FindRoiProfile(const std::vector<RoiProfile>& profiles, std::string name, size_t& index);
+
+#endif  // SRC_ROI_PROFILE_H_
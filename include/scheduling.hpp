@@ -0,0 +1,29 @@
+#ifndef SRC_SCHEDULING_H_
+#define SRC_SCHEDULING_H_
+
+#include <string>
+#include <thread>
+#include <vector>
+
+// restrict thread to a single cpu, returns false when cpu does not exist or call is refused
+bool PinThread(std::thread& thread, int cpu);
+bool PinCurrentThread(int cpu);
+
+// restrict calling thread to a set of cpus, threads it starts afterwards inherit it
+bool PinCurrentThreadToCpus(std::vector<int> cpus);
+
+// every online cpu not in the list
+std::vector<int> OtherCpus(std::vector<int> cpus);
+
+// SCHED_FIFO at priority 1-99, refused without CAP_SYS_NICE or an rtprio limit
+bool SetRealtimePriority(std::thread& thread, int priority);
+
+// keep pages of the process in RAM, future mappings too when the memlock limit allows it
+bool LockAllMemory();
+
+// parse cpu list like "2,3,6-8"
+std::vector<int> ParseCpuList(std::string cpu_list);
+
+int CpuCount();
+
+#endif  // SRC_SCHEDULING_H_
@@ -0,0 +1,72 @@
+#ifndef SRC_SHM_FORMAT_H_
+#define SRC_SHM_FORMAT_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Layout of the POSIX shared memory segment frames are published in.
+//
+//   header, padded to SHM_PAGE_SIZE
+//   slot headers, one per slot
+//   pixel data, slot_size bytes per slot starting at data_offset
+//
+// Frame n is written to slot n % slot_count. Every slot is a seqlock: its
+// sequence is 2n + 1 while frame n is written and 2n + 2 once it is complete,
+// readers check it before and after looking at a frame and drop frames which
+// changed underneath them. The publisher never waits for readers.
+//
+// After each frame the publisher bumps notify and wakes readers sleeping on it
+// with a shared futex. Readers map the segment read only.
+//
+// When frames outgrow the slots the publisher marks the segment replaced and
+// creates a new one under the same name, readers reopen it.
+
+const uint64_t SHM_MAGIC = 0x314d48534e495053ULL; // "SPINSHM1"
+const uint32_t SHM_VERSION = 1;
+
+// header size and alignment of pixel data
+const size_t SHM_PAGE_SIZE = 4096;
+
+enum ShmState : uint32_t {
+  SHM_LIVE = 0,
+  SHM_REPLACED = 1, // a new segment with larger slots took over the name
+  SHM_CLOSED = 2    // publisher stopped
+};
+
+struct ShmHeader {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t slot_count;
+  uint64_t slot_size;    // pixel data bytes per slot
+  uint64_t data_offset;  // segment offset of the first slot's pixel data
+  uint64_t segment_size;
+  char camera[64];       // serial number, zero terminated
+
+  alignas(64) std::atomic<uint32_t> state;
+  alignas(64) std::atomic<uint64_t> published; // frames published so far
+  alignas(64) std::atomic<uint32_t> notify;    // futex word, changes with every frame
+};
+
+struct alignas(64) ShmSlot {
+  std::atomic<uint64_t> sequence;
+  uint32_t pixel_format; // PixelFormat value
+  uint32_t width;
+  uint32_t height;
+  uint32_t stride;
+  uint64_t size;         // pixel data bytes
+  uint64_t id;
+  uint64_t grab_time;    // host monotonic time in ns
+  uint64_t sensor_time;  // host monotonic time in ns, 0 when unknown
+  uint64_t publish_time; // host monotonic time in ns the frame was complete
+};
+
+// shared between processes, only address free atomics work there
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "shared memory needs lock free 32 bit atomics");
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared memory needs lock free 64 bit atomics");
+static_assert(sizeof(ShmHeader) <= SHM_PAGE_SIZE, "shared memory header must fit its page");
+
+// shm_open name for a camera, e.g. /spinnaker_capture_12345678
+const char SHM_NAME_PREFIX[] = "/spinnaker_capture_";
+
+#endif  // SRC_SHM_FORMAT_H_
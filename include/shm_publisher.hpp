@@ -0,0 +1,63 @@
+#ifndef SRC_SHM_PUBLISHER_H_
+#define SRC_SHM_PUBLISHER_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "frame.hpp"
+#include "shm_format.hpp"
+
+// Publishes frames into a POSIX shared memory ring for readers in other
+// processes, see shm_format.hpp for the layout.
+//
+// The segment is created with the first frame and sized for it, a larger
+// frame replaces it. Publish copies the frame into the next slot and never
+// waits for readers, a slow reader loses frames instead. Single publishing
+// thread only.
+class ShmPublisher {
+  public:
+    ShmPublisher(std::string name, std::string camera, size_t slot_count = DEFAULT_SLOTS);
+    ~ShmPublisher();
+
+    ShmPublisher(const ShmPublisher&) = delete;
+    ShmPublisher& operator=(const ShmPublisher&) = delete;
+
+    // false when the segment could not be created
+    bool Publish(const Frame& frame);
+
+    std::string Name();
+    uint64_t Published();
+    uint64_t Failed();
+    uint64_t Replaced();
+    size_t SegmentSize();
+
+    static const size_t DEFAULT_SLOTS = 8;
+
+    // readers need a slot to read while the next one is written
+    static const size_t MIN_SLOTS = 2;
+    static const size_t MAX_SLOTS = 256;
+
+  private:
+    bool Create(size_t frame_size);
+
+    const std::string name;
+    const std::string camera;
+    const size_t slot_count;
+
+    uint8_t* segment = nullptr;
+    ShmHeader* header = nullptr;
+    ShmSlot* slots = nullptr;
+    uint64_t sequence = 0;
+    uint64_t last_create = 0;
+
+    // read by stats and metrics threads
+    std::atomic<uint64_t> published{0};
+    std::atomic<uint64_t> failed{0};
+    std::atomic<uint64_t> replaced{0};
+    std::atomic<size_t> segment_size{0};
+
+    const uint64_t CREATE_RETRY_INTERVAL = 1000 * 1000 * 1000; // ns
+};
+
+#endif  // SRC_SHM_PUBLISHER_H_
@@ -0,0 +1,79 @@
+#ifndef SRC_SHM_READER_H_
+#define SRC_SHM_READER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <sys/types.h>
+#include "frame.hpp"
+#include "shm_format.hpp"
+
+// Reads frames another process publishes with ShmPublisher.
+//
+// The segment is mapped read only and frames point straight into it, so
+// reading costs no copy. The publisher does not wait for readers: a frame may
+// be overwritten while it is used, Intact tells afterwards whether it was.
+// Copy the data out first when it has to be consistent.
+//
+// A reader that falls more than a ring behind skips to the oldest frame still
+// there, skipped frames are counted as missed. The segment is reopened when
+// the publisher replaces it or comes back after a restart.
+class ShmReader {
+  public:
+    ShmReader();
+    ~ShmReader();
+
+    ShmReader(const ShmReader&) = delete;
+    ShmReader& operator=(const ShmReader&) = delete;
+
+    // starts with the next frame published, false while there is no publisher
+    bool Open(std::string name);
+    void Close();
+    bool IsOpen();
+
+    std::string Name();
+    std::string CameraSerial();
+
+    // next frame in publishing order, waits up to timeout (negative waits
+    // forever), publish_time is when the frame became readable; frame data is
+    // read only and mapped until the next call
+    bool Next(Frame& frame, uint64_t& publish_time, int64_t timeout_us);
+
+    // false when the frame last returned by Next was overwritten since
+    bool Intact();
+
+    uint64_t Read();
+    uint64_t Missed();
+    uint64_t Reopened();
+
+  private:
+    bool Map();
+    void Unmap();
+    bool Abandoned();
+    bool TakeFrame(uint64_t number, Frame& frame, uint64_t& publish_time);
+    bool WaitForPublish(uint32_t notify, uint64_t deadline);
+
+    std::string name;
+    const uint8_t* segment = nullptr;
+    size_t segment_size = 0;
+    ino_t segment_inode = 0;
+    const ShmHeader* header = nullptr;
+    const ShmSlot* slots = nullptr;
+
+    // number of the next frame to read
+    uint64_t next = 0;
+
+    // slot and sequence of the frame Next returned last
+    const ShmSlot* last_slot = nullptr;
+    uint64_t last_sequence = 0;
+
+    uint64_t read = 0;
+    uint64_t missed = 0;
+    uint64_t reopened = 0;
+
+    // microseconds between attempts while there is no segment, and between
+    // checks for a dead publisher while no frames come
+    const int64_t REOPEN_INTERVAL = 100 * 1000;
+};
+
+#endif  // SRC_SHM_READER_H_
@@ -0,0 +1,54 @@
+#ifndef SRC_SYNTHETIC_SOURCE_H_
+#define SRC_SYNTHETIC_SOURCE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "frame.hpp"
+#include "frame_source.hpp"
+
+struct SyntheticConfig {
+  size_t width = 1920;
+  size_t height = 1200;
+  PixelFormat pixel_format = PixelFormat::BayerRG8;
+  double fps = 60; // 0 generates frames as fast as the pipeline takes them
+  std::string name = "synthetic";
+};
+
+// parses WIDTHxHEIGHT[@FPS], e.g. 1920x1200@60
+bool ParseSyntheticConfig(std::string spec, SyntheticConfig& config);
+
+// Generates frames without any hardware.
+//
+// A short loop of test pattern frames (color gradients with a moving bar,
+// mosaiced into the configured Bayer layout) is rendered up front. Every
+// captured frame is copied from that loop into a pool buffer, which costs
+// about the same memory traffic as a real frame coming off the driver.
+// Frames are paced on absolute deadlines so the rate does not drift.
+class SyntheticSource : public FrameSource {
+  public:
+    SyntheticSource(std::atomic<bool>& run, SyntheticConfig config);
+
+    void Capture(FrameQueue<FramePtr>& capture_queue) override;
+    std::string Serial() override;
+
+    // renders one test pattern frame, `phase` moves the bar
+    static void RenderPattern(uint8_t* data, size_t width, size_t height, size_t stride,
+        PixelFormat pixel_format, size_t phase);
+
+  private:
+    FramePtr Generate();
+
+    SyntheticConfig config;
+    size_t stride;
+    std::vector<std::vector<uint8_t>> patterns;
+    size_t next_pattern = 0;
+
+    const int POOL_WAIT = 100; // microseconds between checks for a free pool buffer when unpaced
+
+    static const size_t FRAME_POOL_SIZE = 32;
+    static const size_t PATTERN_FRAMES = 16;
+};
+
+#endif  // SRC_SYNTHETIC_SOURCE_H_
@@ -1,11 +1,98 @@
 #include "camera.hpp"
 
-Camera::Camera(bool& run) : run( run ) {}
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include "clock.hpp"
+#include "log.hpp"
+
+PixelFormat FromSpinnakerPixelFormat(Spinnaker::PixelFormatEnums pixel_format) {
+  switch(pixel_format) {
+    case Spinnaker::PixelFormat_Mono8: return PixelFormat::Mono8;
+    case Spinnaker::PixelFormat_Mono16: return PixelFormat::Mono16;
+    case Spinnaker::PixelFormat_BayerRG8: return PixelFormat::BayerRG8;
+    case Spinnaker::PixelFormat_BayerGB8: return PixelFormat::BayerGB8;
+    case Spinnaker::PixelFormat_BayerGR8: return PixelFormat::BayerGR8;
+    case Spinnaker::PixelFormat_BayerBG8: return PixelFormat::BayerBG8;
+    case Spinnaker::PixelFormat_BayerRG16: return PixelFormat::BayerRG16;
+    case Spinnaker::PixelFormat_BayerGB16: return PixelFormat::BayerGB16;
+    case Spinnaker::PixelFormat_BayerGR16: return PixelFormat::BayerGR16;
+    case Spinnaker::PixelFormat_BayerBG16: return PixelFormat::BayerBG16;
+    case Spinnaker::PixelFormat_BGR8: return PixelFormat::BGR8;
+    default: return PixelFormat::Unknown;
+  }
+}
+
+Spinnaker::PixelFormatEnums ToSpinnakerPixelFormat(PixelFormat pixel_format) {
+  switch(pixel_format) {
+    case PixelFormat::Mono8: return Spinnaker::PixelFormat_Mono8;
+    case PixelFormat::Mono16: return Spinnaker::PixelFormat_Mono16;
+    case PixelFormat::BayerRG8: return Spinnaker::PixelFormat_BayerRG8;
+    case PixelFormat::BayerGB8: return Spinnaker::PixelFormat_BayerGB8;
+    case PixelFormat::BayerGR8: return Spinnaker::PixelFormat_BayerGR8;
+    case PixelFormat::BayerBG8: return Spinnaker::PixelFormat_BayerBG8;
+    case PixelFormat::BayerRG16: return Spinnaker::PixelFormat_BayerRG16;
+    case PixelFormat::BayerGB16: return Spinnaker::PixelFormat_BayerGB16;
+    case PixelFormat::BayerGR16: return Spinnaker::PixelFormat_BayerGR16;
+    case PixelFormat::BayerBG16: return Spinnaker::PixelFormat_BayerBG16;
+    case PixelFormat::BGR8: return Spinnaker::PixelFormat_BGR8;
+    default: return Spinnaker::UNKNOWN_PIXELFORMAT;
+  }
+}
+
+LentDevice::LentDevice(Spinnaker::CameraPtr cam) :
+  cam( cam ) {}
+
+// runs on whichever thread returns the last frame, errors must not escape
+LentDevice::~LentDevice() {
+  try {
+    if(acquiring) {
+      cam->EndAcquisition();
+    }
+    cam->DeInit();
+  }
+  catch (Spinnaker::Exception &e) {
+    // expected when the device is already gone
+  }
+}
+
+FrameEvents::FrameEvents(Camera& camera) :
+  camera( camera ) {}
+
+void FrameEvents::OnImageEvent(Spinnaker::ImagePtr image) {
+  camera.HandleImageEvent(image);
+}
+
+Camera::Camera(std::atomic<bool>& run, std::string serial, Spinnaker::SystemPtr shared_system, FrameHandoff handoff,
+    GrabMode grab_mode) :
+  FrameSource( run, FRAME_POOL_SIZE ),
+  system( shared_system ),
+  // event images belong to the driver once the callback returns, they are never lent
+  handoff( grab_mode == GrabMode::Callback ? FrameHandoff::Copy : handoff ),
+  grab_mode( grab_mode ),
+  exposure_time( EXPOSURE_TIME ),
+  serial( serial ),
+  owns_system( shared_system == 0 ),
+  device_events( serial ),
+  frame_events( *this ) {}
 
 void Camera::Connect() {
   while(run && !camera_connected) {
-    if (ConnectDevice()) {
-      camera_connected = true;
+    uint32_t epoch = device_events.Changed().Prepare();
+
+    // the same device must not be opened while its old handle waits for lent frames
+    if(!retired_device.expired()) {
+      LogInfo("Camera {} waits for {} lent frames before reconnecting", serial, lent_frames.load());
+    }
+    else if (ConnectDevice()) {
+
+      // removal seen before this connection belongs to the old device
+      device_events.TakeRemoved();
+
+      // camera clock may have been reset while it was away
+      clock_mapper.Reset();
+      last_clock_sync = 0;
+
       // Output device information
       PrintDeviceInformation();
 
@@ -16,39 +103,55 @@ void Camera::Connect() {
       PrintDeviceConfiguration();
     }
     else {
-      std::cout << "No camera detected" << std::endl;
+      LogInfo("No camera detected");
       camera_connected = false;
     }
 
     if(!camera_connected) {
-      std::cout << "reconnecting to camera in " << CAMERA_RECONNECT_TIMEOUT << " seconds" << std::endl;
-      sleep(CAMERA_RECONNECT_TIMEOUT);
+      // device arrival wakes us up right away, timeout covers missed events,
+      // waiting in slices keeps shutdown quick
+      LogInfo("waiting for camera, retrying in {} seconds at the latest", CAMERA_RECONNECT_TIMEOUT);
+      uint64_t deadline = MonotonicNow() + CAMERA_RECONNECT_TIMEOUT * 1000000000ULL;
+      while(run && MonotonicNow() < deadline && !device_events.Changed().Wait(epoch, IDLE_SLEEP)) {}
     }
   }
 }
 
+// sets camera_connected once the device is there, configuration comes after
 bool Camera::ConnectDevice() {
-  // Retrieve singleton reference to system object
-  system = Spinnaker::System::GetInstance();
+  std::lock_guard<std::mutex> lock(device_mutex);
+
+  // Retrieve singleton reference to system object unless it is shared with other cameras,
+  // kept until capture ends so reconnecting does not bring the system up again
+  if(system == 0) {
+    system = Spinnaker::System::GetInstance();
+  }
+
+  if(!device_events_registered) {
+    system->RegisterInterfaceEvent(device_events);
+    device_events_registered = true;
+  }
 
   // Retrieve list of cameras from the system
   cam_list = system->GetCameras();
 
-  // Finish if there are no cameras
-  if (cam_list.GetSize() == 0) {
+  // Create shared pointer to camera, first one when no serial number is requested
+  if (cam_list.GetSize() > 0) {
+    cam = serial.empty() ? cam_list.GetByIndex(0) : cam_list.GetBySerial(serial);
+  }
 
-    // Clear camera list before releasing system
-    cam_list.Clear();
+  // Finish if requested camera is not there
+  if (cam_list.GetSize() == 0 || cam == 0) {
+    cam = 0;
 
-    // Release system
-    system->ReleaseInstance();
+    // Clear camera list so the device is free once it shows up
+    cam_list.Clear();
 
-    std::cout << "Camera is not connected" << std::endl;
+    LogInfo("Camera {} is not connected", serial);
     return false;
   }
   else {
-    // Create shared pointer to camera
-    cam = cam_list.GetByIndex(0);
+    lent_device = std::make_shared<LentDevice>(cam);
 
     // Retrieve TL device node_map and print device information
     node_map_tl_device = &cam->GetTLDeviceNodeMap();
@@ -56,12 +159,29 @@ bool Camera::ConnectDevice() {
     // Initialize camera
     cam->Init();
 
+    if(grab_mode == GrabMode::Callback) {
+      cam->RegisterEvent(frame_events);
+      frame_events_registered = true;
+    }
+
     // Retrieve GenICam node_map
     node_map = &cam->GetNodeMap();
 
+    // handles from a previous connection point into released node maps
+    node_cache.Clear();
+
     // Retrieve GenICam stream node_map
     stream_node_map = &cam->GetTLStreamNodeMap();
 
+    // first available camera, only events of the device we got matter from now on
+    if(serial.empty()) {
+      Spinnaker::GenApi::CStringPtr device_serial = node_map_tl_device->GetNode("DeviceSerialNumber");
+      if(Spinnaker::GenApi::IsAvailable(device_serial) && Spinnaker::GenApi::IsReadable(device_serial)) {
+        device_events.Follow(std::string(device_serial->GetValue().c_str()));
+      }
+    }
+
+    camera_connected = true;
     return true;
   }
 }
@@ -72,24 +192,26 @@ void Camera::PrintDeviceInformation() {
     Spinnaker::GenApi::CCategoryPtr category = node_map_tl_device->GetNode("DeviceInformation");
 
     if (Spinnaker::GenApi::IsAvailable(category) && Spinnaker::GenApi::IsReadable(category)) {
-      std::cout << "Camera information" << std::endl;
-      std::cout << "======================" << std::endl;
+      std::ostringstream out;
+      out << "Camera information" << std::endl;
+      out << "======================" << std::endl;
       category->GetFeatures(features);
 
       Spinnaker::GenApi::FeatureList_t::const_iterator it;
       for (it = features.begin(); it != features.end(); ++it) {
         Spinnaker::GenApi::CNodePtr feature_node = *it;
         Spinnaker::GenApi::CValuePtr value = (Spinnaker::GenApi::CValuePtr)feature_node;
-        std::cout << ConfigurationLabel(feature_node->GetName().c_str()) << " " <<
+        out << ConfigurationLabel(feature_node->GetName().c_str()) << " " <<
             (Spinnaker::GenApi::IsReadable(value) ? value->ToString().c_str() : "Node not readable") << std::endl;
       }
+      LogText(out.str());
     }
     else {
-      std::cout << "Device control information not available" << std::endl;
+      LogInfo("Device control information not available");
     }
   }
   catch (Spinnaker::Exception &e) {
-    std::cout << "Error: " << e.what() << std::endl;
+    LogError("{}", e.what());
   }
 }
 
@@ -102,40 +224,42 @@ std::string Camera::ConfigurationLabel(std::string str, const size_t num, const
 
 void Camera::PrintDeviceConfiguration() {
   try {
-    std::cout << "Camera settings" << std::endl;
-    std::cout << "======================" << std::endl;
-    std::cout << ConfigurationLabel("Camera uptime") << " " << GetIntProperty("DeviceUptime") << std::endl;
-    std::cout << ConfigurationLabel("Link uptime") << " " << GetIntProperty("LinkUptime") << std::endl;
-    std::cout << ConfigurationLabel("Power supply voltage") << " " << GetFloatProperty("PowerSupplyVoltage") << std::endl;
-    std::cout << ConfigurationLabel("Power supply current") << " " << GetFloatProperty("PowerSupplyCurrent") << std::endl;
-    std::cout << ConfigurationLabel("ADC bit depth") << " " << GetStringProperty("AdcBitDepth") << std::endl;
-    std::cout << ConfigurationLabel("Auto white balance") << " " << GetStringProperty("BalanceWhiteAuto") << std::endl;
-    std::cout << ConfigurationLabel("Auto gain") << " " << GetStringProperty("GainAuto") << std::endl;
-    std::cout << ConfigurationLabel("Acquisition mode") << " " << GetStringProperty("AcquisitionMode") << std::endl;
-    std::cout << ConfigurationLabel("Pixel format") << " " << GetStringProperty("PixelFormat") << std::endl;
-    std::cout << ConfigurationLabel("Reverse X") << " " << GetBoolProperty("ReverseX") << std::endl;
-    std::cout << ConfigurationLabel("Reverse Y") << " " << GetBoolProperty("ReverseY") << std::endl;
-    std::cout << ConfigurationLabel("Auto exposure") << " " << GetStringProperty("ExposureAuto") << std::endl;
-    std::cout << ConfigurationLabel("Exposure time") << " " << GetFloatProperty("ExposureTime") << std::endl;
-    std::cout << ConfigurationLabel("Frame rate") << " " << GetFloatProperty("AcquisitionFrameRate") << std::endl;
-    std::cout << ConfigurationLabel("Gain") << " " << GetFloatProperty("Gain") << std::endl;
-    std::cout << ConfigurationLabel("Width") << " " << GetIntProperty("Width") << std::endl;
-    std::cout << ConfigurationLabel("Height") << " " << GetIntProperty("Height") << std::endl;
-    std::cout << ConfigurationLabel("Offset X") << " " << GetIntProperty("OffsetX") << std::endl;
-    std::cout << ConfigurationLabel("Offset Y") << " " << GetIntProperty("OffsetY") << std::endl;
-    std::cout << ConfigurationLabel("Buffer handling mode") << " " << GetStringProperty("StreamBufferHandlingMode", stream_node_map) << std::endl;
-    std::cout << ConfigurationLabel("Buffer count mode") << " " << GetStringProperty("StreamBufferCountMode", stream_node_map) << std::endl;
-    std::cout << ConfigurationLabel("Buffer count") << " " << GetIntProperty("StreamBufferCountManual", stream_node_map) << std::endl;
-    std::cout << "======================" << std::endl;
+    std::ostringstream out;
+    out << "Camera settings" << std::endl;
+    out << "======================" << std::endl;
+    out << ConfigurationLabel("Camera uptime") << " " << GetIntProperty("DeviceUptime") << std::endl;
+    out << ConfigurationLabel("Link uptime") << " " << GetIntProperty("LinkUptime") << std::endl;
+    out << ConfigurationLabel("Power supply voltage") << " " << GetFloatProperty("PowerSupplyVoltage") << std::endl;
+    out << ConfigurationLabel("Power supply current") << " " << GetFloatProperty("PowerSupplyCurrent") << std::endl;
+    out << ConfigurationLabel("ADC bit depth") << " " << GetStringProperty("AdcBitDepth") << std::endl;
+    out << ConfigurationLabel("Auto white balance") << " " << GetStringProperty("BalanceWhiteAuto") << std::endl;
+    out << ConfigurationLabel("Auto gain") << " " << GetStringProperty("GainAuto") << std::endl;
+    out << ConfigurationLabel("Acquisition mode") << " " << GetStringProperty("AcquisitionMode") << std::endl;
+    out << ConfigurationLabel("Pixel format") << " " << GetStringProperty("PixelFormat") << std::endl;
+    out << ConfigurationLabel("Reverse X") << " " << GetBoolProperty("ReverseX") << std::endl;
+    out << ConfigurationLabel("Reverse Y") << " " << GetBoolProperty("ReverseY") << std::endl;
+    out << ConfigurationLabel("Auto exposure") << " " << GetStringProperty("ExposureAuto") << std::endl;
+    out << ConfigurationLabel("Exposure time") << " " << GetFloatProperty("ExposureTime") << std::endl;
+    out << ConfigurationLabel("Frame rate") << " " << GetFloatProperty("AcquisitionFrameRate") << std::endl;
+    out << ConfigurationLabel("Gain") << " " << GetFloatProperty("Gain") << std::endl;
+    out << ConfigurationLabel("Width") << " " << GetIntProperty("Width") << std::endl;
+    out << ConfigurationLabel("Height") << " " << GetIntProperty("Height") << std::endl;
+    out << ConfigurationLabel("Offset X") << " " << GetIntProperty("OffsetX") << std::endl;
+    out << ConfigurationLabel("Offset Y") << " " << GetIntProperty("OffsetY") << std::endl;
+    out << ConfigurationLabel("Buffer handling mode") << " " << GetStringProperty("StreamBufferHandlingMode", stream_node_map) << std::endl;
+    out << ConfigurationLabel("Buffer count mode") << " " << GetStringProperty("StreamBufferCountMode", stream_node_map) << std::endl;
+    out << ConfigurationLabel("Buffer count") << " " << GetIntProperty("StreamBufferCountManual", stream_node_map) << std::endl;
+    out << "======================" << std::endl;
+    LogText(out.str());
   }
   catch (Spinnaker::Exception &e) {
-    std::cout << "Error: " << e.what() << std::endl;
+    LogError("{}", e.what());
   }
 }
 
 // check one of the settings whether it is writable
 bool Camera::IsWritable() {
-  Spinnaker::GenApi::CEnumerationPtr property = node_map->GetNode("PixelFormat");
+  Spinnaker::GenApi::CEnumerationPtr property = Node("PixelFormat");
   return Spinnaker::GenApi::IsAvailable(property) && Spinnaker::GenApi::IsWritable(property);
 }
 
@@ -146,7 +270,7 @@ bool Camera::EnsureWritability() {
     return true;
   }
   else {
-    std::cout << "Camera write access has been locked" << std::endl;
+    LogInfo("Camera write access has been locked");
 
     // simply starting and stopping acquisition somehow bring writability back
     // TODO: find correct way how to do this
@@ -157,7 +281,7 @@ bool Camera::EnsureWritability() {
       return true;
     }
     else {
-      std::cout << "Cannot get write access to camera" << std::endl;
+      LogInfo("Cannot get write access to camera");
       return false;
     }
   }
@@ -170,351 +294,832 @@ void Camera::Configure() {
       return;
     }
 
-    if(!UpdateProperty("AdcBitDepth", "Bit10", true)) {
-      return;
-    }
+    ConfigTransaction transaction;
+    transaction.Set("AdcBitDepth", "Bit10", true);
+    transaction.Set("ExposureAuto", "Off", false);
+    transaction.Set("AcquisitionMode", "Continuous", true);
+    transaction.Set("StreamBufferHandlingMode", "OldestFirst", true, stream_node_map);
+    transaction.Set("StreamBufferCountMode", "Manual", true, stream_node_map);
+    transaction.Set("StreamBufferCountManual", SPINNAKER_BUFFER_SIZE, true, stream_node_map);
+    transaction.Set("ExposureTime", exposure_time.load(), false);
 
-    if(!UpdateProperty("ExposureAuto", "Off", false)) {
-      return;
-    }
+    // disable fixed frame rate to get correct max frame rate
+    transaction.SetBool("AcquisitionFrameRateEnable", false, false);
 
-    if(!UpdateProperty("AcquisitionMode", "Continuous", true)) {
-      return;
-    }
+    StageRoi(transaction);
 
-    if(!UpdateProperty("StreamBufferHandlingMode", "OldestFirst", true, stream_node_map)) {
+    if(!Commit(transaction)) {
       return;
     }
 
-    if(!UpdateProperty("StreamBufferCountMode", "Manual", true, stream_node_map)) {
-      return;
-    }
+    EnableChunkData();
+  }
+  catch (Spinnaker::Exception &e) {
+    LogError("{}", e.what());
+  }
+}
 
-    if(!UpdateProperty("StreamBufferCountManual", SPINNAKER_BUFFER_SIZE, true, stream_node_map)) {
-      return;
-    }
+// readout changes take one acquisition stop, frame rate follows on its own
+// since fixed frame rate is disabled
+bool Camera::SetRoi(RoiProfile profile) {
+  {
+    std::lock_guard<std::mutex> lock(roi_mutex);
+    roi = profile;
+  }
 
-    if(!UpdateProperty("ExposureTime", EXPOSURE_TIME, false)) {
-      return;
+  // applied by Configure once the camera is there
+  if(!camera_connected) {
+    return true;
+  }
+
+  bool result = false;
+  try {
+    ConfigTransaction transaction;
+    {
+      std::lock_guard<std::mutex> lock(device_mutex);
+      if(!camera_connected) {
+        return true;
+      }
+      StageRoi(transaction);
     }
+    result = Commit(transaction);
 
-    // disable fixed frame rate to get correct max frame rate
-    if(!UpdateBoolProperty("AcquisitionFrameRateEnable", false, false)) {
-      return;
+    std::lock_guard<std::mutex> lock(device_mutex);
+    if(result && camera_connected) {
+      LogInfo("camera {} roi {}: {}x{} at {},{}, max frame rate {}", serial, profile.name, GetIntProperty("Width"), GetIntProperty("Height"), GetIntProperty("OffsetX"), GetIntProperty("OffsetY"), GetFloatProperty("AcquisitionFrameRate"));
     }
   }
   catch (Spinnaker::Exception &e) {
-    std::cout << "Error: " << e.what() << std::endl;
+    LogError("{}", e.what());
   }
+
+  return result;
 }
 
-double Camera::GetFloatProperty(std::string config_name, Spinnaker::GenApi::INodeMap* map) {
-  if(map == NULL) {
-    map = node_map;
+bool Camera::SetExposure(double microseconds) {
+  exposure_time = microseconds;
+
+  // applied by Configure once the camera is there
+  if(!camera_connected) {
+    return true;
   }
 
-  Spinnaker::GenApi::CFloatPtr property = map->GetNode(config_name.c_str());
-  return property->GetValue();
-}
+  bool result = false;
+  try {
+    ConfigTransaction transaction;
+    transaction.Set("ExposureTime", microseconds, false);
+    result = Commit(transaction);
 
-int Camera::GetIntProperty(std::string config_name, Spinnaker::GenApi::INodeMap* map) {
-  if(map == NULL) {
-    map = node_map;
+    std::lock_guard<std::mutex> lock(device_mutex);
+    if(result && camera_connected) {
+      LogInfo("camera {} exposure time {} us", serial, GetFloatProperty("ExposureTime"));
+    }
+  }
+  catch (Spinnaker::Exception &e) {
+    LogError("{}", e.what());
   }
 
-  Spinnaker::GenApi::CIntegerPtr property = map->GetNode(config_name.c_str());
-  return property->GetValue();
+  return result;
 }
 
-std::string Camera::GetStringProperty(std::string config_name, Spinnaker::GenApi::INodeMap* map) {
-  if(map == NULL) {
-    map = node_map;
+void Camera::StageRoi(ConfigTransaction& transaction) {
+  RoiProfile profile;
+  {
+    std::lock_guard<std::mutex> lock(roi_mutex);
+    profile = roi;
   }
 
-  Spinnaker::GenApi::CEnumerationPtr property = map->GetNode(config_name.c_str());
-  return std::string(property->GetCurrentEntry()->GetSymbolic());
+  // cameras without binning or decimation can still do plain ROI
+  int factor = 1;
+  if(Spinnaker::GenApi::IsAvailable(Node("BinningHorizontal"))) {
+    transaction.Set("BinningHorizontal", profile.binning, true);
+    transaction.Set("BinningVertical", profile.binning, true);
+    factor *= profile.binning;
+  }
+  if(Spinnaker::GenApi::IsAvailable(Node("DecimationHorizontal"))) {
+    transaction.Set("DecimationHorizontal", profile.decimation, true);
+    transaction.Set("DecimationVertical", profile.decimation, true);
+    factor *= profile.decimation;
+  }
+
+  // sizes are computed ahead from the sensor, WidthMax only changes once binning is applied
+  int sensor_width = GetIntProperty("SensorWidth") / factor;
+  int sensor_height = GetIntProperty("SensorHeight") / factor;
+  int width = AlignedValue("Width", sensor_width * profile.width);
+  int height = AlignedValue("Height", sensor_height * profile.height);
+
+  transaction.Set("Width", width, true);
+  transaction.Set("Height", height, true);
+  transaction.Set("OffsetX", AlignedValue("OffsetX", (sensor_width - width) / 2.0), true);
+  transaction.Set("OffsetY", AlignedValue("OffsetY", (sensor_height - height) / 2.0), true);
 }
 
-bool Camera::GetBoolProperty(std::string config_name, Spinnaker::GenApi::INodeMap* map) {
-  if(map == NULL) {
-    map = node_map;
-  }
+// round down to the node increment, at least one increment
+int Camera::AlignedValue(std::string config_name, double value) {
+  Spinnaker::GenApi::CIntegerPtr property = Node(config_name);
+  int increment = std::max<int>(1, property->GetInc());
+  int minimum = property->GetMin();
 
-  Spinnaker::GenApi::CBooleanPtr property = map->GetNode(config_name.c_str());
-  return property->GetValue();
+  int aligned = ((int)value / increment) * increment;
+  return std::max(aligned, minimum);
 }
 
-bool Camera::UpdateBoolProperty(std::string config_name, bool config_value, bool exclusive_write, Spinnaker::GenApi::INodeMap* map) {
-  if(map == NULL) {
-    map = node_map;
+// frame id, timestamp and exposure sent along with every image, capture works
+// without them so failures only turn chunk data off
+void Camera::EnableChunkData() {
+  chunk_data_enabled = false;
+
+  try {
+    ConfigTransaction transaction;
+    transaction.SetBool("ChunkModeActive", true, true);
+
+    const char* chunks[] = { "FrameID", "Timestamp", "ExposureTime" };
+    for(const char* chunk : chunks) {
+      transaction.Set("ChunkSelector", std::string(chunk), false);
+      transaction.SetBool("ChunkEnable", true, true);
+    }
+
+    chunk_data_enabled = Commit(transaction);
   }
+  catch (Spinnaker::Exception &e) {
+    LogError("chunk data not available, {}", e.what());
+  }
+}
 
-  // store update success
-  bool result;
+CameraChunk Camera::ReadChunk(Spinnaker::ImagePtr raw_frame) {
+  CameraChunk chunk;
 
-  Spinnaker::GenApi::CBooleanPtr property = map->GetNode(config_name.c_str());
+  if(!chunk_data_enabled) {
+    return chunk;
+  }
 
-  if(property->GetValue() == config_value) {
-    result = true;
+  try {
+    const Spinnaker::ChunkData& data = raw_frame->GetChunkData();
+    chunk.frame_id = data.GetFrameID();
+    chunk.timestamp = data.GetTimestamp();
+    chunk.exposure_time = data.GetExposureTime();
+    chunk.valid = true;
+  }
+  catch (Spinnaker::Exception &e) {
+    chunk.valid = false;
   }
-  else {
-    if(exclusive_write) {
-      EnsureExclusiveWrite();
-    }
 
-    if (Spinnaker::GenApi::IsAvailable(property) && Spinnaker::GenApi::IsWritable(property)) {
-      property->SetValue(config_value);
-      result = true;
-    }
-    else {
-      std::cout << "Cannot set: " << config_name << std::endl;
-      result = false;
-    }
+  return chunk;
+}
 
-    if(exclusive_write) {
-      EndExclusiveWrite();
+// latch camera clock between two host timestamps, one sample for the clock mapper
+void Camera::SyncClock() {
+  try {
+    Spinnaker::GenApi::CCommandPtr latch = Node("TimestampLatch");
+    Spinnaker::GenApi::CIntegerPtr value = Node("TimestampLatchValue");
+
+    if(!Spinnaker::GenApi::IsAvailable(latch) || !Spinnaker::GenApi::IsWritable(latch) ||
+        !Spinnaker::GenApi::IsAvailable(value) || !Spinnaker::GenApi::IsReadable(value)) {
+      return;
     }
+
+    uint64_t host_before = MonotonicNow();
+    latch->Execute();
+    uint64_t host_after = MonotonicNow();
+
+    clock_mapper.AddSample(value->GetValue(), host_before, host_after);
+  }
+  catch (Spinnaker::Exception &e) {
+    LogError("{}", e.what());
   }
+}
 
-  return result;
+uint64_t Camera::ReadStreamCounter(std::string counter_name) {
+  Spinnaker::GenApi::CIntegerPtr counter = Node(counter_name, stream_node_map);
+
+  if(Spinnaker::GenApi::IsAvailable(counter) && Spinnaker::GenApi::IsReadable(counter)) {
+    return counter->GetValue();
+  }
+
+  return 0;
 }
 
-bool Camera::UpdateProperty(std::string config_name, int config_value, bool exclusive_write, Spinnaker::GenApi::INodeMap* map) {
+void Camera::ReadLossCounters(uint64_t& link_lost, uint64_t& driver_dropped) {
+  try {
+    link_lost = ReadStreamCounter("StreamLostFrameCount");
+    driver_dropped = ReadStreamCounter("StreamDroppedFrameCount");
+  }
+  catch (Spinnaker::Exception &e) {
+    LogError("{}", e.what());
+  }
+}
+
+Spinnaker::GenApi::INode* Camera::Node(std::string config_name, Spinnaker::GenApi::INodeMap* map) {
   if(map == NULL) {
     map = node_map;
   }
 
-  // store update success
-  bool result;
+  return node_cache.Get(map, config_name);
+}
 
-  Spinnaker::GenApi::CIntegerPtr property = map->GetNode(config_name.c_str());
+double Camera::GetFloatProperty(std::string config_name, Spinnaker::GenApi::INodeMap* map) {
+  Spinnaker::GenApi::CFloatPtr property = Node(config_name, map);
+  return property->GetValue();
+}
 
-  if(property->GetValue() == config_value) {
-    result = true;
-  }
-  else {
-    if(exclusive_write) {
-      EnsureExclusiveWrite();
-    }
+int Camera::GetIntProperty(std::string config_name, Spinnaker::GenApi::INodeMap* map) {
+  Spinnaker::GenApi::CIntegerPtr property = Node(config_name, map);
+  return property->GetValue();
+}
 
-    if (Spinnaker::GenApi::IsAvailable(property) && Spinnaker::GenApi::IsWritable(property)) {
-      property->SetValue(config_value);
-      result = true;
-    }
-    else {
-      std::cout << "Cannot set: " << config_name << std::endl;
-      result = false;
-    }
+std::string Camera::GetStringProperty(std::string config_name, Spinnaker::GenApi::INodeMap* map) {
+  Spinnaker::GenApi::CEnumerationPtr property = Node(config_name, map);
+  return std::string(property->GetCurrentEntry()->GetSymbolic());
+}
 
-    if(exclusive_write) {
-      EndExclusiveWrite();
-    }
-  }
+bool Camera::GetBoolProperty(std::string config_name, Spinnaker::GenApi::INodeMap* map) {
+  Spinnaker::GenApi::CBooleanPtr property = Node(config_name, map);
+  return property->GetValue();
+}
 
-  return result;
+bool Camera::UpdateBoolProperty(std::string config_name, bool config_value, bool exclusive_write, Spinnaker::GenApi::INodeMap* map) {
+  ConfigTransaction transaction;
+  transaction.SetBool(config_name, config_value, exclusive_write, map);
+  return Commit(transaction);
+}
+
+bool Camera::UpdateProperty(std::string config_name, int config_value, bool exclusive_write, Spinnaker::GenApi::INodeMap* map) {
+  ConfigTransaction transaction;
+  transaction.Set(config_name, config_value, exclusive_write, map);
+  return Commit(transaction);
 }
 
 bool Camera::UpdateProperty(std::string config_name, double config_value, bool exclusive_write, Spinnaker::GenApi::INodeMap* map) {
-  if(map == NULL) {
-    map = node_map;
-  }
+  ConfigTransaction transaction;
+  transaction.Set(config_name, config_value, exclusive_write, map);
+  return Commit(transaction);
+}
 
-  // store update success
-  bool result;
+bool Camera::UpdateProperty(std::string config_name, std::string config_value, bool exclusive_write, Spinnaker::GenApi::INodeMap* map) {
+  ConfigTransaction transaction;
+  transaction.Set(config_name, config_value, exclusive_write, map);
+  return Commit(transaction);
+}
 
-  Spinnaker::GenApi::CFloatPtr property = map->GetNode(config_name.c_str());
+// apply all staged changes, stopping acquisition once if any of them needs it,
+// false when the device went away meanwhile
+bool Camera::Commit(ConfigTransaction& transaction) {
+  std::lock_guard<std::mutex> lock(config_mutex);
 
-  if(property->GetValue() == config_value) {
-    result = true;
-  }
-  else {
-    if(exclusive_write) {
-      EnsureExclusiveWrite();
-    }
+  std::vector<PropertyChange> changes = transaction.Ordered();
+  transaction.Clear();
 
-    if (Spinnaker::GenApi::IsAvailable(property) && Spinnaker::GenApi::IsWritable(property)) {
-      property->SetValue(config_value);
-      result = true;
+  // changes which already hold their value do not need acquisition stopped,
+  // nodes behind a selector can only be checked once the selector is set
+  bool exclusive_write = false;
+  {
+    std::lock_guard<std::mutex> device_lock(device_mutex);
+    if(!camera_connected) {
+      return false;
     }
-    else {
-      std::cout << "Cannot set: " << config_name << std::endl;
-      result = false;
+
+    bool behind_selector = false;
+    for(PropertyChange& change : changes) {
+      if(change.exclusive_write && (behind_selector || !HasValue(change))) {
+        exclusive_write = true;
+        break;
+      }
+
+      if(change.name.find("Selector") != std::string::npos) {
+        behind_selector = true;
+      }
     }
+  }
+
+  bool stopped = exclusive_write && camera_open;
+  uint64_t stop_begin = MonotonicNow();
+
+  // the capture thread may drop the device while acquisition stops, so this
+  // waits without device_mutex and checks again once it holds it
+  bool capturing = true;
+  if(exclusive_write) {
+    capturing = EnsureExclusiveWrite();
+  }
 
+  bool result = true;
+  try {
+    std::lock_guard<std::mutex> device_lock(device_mutex);
+    result = camera_connected;
+
+    for(PropertyChange& change : changes) {
+      if(!result) {
+        break;
+      }
+      if(!HasValue(change)) {
+        result = Apply(change);
+      }
+    }
+  }
+  catch (Spinnaker::Exception &e) {
     if(exclusive_write) {
-      EndExclusiveWrite();
+      EndExclusiveWrite(capturing);
     }
+    throw;
+  }
+
+  if(exclusive_write) {
+    // downtime ends once the capture thread has acquisition running again
+    if(stopped && capturing) {
+      reconfigure_begin = stop_begin;
+    }
+    EndExclusiveWrite(capturing);
   }
 
   return result;
 }
 
-bool Camera::UpdateProperty(std::string config_name, std::string config_value, bool exclusive_write, Spinnaker::GenApi::INodeMap* map) {
-  if(map == NULL) {
-    map = node_map;
-  }
-
-  // store update success
-  bool result;
+template<typename T> static bool Readable(T& property) {
+  return Spinnaker::GenApi::IsAvailable(property) && Spinnaker::GenApi::IsReadable(property);
+}
 
-  // retrieve the enumeration node from the node_map
-  Spinnaker::GenApi::CEnumerationPtr property = map->GetNode(config_name.c_str());
+// unavailable nodes never hold the value, applying them reports the failure
+bool Camera::HasValue(PropertyChange& change) {
+  Spinnaker::GenApi::INode* node = Node(change.name, change.map);
 
-  // stop here as we already have same value
-  if(std::string(property->GetCurrentEntry()->GetSymbolic()) == config_value) {
-    result = true;
-  }
-  else {
-    if(exclusive_write) {
-      EnsureExclusiveWrite();
+  switch(change.type) {
+    case PropertyType::Integer: {
+      Spinnaker::GenApi::CIntegerPtr property = node;
+      return Readable(property) && property->GetValue() == change.int_value;
+    }
+    case PropertyType::Float: {
+      Spinnaker::GenApi::CFloatPtr property = node;
+      return Readable(property) && property->GetValue() == change.float_value;
+    }
+    case PropertyType::Enumeration: {
+      Spinnaker::GenApi::CEnumerationPtr property = node;
+      return Readable(property) && std::string(property->GetCurrentEntry()->GetSymbolic()) == change.string_value;
+    }
+    case PropertyType::Boolean: {
+      Spinnaker::GenApi::CBooleanPtr property = node;
+      return Readable(property) && property->GetValue() == change.bool_value;
     }
+  }
 
-    if (Spinnaker::GenApi::IsAvailable(property) && Spinnaker::GenApi::IsWritable(property)) {
-      // Retrieve the desired entry node from the enumeration node
-      Spinnaker::GenApi::CEnumEntryPtr entryNode = property->GetEntryByName(config_value.c_str());
+  return false;
+}
 
-      if (Spinnaker::GenApi::IsAvailable(entryNode) && Spinnaker::GenApi::IsReadable(entryNode)) {
-        // Retrieve the integer value from the entry node
-        int64_t propertyValue = entryNode->GetValue();
+bool Camera::Apply(PropertyChange& change) {
+  Spinnaker::GenApi::INode* node = Node(change.name, change.map);
 
-        // Set integer as new value for enumeration node
-        property->SetIntValue(propertyValue);
-        result = true;
-      }
-      else {
-        std::cout << config_name << " " <<  config_value << " not available" << std::endl;
-        result = false;
+  switch(change.type) {
+    case PropertyType::Integer: {
+      Spinnaker::GenApi::CIntegerPtr property = node;
+      if (Spinnaker::GenApi::IsAvailable(property) && Spinnaker::GenApi::IsWritable(property)) {
+        property->SetValue(change.int_value);
+        return true;
       }
+      break;
     }
-    else {
-      std::cout << "Cannot set: " << config_name << std::endl;
-      result = false;
+    case PropertyType::Float: {
+      Spinnaker::GenApi::CFloatPtr property = node;
+      if (Spinnaker::GenApi::IsAvailable(property) && Spinnaker::GenApi::IsWritable(property)) {
+        property->SetValue(change.float_value);
+        return true;
+      }
+      break;
     }
+    case PropertyType::Enumeration: {
+      Spinnaker::GenApi::CEnumerationPtr property = node;
+      if (Spinnaker::GenApi::IsAvailable(property) && Spinnaker::GenApi::IsWritable(property)) {
+        // Retrieve the desired entry node from the enumeration node
+        Spinnaker::GenApi::CEnumEntryPtr entryNode = property->GetEntryByName(change.string_value.c_str());
+
+        if (Spinnaker::GenApi::IsAvailable(entryNode) && Spinnaker::GenApi::IsReadable(entryNode)) {
+          // Set integer value of the entry as new value for enumeration node
+          property->SetIntValue(entryNode->GetValue());
+          return true;
+        }
 
-    if(exclusive_write) {
-      EndExclusiveWrite();
+        LogInfo("{} {} not available", change.name, change.string_value);
+        return false;
+      }
+      break;
+    }
+    case PropertyType::Boolean: {
+      Spinnaker::GenApi::CBooleanPtr property = node;
+      if (Spinnaker::GenApi::IsAvailable(property) && Spinnaker::GenApi::IsWritable(property)) {
+        property->SetValue(change.bool_value);
+        return true;
+      }
+      break;
     }
   }
 
-  return result;
+  LogInfo("Cannot set: {}", change.name);
+  return false;
 }
 
-void Camera::EnsureExclusiveWrite() {
-  Pause();
-  while(camera_open) {
-    IdleSleep();
+// returns whether capture was running, EndExclusiveWrite restores that
+bool Camera::EnsureExclusiveWrite() {
+  bool capturing = Pause();
+  while(true) {
+    uint32_t state = state_changed.Prepare();
+    if(!camera_open || !run) {
+      break;
+    }
+    IdleSleep(state);
   }
+  return capturing;
 }
 
-void Camera::EndExclusiveWrite() {
-  Resume();
+void Camera::EndExclusiveWrite(bool capturing) {
+  Restore(capturing);
 }
 
-void Camera::Capture(std::queue<Spinnaker::ImagePtr>& capture_queue) {
+void Camera::Capture(FrameQueue<FramePtr>& capture_queue) {
   RegisterCaptureStart();
+  event_queue = &capture_queue;
 
-  try {
-    while(run) {
+  while(run) {
+    uint32_t state = state_changed.Prepare();
+
+    try {
       if(!camera_connected) {
         Connect();
       }
 
+      // removal event is quicker than waiting for the driver to give up
+      if(camera_connected && device_events.TakeRemoved()) {
+        LogInfo("Camera {} removed", serial);
+        Disconnect();
+        continue;
+      }
+
       if(camera_connected) {
         MaintainCaptureState();
       }
 
       if(camera_connected && capture) {
-        Spinnaker::ImagePtr raw_frame = cam->GetNextImage();
-
-        if (raw_frame->IsIncomplete()) {
-          std::cout << "Image incomplete with image status " << raw_frame->GetImageStatus() << std::endl;
-        }
-        else {
-          Spinnaker::ImagePtr raw_frame_copy = Spinnaker::Image::Create();
-          raw_frame_copy->DeepCopy(raw_frame);
-          capture_queue.push(raw_frame_copy);
+        if(MonotonicNow() - last_clock_sync >= CLOCK_SYNC_INTERVAL) {
+          SyncClock();
+          last_clock_sync = MonotonicNow();
         }
+      }
 
-        raw_frame->Release();
+      if(camera_connected && capture && grab_mode == GrabMode::Polling) {
+        GrabFrame(capture_queue);
+      }
+      else {
+        IdleSleep(state);
+      }
+    }
+    catch (Spinnaker::Exception &e) {
+      LogError("{}", e.what());
 
-        RegisterFrameCapture();
+      // device is gone or in a bad state, start over with a fresh connection
+      if(camera_connected) {
+        Disconnect();
       }
       else {
-        IdleSleep();
+        IdleSleep(state);
       }
     }
   }
-  catch (Spinnaker::Exception &e) {
-    std::cout << "Error: " << e.what() << std::endl;
-  }
 
-  if(camera_open) {
-    CloseCamera();
-  }
+  // no new frames from the driver thread while the queue is drained
+  StopFrameEvents();
 
-  // Deinitialize camera
-  if(cam != 0) {
-    cam->DeInit();
-  }
+  // lent driver buffers must be back before the system goes
+  ReturnLentFrames(capture_queue);
 
-  // Release reference to the camera
-  cam = 0;
+  {
+    std::lock_guard<std::mutex> lock(device_mutex);
+
+    // nothing is lent any more, so this ends acquisition and deinitializes right away
+    ReleaseDevice();
+
+    // nobody waiting for exclusive write is left hanging
+    camera_open = false;
+    camera_connected = false;
+  }
+  state_changed.NotifyAll();
 
   // Clear camera list before releasing system
   cam_list.Clear();
 
+  if(device_events_registered) {
+    system->UnregisterInterfaceEvent(device_events);
+    device_events_registered = false;
+  }
+
   // Release system
-  if(system != 0) {
+  if(owns_system && system != 0) {
     system->ReleaseInstance();
   }
 }
 
+// drop the device but keep system and configuration for a quick reconnect
+void Camera::Disconnect() {
+  disconnect_time = MonotonicNow();
+
+  StopFrameEvents();
+
+  // commits on other threads see the device gone before they touch it again
+  std::lock_guard<std::mutex> lock(device_mutex);
+
+  // lent frames keep the device and their buffers until they are back
+  ReleaseDevice();
+
+  cam_list.Clear();
+  node_cache.Clear();
+  stream_buffers.reset();
+  device_events.Follow(serial);
+
+  camera_open = false;
+  camera_connected = false;
+  state_changed.NotifyAll();
+}
+
+// bounded wait so pause, reconfiguration and shutdown are noticed without a frame arriving
+void Camera::GrabFrame(FrameQueue<FramePtr>& capture_queue) {
+  Spinnaker::ImagePtr raw_frame;
+
+  try {
+    raw_frame = cam->GetNextImage(GRAB_TIMEOUT);
+  }
+  catch (Spinnaker::Exception &e) {
+    // no frame yet, e.g. waiting for a trigger
+    if(e.GetError() == Spinnaker::SPINNAKER_ERR_TIMEOUT) {
+      return;
+    }
+    throw;
+  }
+
+  ProcessFrame(raw_frame, capture_queue);
+}
+
+// runs on the driver event thread, errors must not escape into the driver
+void Camera::HandleImageEvent(Spinnaker::ImagePtr raw_frame) {
+  std::lock_guard<std::mutex> lock(frame_event_mutex);
+
+  // acquisition is being stopped, the driver takes its image back after the callback
+  if(!accept_frame_events || event_queue == NULL) {
+    return;
+  }
+
+  try {
+    ProcessFrame(raw_frame, *event_queue);
+  }
+  catch (Spinnaker::Exception &e) {
+    LogError("{}", e.what());
+  }
+}
+
+void Camera::ProcessFrame(Spinnaker::ImagePtr raw_frame, FrameQueue<FramePtr>& capture_queue) {
+  uint64_t grab_time = MonotonicNow();
+
+  // chunk frame id survives incomplete frames, gaps in it are frames we never saw
+  CameraChunk chunk = ReadChunk(raw_frame);
+  RegisterCameraFrame(chunk.valid ? chunk.frame_id : raw_frame->GetFrameID());
+
+  if (raw_frame->IsIncomplete()) {
+    LogWarning("Image incomplete with image status {}", raw_frame->GetImageStatus());
+    ReleaseRawFrame(raw_frame);
+    RegisterIncompleteFrame();
+    RegisterArrival(grab_time);
+  }
+  else {
+    // driver buffer is released by HandOff or once the consumer drops the frame
+    FramePtr frame = HandOff(raw_frame);
+    if(frame) {
+      frame->chunk = chunk;
+      if(chunk.valid) {
+        frame->sensor_time = clock_mapper.ToHost(chunk.timestamp);
+      }
+    }
+
+    Deliver(frame, grab_time, capture_queue);
+
+    // first frame after losing the device
+    uint64_t lost = disconnect_time.exchange(0);
+    if(lost != 0) {
+      uint64_t recovery = MonotonicNow() - lost;
+      RegisterRecovery(recovery);
+      LogInfo("Camera {} recovered after {} us", serial, recovery / 1000);
+    }
+  }
+
+  RegisterFrameCapture();
+}
+
+// after this returns no image event is queuing frames until acquisition opens again
+void Camera::StopFrameEvents() {
+  accept_frame_events = false;
+  std::lock_guard<std::mutex> lock(frame_event_mutex);
+}
+
+void Camera::UnregisterFrameEvents() {
+  if(frame_events_registered) {
+    cam->UnregisterEvent(frame_events);
+    frame_events_registered = false;
+  }
+}
+
+FramePtr Camera::HandOff(Spinnaker::ImagePtr raw_frame) {
+  FramePtr frame;
+
+  if(handoff == FrameHandoff::ZeroCopy && lent_frames.load() < SPINNAKER_BUFFER_SIZE - SPINNAKER_RESERVED_BUFFERS) {
+    frame = LendFrame(raw_frame);
+  }
+  else {
+    frame = CopyFrame(raw_frame);
+  }
+
+  return frame;
+}
+
+FramePtr Camera::LendFrame(Spinnaker::ImagePtr raw_frame) {
+  Frame* frame = new Frame();
+  frame->data = (uint8_t*)raw_frame->GetData();
+  frame->size = raw_frame->GetImageSize();
+  frame->width = raw_frame->GetWidth();
+  frame->height = raw_frame->GetHeight();
+  frame->stride = raw_frame->GetStride();
+  frame->pixel_format = FromSpinnakerPixelFormat(raw_frame->GetPixelFormat());
+  frame->zero_copy = true;
+
+  lent_frames++;
+
+  // give buffer back to the driver once the last consumer is done with it,
+  // a device dropped meanwhile goes with its last frame and its buffers after it
+  std::shared_ptr<LentDevice> device = lent_device;
+  std::shared_ptr<MemoryArena> buffers = stream_buffers;
+  return FramePtr(frame, [this, raw_frame, device, buffers](Frame* frame) mutable {
+    try {
+      raw_frame->Release();
+    }
+    catch (Spinnaker::Exception &e) {
+      // expected when the device is already gone
+    }
+    raw_frame = 0;
+    device.reset();
+    buffers.reset();
+
+    lent_frames--;
+    delete frame;
+  });
+}
+
+FramePtr Camera::CopyFrame(Spinnaker::ImagePtr raw_frame) {
+  size_t size = raw_frame->GetImageSize();
+  FramePtr frame;
+
+  if(frame_pool.Reserve(size)) {
+    frame = frame_pool.Acquire();
+  }
+
+  if(frame) {
+    memcpy(frame->data, raw_frame->GetData(), size);
+    frame->size = size;
+    frame->width = raw_frame->GetWidth();
+    frame->height = raw_frame->GetHeight();
+    frame->stride = raw_frame->GetStride();
+    frame->pixel_format = FromSpinnakerPixelFormat(raw_frame->GetPixelFormat());
+  }
+
+  ReleaseRawFrame(raw_frame);
+
+  return frame;
+}
+
+// grabbed images are ours to give back, event images are released by the
+// driver once the image event callback returns
+void Camera::ReleaseRawFrame(Spinnaker::ImagePtr raw_frame) {
+  if(grab_mode == GrabMode::Polling) {
+    raw_frame->Release();
+  }
+}
+
+void Camera::ReturnLentFrames(FrameQueue<FramePtr>& capture_queue) {
+  // frames still waiting in queue will never be consumed
+  FramePtr frame;
+  while(capture_queue.Pop(frame)) {
+    frame.reset();
+  }
+
+  WaitLentFrames();
+}
+
+// the driver must not go or stop acquisition while consumers read its
+// buffers, so there is no giving up, pipelines are joined before the cameras
+// and let go of theirs, running ones hold lent frames only briefly
+void Camera::WaitLentFrames() {
+  int waited = 0;
+  while(lent_frames.load() > 0) {
+    usleep(IDLE_SLEEP);
+    waited += IDLE_SLEEP;
+
+    if(waited >= LENT_FRAMES_REPORT_INTERVAL) {
+      LogWarning("waiting for {} frames to be returned to camera driver", lent_frames.load());
+      waited = 0;
+    }
+  }
+}
+
+// hand the device over to the frames lent from it, the last of them ends
+// acquisition and deinitializes it, right away when none are out
+void Camera::ReleaseDevice() {
+  try {
+    UnregisterFrameEvents();
+  }
+  catch (Spinnaker::Exception &e) {
+    // expected when the device is already gone
+  }
+  frame_events_registered = false;
+
+  if(lent_device) {
+    lent_device->acquiring = camera_open;
+    retired_device = lent_device;
+    lent_device.reset();
+  }
+
+  cam = 0;
+}
+
 bool Camera::CloseCamera() {
+  StopFrameEvents();
+
+  // ending acquisition requeues the stream buffers, and reopening after a
+  // reconfiguration may hand the driver a new arena, consumers still reading
+  // lent ones finish first
+  WaitLentFrames();
   cam->EndAcquisition();
   return true;
 }
 
 bool Camera::OpenCamera() {
+  // frame ids and stream counters start over with acquisition
+  RestartCameraFrames();
+
+  PrepareStreamBuffers();
   cam->BeginAcquisition();
+  accept_frame_events = true;
   return true;
 }
 
-int Camera::FPS() {
-  return fps;
+// hand the driver prefaulted, optionally locked memory instead of letting it
+// allocate, a larger readout after a ROI change gets a new arena
+void Camera::PrepareStreamBuffers() {
+#ifdef SPINNAKER_USER_BUFFERS
+  size_t size = (size_t)GetIntProperty("PayloadSize") * SPINNAKER_BUFFER_SIZE;
+  if(size == 0 || (stream_buffers && stream_buffers->Size() >= size)) {
+    return;
+  }
+
+  std::shared_ptr<MemoryArena> buffers = std::make_shared<MemoryArena>(size);
+  if(!buffers->Valid()) {
+    return;
+  }
+
+  cam->SetUserBuffers(buffers->Data(), buffers->Size());
+  stream_buffers = buffers;
+#endif
+}
+
+std::string Camera::Serial() {
+  return serial;
+}
+
+int Camera::LentFrames() {
+  return lent_frames.load();
 }
 
 void Camera::MaintainCaptureState() {
   if(!capture && camera_open) {
     camera_open = !CloseCamera();
+    state_changed.NotifyAll();
   }
   else if(capture && !camera_open) {
     camera_open = OpenCamera();
-  }
-}
-
-void Camera::IdleSleep() {
-  usleep(IDLE_SLEEP); // 100 miliseconds or 0.1 second
-}
-
-void Camera::RegisterCaptureStart() {
-  time_begin = std::time(0);
-}
+    state_changed.NotifyAll();
 
-void Camera::RegisterFrameCapture() {
-  // 1 second passed
-  if ((std::time(0) - time_begin) >= 1) {
-    fps = frame_counter;
-    frame_counter = 0;
-    time_begin = std::time(0);
+    uint64_t begin = reconfigure_begin.exchange(0);
+    if(camera_open && begin != 0) {
+      uint64_t downtime = MonotonicNow() - begin;
+      RegisterReconfiguration(downtime);
+      LogInfo("camera {} reconfigured, acquisition stopped for {} us", serial, downtime / 1000);
+    }
   }
+}
 
-  frame_counter++;
+// wait until capture state changes after `state` was taken or IDLE_SLEEP passes
+void Camera::IdleSleep(uint32_t state) {
+  state_changed.Wait(state, IDLE_SLEEP);
 }
 
-void Camera::Pause() {
-  capture = false;
+// returns whether capture was running
+bool Camera::Pause() {
+  bool capturing = capture.exchange(false);
+  state_changed.NotifyAll();
+  return capturing;
 }
 
-void Camera::Resume() {
-  capture = true;
+void Camera::Restore(bool capturing) {
+  capture = capturing;
+  state_changed.NotifyAll();
 }
@@ -0,0 +1,233 @@
+#include "camera_manager.hpp"
+
+#include "log.hpp"
+#include "scheduling.hpp"
+
+CameraManager::CameraManager(std::atomic<bool>& run, size_t queue_size, OverflowPolicy queue_policy) :
+  run( run ),
+  queue_size( queue_size ),
+  queue_policy( queue_policy ) {}
+
+CameraManager::~CameraManager() {
+  Join();
+
+  // cameras have to release their devices before system goes away
+  units.clear();
+
+  if(system != 0) {
+    system->ReleaseInstance();
+  }
+}
+
+std::vector<std::string> CameraManager::Enumerate() {
+  std::vector<std::string> serials;
+
+  try {
+    Spinnaker::CameraList cam_list = System()->GetCameras();
+
+    for(unsigned int i = 0; i < cam_list.GetSize(); i++) {
+      Spinnaker::CameraPtr cam = cam_list.GetByIndex(i);
+      Spinnaker::GenApi::CStringPtr serial = cam->GetTLDeviceNodeMap().GetNode("DeviceSerialNumber");
+
+      if(Spinnaker::GenApi::IsAvailable(serial) && Spinnaker::GenApi::IsReadable(serial)) {
+        serials.push_back(std::string(serial->GetValue().c_str()));
+      }
+    }
+
+    // Clear camera list so devices are free for capture threads
+    cam_list.Clear();
+  }
+  catch (Spinnaker::Exception &e) {
+    LogError("{}", e.what());
+  }
+
+  return serials;
+}
+
+// Retrieve singleton reference to system object on first use, shared by all cameras
+Spinnaker::SystemPtr CameraManager::System() {
+  if(system == 0) {
+    system = Spinnaker::System::GetInstance();
+  }
+
+  return system;
+}
+
+void CameraManager::Add(std::string serial, int cpu, GrabMode grab_mode) {
+  AddSource(new Camera(run, serial, System(), FrameHandoff::ZeroCopy, grab_mode), cpu);
+}
+
+void CameraManager::AddSource(FrameSource* source, int cpu) {
+  std::unique_ptr<CaptureUnit> unit(new CaptureUnit());
+  unit->serial = source->Serial();
+  unit->cpu = cpu;
+  unit->source.reset(source);
+  unit->queue.reset(new FrameQueue<FramePtr>(queue_size, queue_policy));
+  units.push_back(std::move(unit));
+}
+
+size_t CameraManager::Size() {
+  return units.size();
+}
+
+void CameraManager::Start() {
+  for(std::unique_ptr<CaptureUnit>& unit : units) {
+    unit->thread = std::thread(&FrameSource::Capture, unit->source.get(), std::ref(*unit->queue));
+
+    if(unit->cpu >= 0) {
+      PinThread(unit->thread, unit->cpu);
+    }
+
+    if(realtime_priority > 0 && SetRealtimePriority(unit->thread, realtime_priority)) {
+      unit->priority = realtime_priority;
+    }
+  }
+}
+
+// release consumers waiting on queues and producers waiting for free space
+void CameraManager::Close() {
+  for(std::unique_ptr<CaptureUnit>& unit : units) {
+    unit->queue->Close();
+  }
+}
+
+void CameraManager::Join() {
+  for(std::unique_ptr<CaptureUnit>& unit : units) {
+    if(unit->thread.joinable()) {
+      unit->thread.join();
+    }
+  }
+}
+
+FrameSource* CameraManager::GetSource(size_t index) {
+  return units[index]->source.get();
+}
+
+FrameQueue<FramePtr>& CameraManager::Queue(size_t index) {
+  return *units[index]->queue;
+}
+
+void CameraManager::SetRoi(RoiProfile profile) {
+  for(std::unique_ptr<CaptureUnit>& unit : units) {
+    if(!unit->source->SetRoi(profile)) {
+      LogInfo("camera {} cannot switch to roi {}", unit->serial.empty() ? "default" : unit->serial, profile.name);
+    }
+  }
+}
+
+bool CameraManager::SetExposure(double microseconds) {
+  bool result = true;
+  for(std::unique_ptr<CaptureUnit>& unit : units) {
+    if(!unit->source->SetExposure(microseconds)) {
+      LogInfo("camera {} cannot set exposure time {} us", unit->serial.empty() ? "default" : unit->serial, microseconds);
+      result = false;
+    }
+  }
+  return result;
+}
+
+void CameraManager::SetRealtime(int priority) {
+  realtime_priority = priority;
+}
+
+std::vector<int> CameraManager::Cpus() {
+  std::vector<int> cpus;
+  for(std::unique_ptr<CaptureUnit>& unit : units) {
+    if(unit->cpu >= 0) {
+      cpus.push_back(unit->cpu);
+    }
+  }
+  return cpus;
+}
+
+void CameraManager::SetShedding(ShedConfig config) {
+  for(std::unique_ptr<CaptureUnit>& unit : units) {
+    unit->source->Shedder().Configure(config);
+  }
+}
+
+void CameraManager::PrintStats(std::ostream& out, bool new_window) {
+  int total_fps = 0;
+
+  for(std::unique_ptr<CaptureUnit>& unit : units) {
+    FrameSource* source = unit->source.get();
+    FrameQueue<FramePtr>& queue = *unit->queue;
+    QueueLatency latency = new_window ? queue.TakeLatency() : queue.PeekLatency();
+
+    total_fps += source->FPS();
+
+    out << "camera " << (unit->serial.empty() ? "default" : unit->serial) <<
+        " (cpu " << unit->cpu << (unit->priority > 0 ? ", fifo " + std::to_string(unit->priority) : "") << ")" <<
+        ", fps: " << source->FPS() <<
+        ", queue: " << queue.Size() << "/" << queue.Capacity() <<
+        ", high water: " << queue.HighWaterMark() <<
+        ", dropped: " << queue.Dropped() <<
+        ", queue latency avg/max us: " << latency.average_ns / 1000 << "/" << latency.max_ns / 1000 <<
+        ", handoff p50/p99 us: " << source->HandoffLatency().Percentile(0.5) / 1000 <<
+        "/" << source->HandoffLatency().Percentile(0.99) / 1000 <<
+        ", sensor p50/p99 us: " << source->SensorLatency().Percentile(0.5) / 1000 <<
+        "/" << source->SensorLatency().Percentile(0.99) / 1000 <<
+        ", jitter p50/p99/max us: " << source->ArrivalJitter().Percentile(0.5) / 1000 <<
+        "/" << source->ArrivalJitter().Percentile(0.99) / 1000 <<
+        "/" << source->ArrivalJitter().Max() / 1000 <<
+        ", incomplete: " << source->IncompleteFrames() <<
+        ", camera dropped: " << source->DroppedFrames() <<
+        " (link " << source->LinkLostFrames() << ", driver " << source->DriverDroppedFrames() << ")" <<
+        ", reconnects: " << source->RecoveryTime().Count() <<
+        ", shed: " << source->Shedder().ShedTotal() <<
+        " (keep 1/" << source->Shedder().Decimation() << ")" <<
+        ", lent: " << source->LentFrames() <<
+        ", pool free: " << source->Pool().Available() << "/" << source->Pool().Capacity() <<
+        ", pool exhausted: " << source->Pool().Exhausted() <<
+        ", pool MB in use/reserved: " << source->Pool().InUseBytes() / (1024 * 1024) <<
+        "/" << source->Pool().ReservedBytes() / (1024 * 1024) << std::endl;
+  }
+
+  if(units.size() > 1) {
+    out << "total fps: " << total_fps << std::endl;
+  }
+}
+
+std::string CameraManager::Labels(size_t index) {
+  std::string serial = units[index]->serial;
+  return "camera=\"" + (serial.empty() ? std::string("default") : serial) + "\"";
+}
+
+void CameraManager::WriteMetrics(MetricsWriter& metrics) {
+  for(size_t i = 0; i < units.size(); i++) {
+    FrameSource* source = units[i]->source.get();
+    FrameQueue<FramePtr>& queue = *units[i]->queue;
+    std::string labels = Labels(i);
+
+    metrics.Counter("capture_frames_total", "Frames produced by the source.", labels, source->CapturedFrames());
+    metrics.Counter("capture_incomplete_frames_total", "Frames the driver reported as incomplete.", labels, source->IncompleteFrames());
+    metrics.Counter("capture_missed_frames_total", "Complete frames dropped because no pool buffer was free.", labels, source->MissedFrames());
+    metrics.Counter("capture_queue_pushed_total", "Frames pushed to the capture queue.", labels, queue.Pushed());
+    metrics.Counter("capture_queue_dropped_total", "Frames dropped by the capture queue overflow policy.", labels, queue.Dropped());
+    metrics.Gauge("capture_queue_depth", "Frames waiting in the capture queue.", labels, queue.Size());
+    metrics.Gauge("capture_queue_high_water", "Most frames ever waiting in the capture queue.", labels, queue.HighWaterMark());
+    metrics.Gauge("capture_lent_frames", "Driver buffers currently lent to consumers.", labels, source->LentFrames());
+    metrics.Gauge("capture_pool_available", "Free frame pool buffers.", labels, source->Pool().Available());
+    metrics.Counter("capture_pool_exhausted_total", "Times a frame pool buffer was requested while none was free.", labels, source->Pool().Exhausted());
+    metrics.Gauge("capture_pool_reserved_bytes", "Memory mapped for the frame pool.", labels, source->Pool().ReservedBytes());
+    metrics.Gauge("capture_pool_in_use_bytes", "Frame pool memory held by frames.", labels, source->Pool().InUseBytes());
+    metrics.Gauge("capture_fps", "Frames captured during the last second.", labels, source->FPS());
+    metrics.Summary("capture_handoff_seconds", "Time from grab until the frame is queued.", labels, source->HandoffLatency());
+    metrics.Counter("capture_camera_dropped_frames_total", "Frames missing from the camera frame id sequence.", labels, source->DroppedFrames());
+    metrics.Counter("capture_camera_link_lost_frames_total", "Missing frames the stream reported as lost on the link.", labels, source->LinkLostFrames());
+    metrics.Counter("capture_camera_driver_dropped_frames_total", "Missing frames the stream reported as dropped by the driver.", labels, source->DriverDroppedFrames());
+    metrics.Summary("capture_sensor_seconds", "Time from camera timestamp until the frame is grabbed.", labels, source->SensorLatency());
+    metrics.Summary("capture_frame_interval_seconds", "Time between consecutive frames arriving on the host.", labels, source->ArrivalInterval());
+    metrics.Summary("capture_frame_jitter_seconds", "Deviation of frame arrival intervals from the average frame period.", labels, source->ArrivalJitter());
+    metrics.Summary("capture_recovery_seconds", "Time from losing the camera until frames are captured again.", labels, source->RecoveryTime());
+    metrics.Summary("capture_reconfigure_downtime_seconds", "Time acquisition was stopped to apply configuration changes.", labels, source->ReconfigureDowntime());
+
+    LoadShedder& shedder = source->Shedder();
+    for(size_t reason = 0; reason < (size_t)ShedReason::Count; reason++) {
+      metrics.Counter("capture_shed_frames_total", "Frames given up before the capture queue to keep consumers fresh.",
+          labels + ",reason=\"" + ShedReasonName((ShedReason)reason) + "\"", shedder.Shed((ShedReason)reason));
+    }
+    metrics.Gauge("capture_shed_decimation", "One of this many frames is kept.", labels, shedder.Decimation());
+    metrics.Gauge("capture_shed_predicted_wait_seconds", "Queue wait adaptive shedding predicted for the last kept frame.", labels, shedder.PredictedWait() / 1e9);
+  }
+}
@@ -0,0 +1,96 @@
+#include "clock_mapper.hpp"
+
+void ClockMapper::AddSample(uint64_t camera_time, uint64_t host_before, uint64_t host_after) {
+  std::lock_guard<std::mutex> lock(mutex);
+
+  Sample sample;
+  sample.camera_time = camera_time;
+  sample.host_time = host_before + (host_after - host_before) / 2;
+  sample.round_trip = host_after - host_before;
+
+  samples.push_back(sample);
+  if(samples.size() > WINDOW) {
+    samples.pop_front();
+  }
+
+  Fit();
+}
+
+void ClockMapper::Reset() {
+  std::lock_guard<std::mutex> lock(mutex);
+  samples.clear();
+  rate = 1;
+  uncertainty = 0;
+}
+
+void ClockMapper::Fit() {
+  // the sample with shortest round trip anchors the mapping
+  const Sample* best = &samples.front();
+  for(const Sample& sample : samples) {
+    if(sample.round_trip < best->round_trip) {
+      best = &sample;
+    }
+  }
+
+  camera_reference = best->camera_time;
+  host_reference = best->host_time;
+  uncertainty = best->round_trip;
+
+  // drift from a least squares line through samples which are nearly as good,
+  // relative to the anchor to keep doubles precise
+  double sum_host = 0;
+  double sum_camera = 0;
+  double sum_host_host = 0;
+  double sum_host_camera = 0;
+  size_t count = 0;
+
+  for(const Sample& sample : samples) {
+    if(sample.round_trip > 2 * best->round_trip + 1000) {
+      continue;
+    }
+
+    double host = (double)(int64_t)(sample.host_time - host_reference);
+    double camera = (double)(int64_t)(sample.camera_time - camera_reference);
+    sum_host += host;
+    sum_camera += camera;
+    sum_host_host += host * host;
+    sum_host_camera += host * camera;
+    count++;
+  }
+
+  double denominator = count * sum_host_host - sum_host * sum_host;
+  double fitted = count >= 2 && denominator > 0 ? (count * sum_host_camera - sum_host * sum_camera) / denominator : 1;
+
+  // crystals drift by well under 1000 ppm, anything else is a bad fit
+  rate = fitted > 0.999 && fitted < 1.001 ? fitted : 1;
+}
+
+uint64_t ClockMapper::ToHost(uint64_t camera_time) {
+  std::lock_guard<std::mutex> lock(mutex);
+
+  if(samples.empty()) {
+    return 0;
+  }
+
+  double delta = (double)(int64_t)(camera_time - camera_reference) / rate;
+  if(delta < 0 && (uint64_t)-delta > host_reference) {
+    return 0;
+  }
+
+  return host_reference + (int64_t)delta;
+}
+
+bool ClockMapper::Synced() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return !samples.empty();
+}
+
+uint64_t ClockMapper::Uncertainty() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return uncertainty;
+}
+
+double ClockMapper::Rate() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return rate;
+}
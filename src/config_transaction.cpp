@@ -0,0 +1,115 @@
+#include "config_transaction.hpp"
+
+#include <algorithm>
+
+// nodes which limit what later nodes accept come first, unknown nodes go last
+static int ApplyRank(const std::string& name) {
+  static const char* ORDER[][4] = {
+    { "AcquisitionMode" },
+    { "StreamBufferHandlingMode", "StreamBufferCountMode", "StreamBufferCountManual" },
+    { "AdcBitDepth", "PixelFormat" },
+    { "BinningHorizontal", "BinningVertical", "DecimationHorizontal", "DecimationVertical" },
+    { "Width", "Height" },
+    { "OffsetX", "OffsetY" },
+    { "ExposureAuto", "GainAuto", "BalanceWhiteAuto" },
+    { "ExposureTime", "Gain" },
+    { "AcquisitionFrameRateEnable" },
+    { "AcquisitionFrameRate" },
+    { "ChunkModeActive" },
+    { "ChunkSelector", "ChunkEnable" },
+  };
+  const int RANKS = sizeof(ORDER) / sizeof(ORDER[0]);
+
+  for(int rank = 0; rank < RANKS; rank++) {
+    for(const char* node : ORDER[rank]) {
+      if(node != NULL && name == node) {
+        return rank;
+      }
+    }
+  }
+
+  return RANKS;
+}
+
+void ConfigTransaction::Set(std::string name, int value, bool exclusive_write, Spinnaker::GenApi::INodeMap* map) {
+  PropertyChange change;
+  change.name = name;
+  change.type = PropertyType::Integer;
+  change.int_value = value;
+  change.exclusive_write = exclusive_write;
+  change.map = map;
+  Stage(change);
+}
+
+void ConfigTransaction::Set(std::string name, double value, bool exclusive_write, Spinnaker::GenApi::INodeMap* map) {
+  PropertyChange change;
+  change.name = name;
+  change.type = PropertyType::Float;
+  change.float_value = value;
+  change.exclusive_write = exclusive_write;
+  change.map = map;
+  Stage(change);
+}
+
+void ConfigTransaction::Set(std::string name, std::string value, bool exclusive_write, Spinnaker::GenApi::INodeMap* map) {
+  PropertyChange change;
+  change.name = name;
+  change.type = PropertyType::Enumeration;
+  change.string_value = value;
+  change.exclusive_write = exclusive_write;
+  change.map = map;
+  Stage(change);
+}
+
+void ConfigTransaction::SetBool(std::string name, bool value, bool exclusive_write, Spinnaker::GenApi::INodeMap* map) {
+  PropertyChange change;
+  change.name = name;
+  change.type = PropertyType::Boolean;
+  change.bool_value = value;
+  change.exclusive_write = exclusive_write;
+  change.map = map;
+  Stage(change);
+}
+
+void ConfigTransaction::Stage(PropertyChange change) {
+  changes.push_back(change);
+}
+
+std::vector<PropertyChange> ConfigTransaction::Ordered() {
+  std::vector<PropertyChange> ordered = changes;
+  std::stable_sort(ordered.begin(), ordered.end(), [](const PropertyChange& a, const PropertyChange& b) {
+    return ApplyRank(a.name) < ApplyRank(b.name);
+  });
+
+  // an offset left from the old size can make the new size invalid, move to
+  // the origin first when both are staged
+  const char* SIZE_OFFSETS[][2] = { { "Width", "OffsetX" }, { "Height", "OffsetY" } };
+  for(auto& size_offset : SIZE_OFFSETS) {
+    auto size = std::find_if(ordered.begin(), ordered.end(), [&](const PropertyChange& change) {
+      return change.name == size_offset[0];
+    });
+    auto offset = std::find_if(ordered.begin(), ordered.end(), [&](const PropertyChange& change) {
+      return change.name == size_offset[1];
+    });
+
+    if(size != ordered.end() && offset != ordered.end()) {
+      PropertyChange origin = *offset;
+      origin.int_value = 0;
+      ordered.insert(size, origin);
+    }
+  }
+
+  return ordered;
+}
+
+bool ConfigTransaction::Empty() {
+  return changes.empty();
+}
+
+size_t ConfigTransaction::Size() {
+  return changes.size();
+}
+
+void ConfigTransaction::Clear() {
+  changes.clear();
+}
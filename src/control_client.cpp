@@ -0,0 +1,121 @@
+#include "control_client.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+std::string DefaultControlSocket() {
+  const std::string name = "spinnaker_capture.sock";
+
+  const char* runtime = getenv("XDG_RUNTIME_DIR");
+  if(runtime != NULL && runtime[0] != '\0') {
+    return std::string(runtime) + "/" + name;
+  }
+
+  std::string user_runtime = "/run/user/" + std::to_string(getuid());
+  if(access(user_runtime.c_str(), W_OK) == 0) {
+    return user_runtime + "/" + name;
+  }
+  if(access("/run", W_OK) == 0) {
+    return "/run/" + name;
+  }
+
+  // last resort, the server still keeps the socket to owner and group
+  return "/tmp/" + name;
+}
+
+ControlClient::ControlClient() {}
+
+ControlClient::~ControlClient() {
+  Close();
+}
+
+bool ControlClient::Connect(std::string path) {
+  Close();
+
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if(path.empty() || path.size() >= sizeof(address.sun_path)) {
+    return false;
+  }
+  memcpy(address.sun_path, path.c_str(), path.size());
+
+  socket = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if(socket < 0) {
+    return false;
+  }
+
+  if(connect(socket, (struct sockaddr*)&address, sizeof(address)) < 0) {
+    Close();
+    return false;
+  }
+
+  return true;
+}
+
+void ControlClient::Close() {
+  if(socket >= 0) {
+    close(socket);
+    socket = -1;
+  }
+  input.clear();
+}
+
+bool ControlClient::IsConnected() {
+  return socket >= 0;
+}
+
+bool ControlClient::Send(std::string command, std::string& reply) {
+  reply.clear();
+  if(socket < 0) {
+    return false;
+  }
+
+  command += "\n";
+  size_t sent = 0;
+  while(sent < command.size()) {
+    ssize_t written = send(socket, command.data() + sent, command.size() - sent, MSG_NOSIGNAL);
+    if(written <= 0) {
+      Close();
+      return false;
+    }
+    sent += written;
+  }
+
+  // reply ends with an empty line
+  size_t end;
+  while((end = input.find("\n\n")) == std::string::npos) {
+    struct pollfd server = {socket, POLLIN, 0};
+    if(poll(&server, 1, REPLY_TIMEOUT) <= 0) {
+      Close();
+      return false;
+    }
+
+    char buffer[4096];
+    ssize_t received = recv(socket, buffer, sizeof(buffer), 0);
+    if(received <= 0) {
+      Close();
+      return false;
+    }
+    input.append(buffer, received);
+  }
+
+  std::string text = input.substr(0, end + 1);
+  input.erase(0, end + 2);
+
+  // "ok" or "error: reason" first, output after it
+  const std::string error = "error: ";
+  size_t first_line = text.find('\n');
+  if(text.compare(0, first_line, "ok") == 0) {
+    reply = text.substr(first_line + 1);
+    return true;
+  }
+
+  size_t reason = text.compare(0, error.size(), error) == 0 ? error.size() : 0;
+  reply = text.substr(reason, first_line - reason);
+  return false;
+}
@@ -0,0 +1,273 @@
+#include "control_server.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <poll.h>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "log.hpp"
+
+// words of a command line
+static std::vector<std::string> SplitWords(const std::string& line) {
+  std::vector<std::string> words;
+  std::istringstream stream(line);
+  std::string word;
+  while(stream >> word) {
+    words.push_back(word);
+  }
+  return words;
+}
+
+// first reply line followed by output without empty lines, ended by one
+static std::string Reply(bool ok, const std::string& text) {
+  std::string reply = ok ? "ok\n" : "error: " + text + "\n";
+  if(ok) {
+    std::istringstream stream(text);
+    std::string line;
+    while(std::getline(stream, line)) {
+      if(!line.empty()) {
+        reply += line + "\n";
+      }
+    }
+  }
+  return reply + "\n";
+}
+
+static bool FillAddress(const std::string& path, struct sockaddr_un& address) {
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if(path.empty() || path.size() >= sizeof(address.sun_path)) {
+    return false;
+  }
+  memcpy(address.sun_path, path.c_str(), path.size());
+  return true;
+}
+
+ControlServer::ControlServer(std::atomic<bool>& run, std::string path) :
+  run( run ),
+  path( path ),
+  deferred( DEFERRED_QUEUE_SIZE, OverflowPolicy::DropNewest ) {}
+
+ControlServer::~ControlServer() {
+  Join();
+
+  if(listen_socket >= 0) {
+    close(listen_socket);
+    unlink(path.c_str());
+  }
+}
+
+void ControlServer::Register(std::string name, std::string usage, size_t arguments, bool deferred, Handler handler) {
+  commands[name] = Command{ usage, arguments, deferred, handler };
+}
+
+bool ControlServer::Start() {
+  // deferred commands of this process run without the socket too
+  command_thread = std::thread(&ControlServer::RunDeferred, this);
+
+  struct sockaddr_un address;
+  if(!FillAddress(path, address)) {
+    std::cout << "Error: control socket path " << path << " is empty or too long" << std::endl;
+    return false;
+  }
+
+  listen_socket = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if(listen_socket < 0) {
+    std::cout << "Error: cannot create control socket: " << strerror(errno) << std::endl;
+    return false;
+  }
+
+  // a socket left behind by a process which is gone is taken over, a live one is not
+  if(connect(listen_socket, (struct sockaddr*)&address, sizeof(address)) == 0) {
+    std::cout << "Error: control socket " << path << " is served by another process" << std::endl;
+    close(listen_socket);
+    listen_socket = -1;
+    return false;
+  }
+  close(listen_socket);
+  unlink(path.c_str());
+
+  // owner and group only from the moment the socket exists
+  listen_socket = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  mode_t mask = umask(0117);
+  int bound = listen_socket < 0 ? -1 : bind(listen_socket, (struct sockaddr*)&address, sizeof(address));
+  umask(mask);
+
+  if(bound < 0 || listen(listen_socket, 4) < 0) {
+    std::cout << "Error: cannot serve control socket " << path << ": " << strerror(errno) << std::endl;
+    if(listen_socket >= 0) {
+      close(listen_socket);
+    }
+    listen_socket = -1;
+    return false;
+  }
+
+  thread = std::thread(&ControlServer::Serve, this);
+  return true;
+}
+
+void ControlServer::Join() {
+  if(thread.joinable()) {
+    thread.join();
+  }
+  if(command_thread.joinable()) {
+    command_thread.join();
+  }
+}
+
+std::string ControlServer::Path() {
+  return path;
+}
+
+void ControlServer::Serve() {
+  std::vector<Client> clients;
+
+  while(run) {
+    std::vector<struct pollfd> sockets;
+    sockets.push_back({listen_socket, POLLIN, 0});
+    for(Client& client : clients) {
+      sockets.push_back({client.socket, (short)(client.output.empty() ? POLLIN : POLLOUT), 0});
+    }
+
+    if(poll(sockets.data(), sockets.size(), POLL_TIMEOUT) <= 0) {
+      continue;
+    }
+
+    // replies go out before new connections are taken
+    for(size_t i = clients.size(); i > 0; i--) {
+      if(sockets[i].revents == 0) {
+        continue;
+      }
+
+      Client& client = clients[i - 1];
+      bool connected = client.output.empty() ? Receive(client) : true;
+      if(connected) {
+        connected = Flush(client);
+      }
+
+      if(!connected) {
+        close(client.socket);
+        clients.erase(clients.begin() + (i - 1));
+      }
+    }
+
+    if(sockets[0].revents & POLLIN) {
+      // a client which stops reading must not hold up the others
+      int connection = accept4(listen_socket, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+      if(connection >= 0 && clients.size() < MAX_CLIENTS) {
+        clients.push_back(Client{ connection, "", "" });
+      }
+      else if(connection >= 0) {
+        close(connection);
+      }
+    }
+  }
+
+  for(Client& client : clients) {
+    close(client.socket);
+  }
+}
+
+bool ControlServer::Receive(Client& client) {
+  char buffer[1024];
+  ssize_t received = recv(client.socket, buffer, sizeof(buffer), 0);
+  if(received <= 0) {
+    return received < 0 && (errno == EAGAIN || errno == EINTR);
+  }
+  client.input.append(buffer, received);
+
+  size_t end;
+  while((end = client.input.find('\n')) != std::string::npos) {
+    std::string line = client.input.substr(0, end);
+    client.input.erase(0, end + 1);
+
+    std::string reply;
+    bool ok = Execute(line, reply);
+    client.output += Reply(ok, reply);
+  }
+
+  return client.input.size() <= MAX_LINE && client.output.size() <= MAX_OUTPUT;
+}
+
+// writes what the socket takes without waiting, the rest goes once poll says it fits
+bool ControlServer::Flush(Client& client) {
+  while(!client.output.empty()) {
+    ssize_t written = send(client.socket, client.output.data(), client.output.size(), MSG_NOSIGNAL);
+    if(written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+      return true;
+    }
+    if(written <= 0) {
+      return false;
+    }
+    client.output.erase(0, written);
+  }
+  return true;
+}
+
+bool ControlServer::Execute(const std::string& line, std::string& reply) {
+  reply.clear();
+
+  std::vector<std::string> words = SplitWords(line);
+  if(words.empty()) {
+    reply = "empty command";
+    return false;
+  }
+
+  if(words[0] == "help") {
+    reply = Help();
+    return true;
+  }
+
+  auto found = commands.find(words[0]);
+  if(found == commands.end()) {
+    reply = "unknown command " + words[0] + ", see help";
+    return false;
+  }
+
+  const Command& command = found->second;
+  std::vector<std::string> arguments(words.begin() + 1, words.end());
+  if(arguments.size() != command.arguments) {
+    reply = "usage: " + words[0] + (command.usage.empty() ? "" : " " + command.usage);
+    return false;
+  }
+
+  if(command.deferred) {
+    DeferredCommand pending;
+    pending.name = words[0];
+    pending.command = &command;
+    pending.arguments = arguments;
+    if(!deferred.Push(pending)) {
+      reply = "busy, too many commands waiting";
+      return false;
+    }
+    return true;
+  }
+
+  return command.handler(arguments, reply);
+}
+
+std::string ControlServer::Help() {
+  std::string help = "help";
+  for(auto& entry : commands) {
+    help += "\n" + entry.first + (entry.second.usage.empty() ? "" : " " + entry.second.usage);
+  }
+  return help;
+}
+
+void ControlServer::RunDeferred() {
+  while(run) {
+    DeferredCommand pending;
+    if(!deferred.WaitPop(pending, COMMAND_WAIT_TIMEOUT)) {
+      continue;
+    }
+
+    std::string reply;
+    if(!pending.command->handler(pending.arguments, reply)) {
+      LogError("control command {} failed: {}", pending.name, reply);
+    }
+  }
+}
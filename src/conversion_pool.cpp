@@ -0,0 +1,311 @@
+#include "conversion_pool.hpp"
+
+#include "clock.hpp"
+
+ConversionPool::ConversionPool(std::atomic<bool>& run, FrameQueue<FramePtr>& input, int workers, DemosaicMethod method) :
+  run( run ),
+  input( input ),
+  method( method ),
+  worker_count( workers > 0 ? workers : 1 ),
+  output_pool( worker_count * REORDER_FRAMES_PER_WORKER * 2 ),
+  reorder( worker_count * REORDER_FRAMES_PER_WORKER ) {
+  for(size_t i = 0; i < worker_count; i++) {
+    worker_queues.push_back(std::unique_ptr<WorkerQueue>(new WorkerQueue()));
+  }
+}
+
+ConversionPool::~ConversionPool() {
+  stopping = true;
+  work_available.NotifyAll();
+  Join();
+}
+
+void ConversionPool::AddSink(ConversionSink sink) {
+  sinks.push_back(sink);
+}
+
+void ConversionPool::AddRawSink(RawSink sink) {
+  raw_sinks.push_back(sink);
+}
+
+void ConversionPool::Start() {
+  for(size_t i = 0; i < worker_count; i++) {
+    workers.push_back(std::thread(&ConversionPool::Work, this, i));
+  }
+
+  dispatcher = std::thread(&ConversionPool::Dispatch, this);
+}
+
+void ConversionPool::Join() {
+  if(dispatcher.joinable()) {
+    dispatcher.join();
+  }
+
+  for(std::thread& worker : workers) {
+    if(worker.joinable()) {
+      worker.join();
+    }
+  }
+}
+
+void ConversionPool::Dispatch() {
+  while(run) {
+    FramePtr frame;
+    if(!input.WaitPop(frame, QUEUE_WAIT_TIMEOUT)) {
+      continue;
+    }
+
+    // times go onto a frame of our own, other stages may share the one we got
+    frame = AnnotatedFrame(frame);
+    frame->dequeue_time = MonotonicNow();
+    if(frame->enqueue_time != 0) {
+      queue_latency.Record(frame->dequeue_time - frame->enqueue_time);
+    }
+
+    for(RawSink& sink : raw_sinks) {
+      sink(frame);
+    }
+
+    // keep at most one reorder window of frames in flight
+    if(!WaitForRoom()) {
+      break;
+    }
+
+    Task task;
+    task.sequence = next_sequence++;
+    task.frame = frame;
+    task.converted = AcquireOutput(frame);
+
+    // deal tasks out round robin, idle workers steal from busy ones
+    WorkerQueue& queue = *worker_queues[task.sequence % worker_count];
+    {
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      queue.tasks.push_back(std::move(task));
+    }
+
+    work_available.Notify();
+  }
+
+  // workers finish queued tasks before they exit
+  stopping = true;
+  work_available.NotifyAll();
+}
+
+bool ConversionPool::WaitForRoom() {
+  while(true) {
+    uint32_t epoch = emitted.Prepare();
+
+    if(next_sequence - next_emit.load() < reorder.size()) {
+      return true;
+    }
+
+    if(!run) {
+      return false;
+    }
+
+    emitted.Wait(epoch, QUEUE_WAIT_TIMEOUT);
+  }
+}
+
+FramePtr ConversionPool::AcquireOutput(const FramePtr& frame) {
+  size_t stride = frame->width * BytesPerPixel(PixelFormat::BGR8);
+
+  if(!output_pool.Reserve(stride * frame->height)) {
+    return FramePtr();
+  }
+
+  FramePtr converted = output_pool.Acquire();
+
+  // every image is held by sinks, wait until one of them lets go
+  while(!converted && run) {
+    uint32_t epoch = emitted.Prepare();
+    emitted.Wait(epoch, OUTPUT_WAIT_TIMEOUT);
+    converted = output_pool.Acquire();
+  }
+
+  if(converted) {
+    converted->width = frame->width;
+    converted->height = frame->height;
+    converted->stride = stride;
+    converted->size = stride * frame->height;
+    converted->pixel_format = PixelFormat::BGR8;
+    CopyFrameMetadata(*frame, *converted);
+  }
+
+  return converted;
+}
+
+void ConversionPool::Work(size_t index) {
+  // conversions run in parallel per frame, so each one stays on a single thread
+  Demosaicer demosaicer(method, 1);
+
+  while(true) {
+    uint32_t epoch = work_available.Prepare();
+
+    Task task;
+    if(TakeTask(index, task)) {
+      uint64_t start = MonotonicNow();
+      bool success = task.converted && demosaicer.Process(*task.frame, task.converted->data, task.converted->stride);
+
+      task.frame->convert_time = MonotonicNow();
+      convert_latency.Record(task.frame->convert_time - start);
+
+      Complete(task, success);
+      continue;
+    }
+
+    if(stopping) {
+      break;
+    }
+
+    work_available.Wait(epoch, QUEUE_WAIT_TIMEOUT);
+  }
+}
+
+bool ConversionPool::TakeTask(size_t index, Task& task) {
+  // own tasks oldest first
+  {
+    WorkerQueue& queue = *worker_queues[index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if(!queue.tasks.empty()) {
+      task = std::move(queue.tasks.front());
+      queue.tasks.pop_front();
+      return true;
+    }
+  }
+
+  // steal newest task of another worker
+  for(size_t i = 1; i < worker_count; i++) {
+    WorkerQueue& queue = *worker_queues[(index + i) % worker_count];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if(!queue.tasks.empty()) {
+      task = std::move(queue.tasks.back());
+      queue.tasks.pop_back();
+      stolen++;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void ConversionPool::Complete(Task& task, bool success) {
+  if(success) {
+    converted++;
+  }
+  else {
+    failed++;
+  }
+
+  std::unique_lock<std::mutex> lock(reorder_mutex);
+
+  Result& result = reorder[task.sequence % reorder.size()];
+  result.ready = true;
+  result.frame = std::move(task.frame);
+  result.converted = success ? std::move(task.converted) : FramePtr();
+
+  // one worker at a time hands frames to the sinks so they stay in order,
+  // it picks up whatever the others complete meanwhile
+  if(delivering) {
+    return;
+  }
+  delivering = true;
+
+  // emit every frame which is next in line
+  while(true) {
+    uint64_t next = next_emit.load();
+    Result& next_result = reorder[next % reorder.size()];
+    if(!next_result.ready) {
+      break;
+    }
+
+    FramePtr frame = std::move(next_result.frame);
+    FramePtr converted_frame = std::move(next_result.converted);
+    next_result.ready = false;
+
+    next_emit.store(next + 1);
+    RegisterConversion();
+
+    // sinks may be slow or block on a full channel, other workers keep converting
+    lock.unlock();
+
+    if(frame->grab_time != 0) {
+      total_latency.Record(MonotonicNow() - frame->grab_time);
+    }
+
+    for(ConversionSink& sink : sinks) {
+      sink(frame, converted_frame);
+    }
+
+    // output image may be free again
+    frame.reset();
+    converted_frame.reset();
+    emitted.Notify();
+
+    lock.lock();
+  }
+
+  delivering = false;
+}
+
+// called with reorder_mutex held
+void ConversionPool::RegisterConversion() {
+  uint64_t now = MonotonicNow();
+
+  if(now - second_begin >= 1000000000ULL) {
+    fps = frame_counter;
+    frame_counter = 0;
+    second_begin = now;
+  }
+
+  frame_counter++;
+}
+
+int ConversionPool::Workers() {
+  return worker_count;
+}
+
+size_t ConversionPool::InFlight() {
+  return next_sequence - next_emit.load();
+}
+
+uint64_t ConversionPool::Converted() {
+  return converted.load();
+}
+
+uint64_t ConversionPool::Failed() {
+  return failed.load();
+}
+
+uint64_t ConversionPool::Stolen() {
+  return stolen.load();
+}
+
+int ConversionPool::FPS() {
+  return fps.load();
+}
+
+LatencyHistogram& ConversionPool::QueueWaitLatency() {
+  return queue_latency;
+}
+
+LatencyHistogram& ConversionPool::ConvertLatency() {
+  return convert_latency;
+}
+
+LatencyHistogram& ConversionPool::TotalLatency() {
+  return total_latency;
+}
+
+void ConversionPool::WriteMetrics(MetricsWriter& metrics, std::string labels) {
+  metrics.Counter("capture_converted_frames_total", "Frames converted to BGR.", labels, Converted());
+  metrics.Counter("capture_conversion_failures_total", "Frames which could not be converted.", labels, Failed());
+  metrics.Counter("capture_conversion_steals_total", "Conversion tasks stolen by idle workers.", labels, Stolen());
+  metrics.Gauge("capture_conversion_in_flight", "Frames taken from the capture queue but not yet passed to sinks.", labels, InFlight());
+  metrics.Gauge("capture_conversion_workers", "Conversion worker threads.", labels, Workers());
+  metrics.Gauge("capture_conversion_pool_reserved_bytes", "Memory mapped for converted images.", labels, output_pool.ReservedBytes());
+  metrics.Gauge("capture_conversion_pool_in_use_bytes", "Converted image memory held by frames.", labels, output_pool.InUseBytes());
+  metrics.Summary("capture_queue_wait_seconds", "Time from enqueue until a frame is taken from the capture queue.", labels, queue_latency);
+  metrics.Summary("capture_convert_seconds", "Time to convert one frame to BGR.", labels, convert_latency);
+  metrics.Summary("capture_total_latency_seconds", "Time from grab until a converted frame reaches the sinks.", labels, total_latency);
+}
@@ -0,0 +1,271 @@
+#include "demosaic.hpp"
+
+#include <algorithm>
+#include "demosaic_kernels.hpp"
+
+SimdLevel DetectSimdLevel() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx2")) {
+    return SimdLevel::AVX2;
+  }
+  if(__builtin_cpu_supports("sse4.1")) {
+    return SimdLevel::SSE41;
+  }
+#endif
+  return SimdLevel::Scalar;
+}
+
+const char* SimdLevelName(SimdLevel simd) {
+  switch(simd) {
+    case SimdLevel::AVX2: return "avx2";
+    case SimdLevel::SSE41: return "sse4.1";
+    default: return "scalar";
+  }
+}
+
+const char* DemosaicMethodName(DemosaicMethod method) {
+  switch(method) {
+    case DemosaicMethod::EdgeAware: return "edge-aware";
+    default: return "bilinear";
+  }
+}
+
+// keep 8 most significant bits of 16-bit samples
+static void NarrowRow(const uint8_t* input, size_t width, uint8_t* output) {
+  const uint16_t* samples = (const uint16_t*)input;
+  for(size_t x = 0; x < width; x++) {
+    output[x] = samples[x] >> 8;
+  }
+}
+
+static void MonoRow(const uint8_t* input, size_t width, uint8_t* output) {
+  for(size_t x = 0; x < width; x++) {
+    output[x * 3] = input[x];
+    output[x * 3 + 1] = input[x];
+    output[x * 3 + 2] = input[x];
+  }
+}
+
+// mirrored neighbour rows keep the Bayer phase at the image border
+static inline size_t RowAbove(size_t y) {
+  return y == 0 ? 1 : y - 1;
+}
+
+static inline size_t RowBelow(size_t y, size_t height) {
+  return y + 1 == height ? height - 2 : y + 1;
+}
+
+void DemosaicReference(const uint8_t* input, size_t width, size_t height, size_t input_stride,
+    PixelFormat pixel_format, DemosaicMethod method, uint8_t* output, size_t output_stride) {
+  size_t bytes_per_pixel = BytesPerPixel(pixel_format);
+  size_t red_x = 0;
+  size_t red_y = 0;
+  bool bayer = BayerPhase(pixel_format, red_x, red_y);
+
+  if(bytes_per_pixel == 0 || bytes_per_pixel > 2 || width < 2 || height < 2) {
+    return;
+  }
+
+  // all rows as 8-bit samples
+  std::vector<uint8_t> samples(width * height);
+  for(size_t y = 0; y < height; y++) {
+    if(bytes_per_pixel == 2) {
+      NarrowRow(input + y * input_stride, width, &samples[y * width]);
+    }
+    else {
+      std::copy(input + y * input_stride, input + y * input_stride + width, &samples[y * width]);
+    }
+  }
+
+  for(size_t y = 0; y < height; y++) {
+    if(!bayer) {
+      MonoRow(&samples[y * width], width, output + y * output_stride);
+      continue;
+    }
+
+    BayerRow row;
+    row.up = &samples[RowAbove(y) * width];
+    row.mid = &samples[y * width];
+    row.down = &samples[RowBelow(y, height) * width];
+    row.output = output + y * output_stride;
+    row.width = width;
+    row.red_row = (y & 1) == red_y;
+    row.color_x = row.red_row ? red_x : 1 - red_x;
+
+    for(size_t x = 0; x < width; x++) {
+      DemosaicPixel(row, x, method);
+    }
+  }
+}
+
+Demosaicer::Demosaicer(DemosaicMethod method, int threads, SimdLevel simd) :
+  method( method ),
+  simd( std::min(simd, DetectSimdLevel()) ) {
+  for(int i = 1; i < threads; i++) {
+    workers.push_back(std::thread(&Demosaicer::Work, this));
+  }
+}
+
+Demosaicer::~Demosaicer() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  job_ready.notify_all();
+
+  for(std::thread& worker : workers) {
+    worker.join();
+  }
+}
+
+bool Demosaicer::Process(const Frame& frame, uint8_t* output, size_t output_stride) {
+  size_t stride = frame.stride != 0 ? frame.stride : frame.width * BytesPerPixel(frame.pixel_format);
+  return Process(frame.data, frame.width, frame.height, stride, frame.pixel_format, output, output_stride);
+}
+
+bool Demosaicer::Process(const uint8_t* input, size_t width, size_t height, size_t input_stride,
+    PixelFormat pixel_format, uint8_t* output, size_t output_stride) {
+  size_t bytes_per_pixel = BytesPerPixel(pixel_format);
+  size_t red_x = 0;
+  size_t red_y = 0;
+
+  if(input == NULL || output == NULL || bytes_per_pixel == 0 || bytes_per_pixel > 2 || width < 2 || height < 2) {
+    return false;
+  }
+
+  job.input = input;
+  job.width = width;
+  job.height = height;
+  job.input_stride = input_stride;
+  job.bytes_per_pixel = bytes_per_pixel;
+  job.mono = !BayerPhase(pixel_format, red_x, red_y);
+  job.red_first_row = red_y == 0;
+  job.color_x = red_x;
+  job.output = output;
+  job.output_stride = output_stride;
+  job.tile_rows = std::max<size_t>(2, TILE_CACHE_BYTES / (width * (bytes_per_pixel + 3)));
+  job.tiles = (height + job.tile_rows - 1) / job.tile_rows;
+
+  next_tile.store(0);
+
+  if(workers.empty()) {
+    RunTiles(caller_scratch);
+    return true;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    generation++;
+    busy_workers = workers.size();
+  }
+  job_ready.notify_all();
+
+  // calling thread takes tiles as well
+  RunTiles(caller_scratch);
+
+  std::unique_lock<std::mutex> lock(mutex);
+  job_done.wait(lock, [this] { return busy_workers == 0; });
+
+  return true;
+}
+
+void Demosaicer::Work() {
+  uint64_t seen_generation = 0;
+  std::vector<uint8_t> scratch;
+
+  while(true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      job_ready.wait(lock, [this, seen_generation] { return stopping || generation != seen_generation; });
+
+      if(stopping) {
+        return;
+      }
+      seen_generation = generation;
+    }
+
+    RunTiles(scratch);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    busy_workers--;
+    if(busy_workers == 0) {
+      job_done.notify_one();
+    }
+  }
+}
+
+void Demosaicer::RunTiles(std::vector<uint8_t>& scratch) {
+  size_t tile;
+  while((tile = next_tile.fetch_add(1)) < job.tiles) {
+    ProcessTile(job, tile, scratch);
+  }
+}
+
+void Demosaicer::ProcessTile(const Job& job, size_t tile, std::vector<uint8_t>& scratch) {
+  size_t first_row = tile * job.tile_rows;
+  size_t end_row = std::min(job.height, first_row + job.tile_rows);
+
+  // rows read by this tile, including neighbours above and below
+  size_t first_input_row = first_row == 0 ? 0 : first_row - 1;
+  size_t end_input_row = std::min(job.height, end_row + 1);
+
+  // narrow 16-bit rows once per tile so the 8-bit kernels can be used
+  if(job.bytes_per_pixel == 2) {
+    scratch.resize((end_input_row - first_input_row) * job.width);
+    for(size_t y = first_input_row; y < end_input_row; y++) {
+      NarrowRow(job.input + y * job.input_stride, job.width, &scratch[(y - first_input_row) * job.width]);
+    }
+  }
+
+  auto input_row = [&](size_t y) -> const uint8_t* {
+    if(job.bytes_per_pixel == 2) {
+      return &scratch[(y - first_input_row) * job.width];
+    }
+    return job.input + y * job.input_stride;
+  };
+
+  for(size_t y = first_row; y < end_row; y++) {
+    uint8_t* output = job.output + y * job.output_stride;
+
+    if(job.mono) {
+      MonoRow(input_row(y), job.width, output);
+      continue;
+    }
+
+    BayerRow row;
+    row.up = input_row(RowAbove(y));
+    row.mid = input_row(y);
+    row.down = input_row(RowBelow(y, job.height));
+    row.output = output;
+    row.width = job.width;
+    row.red_row = ((y & 1) == 0) == job.red_first_row;
+    row.color_x = row.red_row ? job.color_x : 1 - job.color_x;
+
+    // first and last column need mirrored neighbours
+    DemosaicPixel(row, 0, method);
+
+    size_t x = 1;
+    if(simd == SimdLevel::AVX2) {
+      x = DemosaicRowAVX2(row, x, job.width - 1, method);
+    }
+    if(simd >= SimdLevel::SSE41) {
+      x = DemosaicRowSSE41(row, x, job.width - 1, method);
+    }
+    for(; x < job.width; x++) {
+      DemosaicPixel(row, x, method);
+    }
+  }
+}
+
+DemosaicMethod Demosaicer::Method() {
+  return method;
+}
+
+SimdLevel Demosaicer::Simd() {
+  return simd;
+}
+
+int Demosaicer::Threads() {
+  return workers.size() + 1;
+}
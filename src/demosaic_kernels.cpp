@@ -0,0 +1,447 @@
+#include "demosaic_kernels.hpp"
+
+#include <cstdlib>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define DEMOSAIC_X86
+#endif
+
+static inline uint8_t Average2(int a, int b) {
+  return (a + b + 1) >> 1;
+}
+
+static inline uint8_t Average4(int a, int b, int c, int d) {
+  return (a + b + c + d + 2) >> 2;
+}
+
+void DemosaicPixel(const BayerRow& row, size_t x, DemosaicMethod method) {
+  size_t left = x > 0 ? x - 1 : 1;
+  size_t right = x + 1 < row.width ? x + 1 : row.width - 2;
+
+  int center = row.mid[x];
+  int north = row.up[x];
+  int south = row.down[x];
+  int west = row.mid[left];
+  int east = row.mid[right];
+
+  uint8_t horizontal = Average2(west, east);
+  uint8_t vertical = Average2(north, south);
+
+  uint8_t blue, green, red;
+
+  if((x & 1) == row.color_x) {
+    // red or blue sample, green comes from the cross, opposite color from diagonals
+    green = Average4(north, south, west, east);
+
+    if(method == DemosaicMethod::EdgeAware) {
+      int horizontal_gradient = abs(west - east);
+      int vertical_gradient = abs(north - south);
+
+      if(horizontal_gradient < vertical_gradient) {
+        green = horizontal;
+      }
+      else if(vertical_gradient < horizontal_gradient) {
+        green = vertical;
+      }
+    }
+
+    uint8_t opposite = Average4(row.up[left], row.up[right], row.down[left], row.down[right]);
+    red = row.red_row ? center : opposite;
+    blue = row.red_row ? opposite : center;
+  }
+  else {
+    // green sample, row color sits left and right, the other one above and below
+    green = center;
+    red = row.red_row ? horizontal : vertical;
+    blue = row.red_row ? vertical : horizontal;
+  }
+
+  uint8_t* bgr = row.output + x * 3;
+  bgr[0] = blue;
+  bgr[1] = green;
+  bgr[2] = red;
+}
+
+void BinTile(const BinnedRow& row, size_t tile) {
+  const uint8_t* samples[2] = { row.top + tile * 2, row.bottom + tile * 2 };
+  uint8_t* bgr = row.output + tile * 3;
+
+  if(row.mono) {
+    uint8_t gray = Average4(samples[0][0], samples[0][1], samples[1][0], samples[1][1]);
+    bgr[0] = gray;
+    bgr[1] = gray;
+    bgr[2] = gray;
+    return;
+  }
+
+  bgr[0] = samples[1 - row.red_y][1 - row.red_x];
+  bgr[1] = Average2(samples[row.red_y][1 - row.red_x], samples[1 - row.red_y][row.red_x]);
+  bgr[2] = samples[row.red_y][row.red_x];
+}
+
+void HalvePixel(const uint8_t* top, const uint8_t* bottom, uint8_t* output, size_t x) {
+  const uint8_t* left_top = top + x * 6;
+  const uint8_t* left_bottom = bottom + x * 6;
+
+  for(size_t channel = 0; channel < 3; channel++) {
+    output[x * 3 + channel] = Average2(Average2(left_top[channel], left_bottom[channel]),
+        Average2(left_top[channel + 3], left_bottom[channel + 3]));
+  }
+}
+
+#ifdef DEMOSAIC_X86
+
+__attribute__((target("sse4.1")))
+static inline __m128i Average4SSE41(__m128i a, __m128i b, __m128i c, __m128i d) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i two = _mm_set1_epi16(2);
+
+  __m128i low = _mm_add_epi16(_mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero)),
+      _mm_add_epi16(_mm_unpacklo_epi8(c, zero), _mm_unpacklo_epi8(d, zero)));
+  __m128i high = _mm_add_epi16(_mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero)),
+      _mm_add_epi16(_mm_unpackhi_epi8(c, zero), _mm_unpackhi_epi8(d, zero)));
+
+  low = _mm_srli_epi16(_mm_add_epi16(low, two), 2);
+  high = _mm_srli_epi16(_mm_add_epi16(high, two), 2);
+
+  return _mm_packus_epi16(low, high);
+}
+
+__attribute__((target("sse4.1")))
+static inline __m128i AbsoluteDifferenceSSE41(__m128i a, __m128i b) {
+  return _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a));
+}
+
+// pick edge-aware green: horizontal where it is smoother, vertical where that is smoother, else cross
+__attribute__((target("sse4.1")))
+static inline __m128i EdgeGreenSSE41(__m128i north, __m128i south, __m128i west, __m128i east,
+    __m128i horizontal, __m128i vertical, __m128i cross) {
+  const __m128i zero = _mm_setzero_si128();
+
+  __m128i horizontal_gradient = AbsoluteDifferenceSSE41(west, east);
+  __m128i vertical_gradient = AbsoluteDifferenceSSE41(north, south);
+
+  // a < b for unsigned bytes when b - a does not saturate to zero
+  __m128i use_horizontal = _mm_xor_si128(_mm_cmpeq_epi8(_mm_subs_epu8(vertical_gradient, horizontal_gradient), zero), _mm_set1_epi8(-1));
+  __m128i use_vertical = _mm_xor_si128(_mm_cmpeq_epi8(_mm_subs_epu8(horizontal_gradient, vertical_gradient), zero), _mm_set1_epi8(-1));
+
+  __m128i green = _mm_blendv_epi8(cross, horizontal, use_horizontal);
+  return _mm_blendv_epi8(green, vertical, use_vertical);
+}
+
+// write 16 planar pixels as 48 bytes of packed BGR
+__attribute__((target("sse4.1")))
+static inline void StoreBGRSSE41(uint8_t* output, __m128i blue, __m128i green, __m128i red) {
+  const __m128i blue0 = _mm_setr_epi8(0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1, 5);
+  const __m128i green0 = _mm_setr_epi8(-1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1);
+  const __m128i red0 = _mm_setr_epi8(-1, -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1);
+  const __m128i blue1 = _mm_setr_epi8(-1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10, -1);
+  const __m128i green1 = _mm_setr_epi8(5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10);
+  const __m128i red1 = _mm_setr_epi8(-1, 5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1);
+  const __m128i blue2 = _mm_setr_epi8(-1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1, -1);
+  const __m128i green2 = _mm_setr_epi8(-1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1);
+  const __m128i red2 = _mm_setr_epi8(10, -1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15);
+
+  __m128i out0 = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(blue, blue0), _mm_shuffle_epi8(green, green0)), _mm_shuffle_epi8(red, red0));
+  __m128i out1 = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(blue, blue1), _mm_shuffle_epi8(green, green1)), _mm_shuffle_epi8(red, red1));
+  __m128i out2 = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(blue, blue2), _mm_shuffle_epi8(green, green2)), _mm_shuffle_epi8(red, red2));
+
+  _mm_storeu_si128((__m128i*)output, out0);
+  _mm_storeu_si128((__m128i*)(output + 16), out1);
+  _mm_storeu_si128((__m128i*)(output + 32), out2);
+}
+
+__attribute__((target("sse4.1")))
+size_t DemosaicRowSSE41(const BayerRow& row, size_t x, size_t x_end, DemosaicMethod method) {
+  // lanes holding red/blue samples alternate, x always advances by an even count
+  const __m128i color_lanes = ((x & 1) == row.color_x) ? _mm_set1_epi16(0x00FF) : _mm_set1_epi16((short)0xFF00);
+  const bool edge_aware = method == DemosaicMethod::EdgeAware;
+
+  for(; x + 16 <= x_end; x += 16) {
+    __m128i north_west = _mm_loadu_si128((const __m128i*)(row.up + x - 1));
+    __m128i north = _mm_loadu_si128((const __m128i*)(row.up + x));
+    __m128i north_east = _mm_loadu_si128((const __m128i*)(row.up + x + 1));
+    __m128i west = _mm_loadu_si128((const __m128i*)(row.mid + x - 1));
+    __m128i center = _mm_loadu_si128((const __m128i*)(row.mid + x));
+    __m128i east = _mm_loadu_si128((const __m128i*)(row.mid + x + 1));
+    __m128i south_west = _mm_loadu_si128((const __m128i*)(row.down + x - 1));
+    __m128i south = _mm_loadu_si128((const __m128i*)(row.down + x));
+    __m128i south_east = _mm_loadu_si128((const __m128i*)(row.down + x + 1));
+
+    __m128i horizontal = _mm_avg_epu8(west, east);
+    __m128i vertical = _mm_avg_epu8(north, south);
+    __m128i cross = Average4SSE41(north, south, west, east);
+    __m128i diagonal = Average4SSE41(north_west, north_east, south_west, south_east);
+
+    __m128i green_estimate = edge_aware ? EdgeGreenSSE41(north, south, west, east, horizontal, vertical, cross) : cross;
+
+    __m128i green = _mm_blendv_epi8(center, green_estimate, color_lanes);
+    __m128i row_color = _mm_blendv_epi8(horizontal, center, color_lanes);
+    __m128i other_color = _mm_blendv_epi8(vertical, diagonal, color_lanes);
+
+    if(row.red_row) {
+      StoreBGRSSE41(row.output + x * 3, other_color, green, row_color);
+    }
+    else {
+      StoreBGRSSE41(row.output + x * 3, row_color, green, other_color);
+    }
+  }
+
+  return x;
+}
+
+// samples of a tile position as 16-bit lanes, planes[y][x]; mono or color
+// pixels are combined there and narrowed back to bytes
+__attribute__((target("sse4.1")))
+static inline void BinPlanesSSE41(const BinnedRow& row, __m128i planes[2][2], __m128i& blue, __m128i& green, __m128i& red) {
+  if(row.mono) {
+    green = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(_mm_add_epi16(planes[0][0], planes[0][1]),
+        _mm_add_epi16(planes[1][0], planes[1][1])), _mm_set1_epi16(2)), 2);
+    blue = green;
+    red = green;
+    return;
+  }
+
+  blue = planes[1 - row.red_y][1 - row.red_x];
+  green = _mm_avg_epu16(planes[row.red_y][1 - row.red_x], planes[1 - row.red_y][row.red_x]);
+  red = planes[row.red_y][row.red_x];
+}
+
+__attribute__((target("sse4.1")))
+size_t BinRowSSE41(const BinnedRow& row, size_t tile) {
+  const __m128i even = _mm_set1_epi16(0x00FF);
+
+  // 16 tiles are 32 samples of each row
+  for(; tile + 16 <= row.tiles; tile += 16) {
+    __m128i planes[2][2][2];
+    const uint8_t* rows[2] = { row.top + tile * 2, row.bottom + tile * 2 };
+
+    for(size_t y = 0; y < 2; y++) {
+      for(size_t half = 0; half < 2; half++) {
+        __m128i samples = _mm_loadu_si128((const __m128i*)(rows[y] + half * 16));
+        planes[half][y][0] = _mm_and_si128(samples, even);
+        planes[half][y][1] = _mm_srli_epi16(samples, 8);
+      }
+    }
+
+    __m128i blue[2];
+    __m128i green[2];
+    __m128i red[2];
+    for(size_t half = 0; half < 2; half++) {
+      BinPlanesSSE41(row, planes[half], blue[half], green[half], red[half]);
+    }
+
+    StoreBGRSSE41(row.output + tile * 3, _mm_packus_epi16(blue[0], blue[1]), _mm_packus_epi16(green[0], green[1]),
+        _mm_packus_epi16(red[0], red[1]));
+  }
+
+  return tile;
+}
+
+// Shuffle masks gathering the left (parity 0) or right (parity 1) pixel of
+// every pair from 48 bytes of BGR into 8 output pixels, the first 16 bytes
+// in part 0 and the last 8 in part 1, one mask per 16-byte source register.
+struct HalveMasks {
+  int8_t masks[2][2][3][16];
+
+  HalveMasks() {
+    for(size_t part = 0; part < 2; part++) {
+      for(size_t parity = 0; parity < 2; parity++) {
+        for(size_t source = 0; source < 3; source++) {
+          for(size_t j = 0; j < 16; j++) {
+            size_t out = part * 16 + j;
+            size_t in = out / 3 * 6 + out % 3 + parity * 3;
+            masks[part][parity][source][j] = out < 24 && in / 16 == source ? in % 16 : -1;
+          }
+        }
+      }
+    }
+  }
+};
+
+static const HalveMasks HALVE_MASKS;
+
+__attribute__((target("sse4.1")))
+static inline __m128i GatherSSE41(const __m128i samples[3], const int8_t masks[3][16]) {
+  __m128i gathered = _mm_shuffle_epi8(samples[0], _mm_loadu_si128((const __m128i*)masks[0]));
+  gathered = _mm_or_si128(gathered, _mm_shuffle_epi8(samples[1], _mm_loadu_si128((const __m128i*)masks[1])));
+  return _mm_or_si128(gathered, _mm_shuffle_epi8(samples[2], _mm_loadu_si128((const __m128i*)masks[2])));
+}
+
+__attribute__((target("sse4.1")))
+size_t HalveRowSSE41(const uint8_t* top, const uint8_t* bottom, uint8_t* output, size_t x, size_t width) {
+  const int8_t (&masks)[2][2][3][16] = HALVE_MASKS.masks;
+
+  // 8 output pixels from 16 pixels of both rows
+  for(; x + 8 <= width; x += 8) {
+    __m128i vertical[3];
+    for(size_t i = 0; i < 3; i++) {
+      vertical[i] = _mm_avg_epu8(_mm_loadu_si128((const __m128i*)(top + x * 6 + i * 16)),
+          _mm_loadu_si128((const __m128i*)(bottom + x * 6 + i * 16)));
+    }
+
+    __m128i first = _mm_avg_epu8(GatherSSE41(vertical, masks[0][0]), GatherSSE41(vertical, masks[0][1]));
+    __m128i last = _mm_avg_epu8(GatherSSE41(vertical, masks[1][0]), GatherSSE41(vertical, masks[1][1]));
+    _mm_storeu_si128((__m128i*)(output + x * 3), first);
+    _mm_storel_epi64((__m128i*)(output + x * 3 + 16), last);
+  }
+
+  return x;
+}
+
+__attribute__((target("avx2")))
+static inline __m256i Average4AVX2(__m256i a, __m256i b, __m256i c, __m256i d) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i two = _mm256_set1_epi16(2);
+
+  // unpack and pack work per 128-bit lane, so byte order is preserved
+  __m256i low = _mm256_add_epi16(_mm256_add_epi16(_mm256_unpacklo_epi8(a, zero), _mm256_unpacklo_epi8(b, zero)),
+      _mm256_add_epi16(_mm256_unpacklo_epi8(c, zero), _mm256_unpacklo_epi8(d, zero)));
+  __m256i high = _mm256_add_epi16(_mm256_add_epi16(_mm256_unpackhi_epi8(a, zero), _mm256_unpackhi_epi8(b, zero)),
+      _mm256_add_epi16(_mm256_unpackhi_epi8(c, zero), _mm256_unpackhi_epi8(d, zero)));
+
+  low = _mm256_srli_epi16(_mm256_add_epi16(low, two), 2);
+  high = _mm256_srli_epi16(_mm256_add_epi16(high, two), 2);
+
+  return _mm256_packus_epi16(low, high);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i AbsoluteDifferenceAVX2(__m256i a, __m256i b) {
+  return _mm256_or_si256(_mm256_subs_epu8(a, b), _mm256_subs_epu8(b, a));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i EdgeGreenAVX2(__m256i north, __m256i south, __m256i west, __m256i east,
+    __m256i horizontal, __m256i vertical, __m256i cross) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i ones = _mm256_set1_epi8(-1);
+
+  __m256i horizontal_gradient = AbsoluteDifferenceAVX2(west, east);
+  __m256i vertical_gradient = AbsoluteDifferenceAVX2(north, south);
+
+  __m256i use_horizontal = _mm256_xor_si256(_mm256_cmpeq_epi8(_mm256_subs_epu8(vertical_gradient, horizontal_gradient), zero), ones);
+  __m256i use_vertical = _mm256_xor_si256(_mm256_cmpeq_epi8(_mm256_subs_epu8(horizontal_gradient, vertical_gradient), zero), ones);
+
+  __m256i green = _mm256_blendv_epi8(cross, horizontal, use_horizontal);
+  return _mm256_blendv_epi8(green, vertical, use_vertical);
+}
+
+__attribute__((target("avx2")))
+size_t DemosaicRowAVX2(const BayerRow& row, size_t x, size_t x_end, DemosaicMethod method) {
+  const __m256i color_lanes = ((x & 1) == row.color_x) ? _mm256_set1_epi16(0x00FF) : _mm256_set1_epi16((short)0xFF00);
+  const bool edge_aware = method == DemosaicMethod::EdgeAware;
+
+  for(; x + 32 <= x_end; x += 32) {
+    __m256i north_west = _mm256_loadu_si256((const __m256i*)(row.up + x - 1));
+    __m256i north = _mm256_loadu_si256((const __m256i*)(row.up + x));
+    __m256i north_east = _mm256_loadu_si256((const __m256i*)(row.up + x + 1));
+    __m256i west = _mm256_loadu_si256((const __m256i*)(row.mid + x - 1));
+    __m256i center = _mm256_loadu_si256((const __m256i*)(row.mid + x));
+    __m256i east = _mm256_loadu_si256((const __m256i*)(row.mid + x + 1));
+    __m256i south_west = _mm256_loadu_si256((const __m256i*)(row.down + x - 1));
+    __m256i south = _mm256_loadu_si256((const __m256i*)(row.down + x));
+    __m256i south_east = _mm256_loadu_si256((const __m256i*)(row.down + x + 1));
+
+    __m256i horizontal = _mm256_avg_epu8(west, east);
+    __m256i vertical = _mm256_avg_epu8(north, south);
+    __m256i cross = Average4AVX2(north, south, west, east);
+    __m256i diagonal = Average4AVX2(north_west, north_east, south_west, south_east);
+
+    __m256i green_estimate = edge_aware ? EdgeGreenAVX2(north, south, west, east, horizontal, vertical, cross) : cross;
+
+    __m256i green = _mm256_blendv_epi8(center, green_estimate, color_lanes);
+    __m256i row_color = _mm256_blendv_epi8(horizontal, center, color_lanes);
+    __m256i other_color = _mm256_blendv_epi8(vertical, diagonal, color_lanes);
+
+    __m256i blue = row.red_row ? other_color : row_color;
+    __m256i red = row.red_row ? row_color : other_color;
+
+    // byte shuffles do not cross 128-bit lanes, interleave both halves separately
+    StoreBGRSSE41(row.output + x * 3, _mm256_castsi256_si128(blue), _mm256_castsi256_si128(green), _mm256_castsi256_si128(red));
+    StoreBGRSSE41(row.output + (x + 16) * 3, _mm256_extracti128_si256(blue, 1), _mm256_extracti128_si256(green, 1), _mm256_extracti128_si256(red, 1));
+  }
+
+  return x;
+}
+
+__attribute__((target("avx2")))
+static inline void BinPlanesAVX2(const BinnedRow& row, __m256i planes[2][2], __m256i& blue, __m256i& green, __m256i& red) {
+  if(row.mono) {
+    green = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(_mm256_add_epi16(planes[0][0], planes[0][1]),
+        _mm256_add_epi16(planes[1][0], planes[1][1])), _mm256_set1_epi16(2)), 2);
+    blue = green;
+    red = green;
+    return;
+  }
+
+  blue = planes[1 - row.red_y][1 - row.red_x];
+  green = _mm256_avg_epu16(planes[row.red_y][1 - row.red_x], planes[1 - row.red_y][row.red_x]);
+  red = planes[row.red_y][row.red_x];
+}
+
+// packus works per 128-bit lane, put the 64-bit quarters back in tile order
+__attribute__((target("avx2")))
+static inline __m256i PackTilesAVX2(__m256i low, __m256i high) {
+  return _mm256_permute4x64_epi64(_mm256_packus_epi16(low, high), 0xD8);
+}
+
+__attribute__((target("avx2")))
+size_t BinRowAVX2(const BinnedRow& row, size_t tile) {
+  const __m256i even = _mm256_set1_epi16(0x00FF);
+
+  for(; tile + 32 <= row.tiles; tile += 32) {
+    __m256i planes[2][2][2];
+    const uint8_t* rows[2] = { row.top + tile * 2, row.bottom + tile * 2 };
+
+    for(size_t y = 0; y < 2; y++) {
+      for(size_t half = 0; half < 2; half++) {
+        __m256i samples = _mm256_loadu_si256((const __m256i*)(rows[y] + half * 32));
+        planes[half][y][0] = _mm256_and_si256(samples, even);
+        planes[half][y][1] = _mm256_srli_epi16(samples, 8);
+      }
+    }
+
+    __m256i blue[2];
+    __m256i green[2];
+    __m256i red[2];
+    for(size_t half = 0; half < 2; half++) {
+      BinPlanesAVX2(row, planes[half], blue[half], green[half], red[half]);
+    }
+
+    __m256i blue_tiles = PackTilesAVX2(blue[0], blue[1]);
+    __m256i green_tiles = PackTilesAVX2(green[0], green[1]);
+    __m256i red_tiles = PackTilesAVX2(red[0], red[1]);
+
+    StoreBGRSSE41(row.output + tile * 3, _mm256_castsi256_si128(blue_tiles), _mm256_castsi256_si128(green_tiles), _mm256_castsi256_si128(red_tiles));
+    StoreBGRSSE41(row.output + (tile + 16) * 3, _mm256_extracti128_si256(blue_tiles, 1), _mm256_extracti128_si256(green_tiles, 1),
+        _mm256_extracti128_si256(red_tiles, 1));
+  }
+
+  return tile;
+}
+
+#else
+
+size_t DemosaicRowSSE41(const BayerRow& row, size_t x, size_t x_end, DemosaicMethod method) {
+  return x;
+}
+
+size_t DemosaicRowAVX2(const BayerRow& row, size_t x, size_t x_end, DemosaicMethod method) {
+  return x;
+}
+
+size_t BinRowSSE41(const BinnedRow& row, size_t tile) {
+  return tile;
+}
+
+size_t BinRowAVX2(const BinnedRow& row, size_t tile) {
+  return tile;
+}
+
+size_t HalveRowSSE41(const uint8_t* top, const uint8_t* bottom, uint8_t* output, size_t x, size_t width) {
+  return x;
+}
+
+#endif
@@ -0,0 +1,35 @@
+#include "device_events.hpp"
+
+DeviceEvents::DeviceEvents(std::string serial) :
+  serial( serial ) {}
+
+void DeviceEvents::Follow(std::string device_serial) {
+  std::lock_guard<std::mutex> lock(mutex);
+  serial = device_serial;
+}
+
+void DeviceEvents::OnDeviceArrival(uint64_t device_serial) {
+  if(Matches(device_serial)) {
+    changed.NotifyAll();
+  }
+}
+
+void DeviceEvents::OnDeviceRemoval(uint64_t device_serial) {
+  if(Matches(device_serial)) {
+    removed = true;
+    changed.NotifyAll();
+  }
+}
+
+bool DeviceEvents::TakeRemoved() {
+  return removed.exchange(false);
+}
+
+Notifier& DeviceEvents::Changed() {
+  return changed;
+}
+
+bool DeviceEvents::Matches(uint64_t device_serial) {
+  std::lock_guard<std::mutex> lock(mutex);
+  return serial.empty() || serial == std::to_string(device_serial);
+}
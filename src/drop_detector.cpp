@@ -0,0 +1,18 @@
+#include "drop_detector.hpp"
+
+uint64_t DropDetector::Observe(uint64_t frame_id) {
+  uint64_t missing = 0;
+
+  if(started && frame_id > expected) {
+    missing = frame_id - expected;
+  }
+
+  started = true;
+  expected = frame_id + 1;
+
+  return missing;
+}
+
+void DropDetector::Reset() {
+  started = false;
+}
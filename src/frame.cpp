@@ -0,0 +1,90 @@
+#include "frame.hpp"
+
+void CopyFrameMetadata(const Frame& from, Frame& to) {
+  to.id = from.id;
+  to.grab_time = from.grab_time;
+  to.sensor_time = from.sensor_time;
+  to.chunk = from.chunk;
+  to.motion_score = from.motion_score;
+  to.still = from.still;
+  to.stats = from.stats;
+}
+
+FramePtr AnnotatedFrame(const FramePtr& frame) {
+  FramePtr image = frame;
+  return FramePtr(new Frame(*frame), [image](Frame* annotated) {
+    delete annotated;
+  });
+}
+
+size_t BytesPerPixel(PixelFormat pixel_format) {
+  switch(pixel_format) {
+    case PixelFormat::Mono8:
+    case PixelFormat::BayerRG8:
+    case PixelFormat::BayerGB8:
+    case PixelFormat::BayerGR8:
+    case PixelFormat::BayerBG8:
+      return 1;
+    case PixelFormat::Mono16:
+    case PixelFormat::BayerRG16:
+    case PixelFormat::BayerGB16:
+    case PixelFormat::BayerGR16:
+    case PixelFormat::BayerBG16:
+      return 2;
+    case PixelFormat::BGR8:
+      return 3;
+    default:
+      return 0;
+  }
+}
+
+bool IsBayer(PixelFormat pixel_format) {
+  return pixel_format != PixelFormat::Unknown &&
+      pixel_format != PixelFormat::Mono8 &&
+      pixel_format != PixelFormat::Mono16 &&
+      pixel_format != PixelFormat::BGR8;
+}
+
+bool BayerPhase(PixelFormat pixel_format, size_t& red_x, size_t& red_y) {
+  switch(pixel_format) {
+    case PixelFormat::BayerRG8:
+    case PixelFormat::BayerRG16:
+      red_x = 0;
+      red_y = 0;
+      return true;
+    case PixelFormat::BayerGR8:
+    case PixelFormat::BayerGR16:
+      red_x = 1;
+      red_y = 0;
+      return true;
+    case PixelFormat::BayerGB8:
+    case PixelFormat::BayerGB16:
+      red_x = 0;
+      red_y = 1;
+      return true;
+    case PixelFormat::BayerBG8:
+    case PixelFormat::BayerBG16:
+      red_x = 1;
+      red_y = 1;
+      return true;
+    default:
+      return false;
+  }
+}
+
+const char* PixelFormatName(PixelFormat pixel_format) {
+  switch(pixel_format) {
+    case PixelFormat::Mono8: return "Mono8";
+    case PixelFormat::Mono16: return "Mono16";
+    case PixelFormat::BayerRG8: return "BayerRG8";
+    case PixelFormat::BayerGB8: return "BayerGB8";
+    case PixelFormat::BayerGR8: return "BayerGR8";
+    case PixelFormat::BayerBG8: return "BayerBG8";
+    case PixelFormat::BayerRG16: return "BayerRG16";
+    case PixelFormat::BayerGB16: return "BayerGB16";
+    case PixelFormat::BayerGR16: return "BayerGR16";
+    case PixelFormat::BayerBG16: return "BayerBG16";
+    case PixelFormat::BGR8: return "BGR8";
+    default: return "Unknown";
+  }
+}
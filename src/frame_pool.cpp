@@ -0,0 +1,110 @@
+#include "frame_pool.hpp"
+
+FramePool::Storage::Storage(size_t capacity, size_t frame_size, size_t buffer_stride, std::shared_ptr<Accounting> accounting) :
+  frame_size( frame_size ),
+  arena( capacity * buffer_stride ),
+  accounting( accounting ),
+  buffers( capacity, nullptr ),
+  frames( capacity ),
+  in_use( new std::atomic<bool>[capacity] ),
+  available( 0 ) {
+  for(size_t i = 0; i < capacity; i++) {
+    in_use[i].store(true, std::memory_order_relaxed);
+  }
+
+  accounting->reserved.fetch_add(arena.MappedSize(), std::memory_order_relaxed);
+}
+
+FramePool::Storage::~Storage() {
+  accounting->reserved.fetch_sub(arena.MappedSize(), std::memory_order_relaxed);
+}
+
+FramePool::FramePool(size_t capacity) :
+  capacity( capacity ),
+  accounting( std::make_shared<Accounting>() ) {}
+
+bool FramePool::Reserve(size_t frame_size) {
+  // shrink only when most of every buffer would go unused, e.g. after switching to a smaller ROI
+  if(storage && storage->frame_size >= frame_size && storage->frame_size / SHRINK_FACTOR < frame_size) {
+    return true;
+  }
+
+  size_t buffer_stride = (frame_size + BUFFER_ALIGNMENT - 1) / BUFFER_ALIGNMENT * BUFFER_ALIGNMENT;
+  std::shared_ptr<Storage> reserved = std::make_shared<Storage>(capacity, frame_size, buffer_stride, accounting);
+
+  if(!reserved->arena.Valid()) {
+    return false;
+  }
+
+  for(size_t i = 0; i < capacity; i++) {
+    reserved->buffers[i] = reserved->arena.Data() + i * buffer_stride;
+    reserved->in_use[i].store(false, std::memory_order_relaxed);
+  }
+  reserved->available.store(capacity, std::memory_order_release);
+
+  // frames still out from previous storage keep it alive until they are released
+  storage = reserved;
+  next_slot = 0;
+
+  return true;
+}
+
+FramePtr FramePool::Acquire() {
+  if(!storage) {
+    exhausted.fetch_add(1, std::memory_order_relaxed);
+    return FramePtr();
+  }
+
+  for(size_t i = 0; i < capacity; i++) {
+    size_t slot = (next_slot + i) % capacity;
+
+    if(!storage->in_use[slot].exchange(true, std::memory_order_acquire)) {
+      next_slot = slot + 1;
+      storage->available.fetch_sub(1, std::memory_order_relaxed);
+      accounting->in_use.fetch_add(storage->frame_size, std::memory_order_relaxed);
+
+      Frame* frame = &storage->frames[slot];
+      *frame = Frame();
+      frame->data = storage->buffers[slot];
+      frame->size = storage->frame_size;
+
+      std::shared_ptr<Storage> owner = storage;
+      return FramePtr(frame, [owner, slot](Frame*) {
+        owner->accounting->in_use.fetch_sub(owner->frame_size, std::memory_order_relaxed);
+        owner->available.fetch_add(1, std::memory_order_relaxed);
+        owner->in_use[slot].store(false, std::memory_order_release);
+      });
+    }
+  }
+
+  exhausted.fetch_add(1, std::memory_order_relaxed);
+  return FramePtr();
+}
+
+size_t FramePool::Capacity() {
+  return capacity;
+}
+
+size_t FramePool::Available() {
+  return storage ? storage->available.load(std::memory_order_relaxed) : 0;
+}
+
+size_t FramePool::FrameSize() {
+  return storage ? storage->frame_size : 0;
+}
+
+uint64_t FramePool::Exhausted() {
+  return exhausted.load(std::memory_order_relaxed);
+}
+
+size_t FramePool::ReservedBytes() {
+  return accounting->reserved.load(std::memory_order_relaxed);
+}
+
+size_t FramePool::InUseBytes() {
+  return accounting->in_use.load(std::memory_order_relaxed);
+}
+
+bool FramePool::HugePages() {
+  return storage && storage->arena.HugePages();
+}
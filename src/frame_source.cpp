@@ -0,0 +1,192 @@
+#include "frame_source.hpp"
+
+#include <algorithm>
+#include "clock.hpp"
+
+FrameSource::FrameSource(std::atomic<bool>& run, size_t pool_size) :
+  run( run ),
+  frame_pool( pool_size ) {}
+
+FrameSource::~FrameSource() {}
+
+int FrameSource::LentFrames() {
+  return 0;
+}
+
+bool FrameSource::SetRoi(RoiProfile profile) {
+  return false;
+}
+
+bool FrameSource::SetExposure(double microseconds) {
+  return false;
+}
+
+void FrameSource::Deliver(FramePtr frame, uint64_t grab_time, FrameQueue<FramePtr>& capture_queue) {
+  RegisterArrival(grab_time);
+
+  if(!frame) {
+    missed_frames++;
+    return;
+  }
+
+  frame->id = frame_sequence++;
+  frame->grab_time = grab_time;
+
+  // shed frames leave a gap in ids so consumers can tell
+  if(!load_shedder.Admit(capture_queue)) {
+    return;
+  }
+
+  frame->enqueue_time = MonotonicNow();
+  handoff_latency.Record(frame->enqueue_time - grab_time);
+
+  if(frame->sensor_time != 0 && grab_time > frame->sensor_time) {
+    sensor_latency.Record(grab_time - frame->sensor_time);
+  }
+
+  capture_queue.Push(frame);
+}
+
+void FrameSource::RegisterCaptureStart() {
+  second_begin = MonotonicNow();
+}
+
+void FrameSource::RegisterFrameCapture() {
+  uint64_t now = MonotonicNow();
+
+  // 1 second passed
+  if (now - second_begin >= 1000000000ULL) {
+    fps = frame_counter;
+    frame_counter = 0;
+    second_begin = now;
+  }
+
+  frame_counter++;
+  captured_frames++;
+}
+
+void FrameSource::RegisterIncompleteFrame() {
+  incomplete_frames++;
+}
+
+void FrameSource::RegisterArrival(uint64_t grab_time) {
+  if(last_arrival != 0 && grab_time > last_arrival) {
+    uint64_t interval = grab_time - last_arrival;
+    arrival_interval.Record(interval);
+
+    if(average_interval != 0) {
+      arrival_jitter.Record(interval > average_interval ? interval - average_interval : average_interval - interval);
+      average_interval += ((int64_t)interval - (int64_t)average_interval) / INTERVAL_AVERAGE_WEIGHT;
+    }
+    else {
+      average_interval = interval;
+    }
+  }
+
+  last_arrival = grab_time;
+}
+
+void FrameSource::RegisterCameraFrame(uint64_t camera_frame_id) {
+  uint64_t missing = drop_detector.Observe(camera_frame_id);
+  if(missing == 0) {
+    return;
+  }
+
+  // an interval spanning lost frames says nothing about scheduling
+  last_arrival = 0;
+
+  dropped_frames += missing;
+
+  // blame link first, then driver, whatever is left over stays unattributed
+  uint64_t link_lost = last_link_lost;
+  uint64_t driver_dropped = last_driver_dropped;
+  ReadLossCounters(link_lost, driver_dropped);
+
+  uint64_t link_part = std::min(missing, link_lost - last_link_lost);
+  uint64_t driver_part = std::min(missing - link_part, driver_dropped - last_driver_dropped);
+  link_lost_frames += link_part;
+  driver_dropped_frames += driver_part;
+
+  last_link_lost = link_lost;
+  last_driver_dropped = driver_dropped;
+}
+
+void FrameSource::RestartCameraFrames() {
+  drop_detector.Reset();
+  last_arrival = 0;
+
+  // loss counters restart along with the stream
+  last_link_lost = 0;
+  last_driver_dropped = 0;
+}
+
+void FrameSource::RegisterReconfiguration(uint64_t downtime) {
+  reconfigure_downtime.Record(downtime);
+}
+
+void FrameSource::RegisterRecovery(uint64_t recovery) {
+  recovery_time.Record(recovery);
+}
+
+void FrameSource::ReadLossCounters(uint64_t& link_lost, uint64_t& driver_dropped) {
+}
+
+int FrameSource::FPS() {
+  return fps.load();
+}
+
+uint64_t FrameSource::CapturedFrames() {
+  return captured_frames.load();
+}
+
+uint64_t FrameSource::IncompleteFrames() {
+  return incomplete_frames.load();
+}
+
+uint64_t FrameSource::MissedFrames() {
+  return missed_frames.load();
+}
+
+LatencyHistogram& FrameSource::HandoffLatency() {
+  return handoff_latency;
+}
+
+FramePool& FrameSource::Pool() {
+  return frame_pool;
+}
+
+LoadShedder& FrameSource::Shedder() {
+  return load_shedder;
+}
+
+uint64_t FrameSource::DroppedFrames() {
+  return dropped_frames.load();
+}
+
+uint64_t FrameSource::LinkLostFrames() {
+  return link_lost_frames.load();
+}
+
+uint64_t FrameSource::DriverDroppedFrames() {
+  return driver_dropped_frames.load();
+}
+
+LatencyHistogram& FrameSource::SensorLatency() {
+  return sensor_latency;
+}
+
+LatencyHistogram& FrameSource::ArrivalInterval() {
+  return arrival_interval;
+}
+
+LatencyHistogram& FrameSource::ArrivalJitter() {
+  return arrival_jitter;
+}
+
+LatencyHistogram& FrameSource::ReconfigureDowntime() {
+  return reconfigure_downtime;
+}
+
+LatencyHistogram& FrameSource::RecoveryTime() {
+  return recovery_time;
+}
@@ -0,0 +1,80 @@
+#include "histogram.hpp"
+
+#include <cmath>
+
+LatencyHistogram::LatencyHistogram() :
+  buckets( new std::atomic<uint64_t>[BUCKETS] ) {
+  for(size_t i = 0; i < BUCKETS; i++) {
+    buckets[i].store(0, std::memory_order_relaxed);
+  }
+}
+
+// values below SUB_BUCKETS get a bucket each, every following power of two
+// range is split into SUB_BUCKETS buckets
+size_t LatencyHistogram::BucketIndex(uint64_t value) {
+  if(value < SUB_BUCKETS) {
+    return value;
+  }
+
+  int shift = 63 - __builtin_clzll(value) - SUB_BUCKET_BITS;
+  return (shift + 1) * SUB_BUCKETS + ((value >> shift) - SUB_BUCKETS);
+}
+
+uint64_t LatencyHistogram::BucketUpperBound(size_t index) {
+  if(index < SUB_BUCKETS) {
+    return index;
+  }
+
+  int shift = index / SUB_BUCKETS - 1;
+  uint64_t mantissa = index % SUB_BUCKETS + SUB_BUCKETS;
+  return ((mantissa + 1) << shift) - 1;
+}
+
+void LatencyHistogram::Record(uint64_t value) {
+  buckets[BucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+  count.fetch_add(1, std::memory_order_relaxed);
+  sum.fetch_add(value, std::memory_order_relaxed);
+
+  uint64_t previous = max.load(std::memory_order_relaxed);
+  while(value > previous && !max.compare_exchange_weak(previous, value, std::memory_order_relaxed)) {
+  }
+}
+
+uint64_t LatencyHistogram::Percentile(double quantile) {
+  uint64_t total = count.load(std::memory_order_relaxed);
+  if(total == 0) {
+    return 0;
+  }
+
+  // rank of the requested value, 1 based
+  uint64_t rank = std::ceil(quantile * total);
+  if(rank < 1) {
+    rank = 1;
+  }
+
+  uint64_t seen = 0;
+  for(size_t i = 0; i < BUCKETS; i++) {
+    seen += buckets[i].load(std::memory_order_relaxed);
+    if(seen >= rank) {
+      // bucket bound may overshoot the largest value actually recorded
+      uint64_t bound = BucketUpperBound(i);
+      uint64_t largest = max.load(std::memory_order_relaxed);
+      return bound < largest ? bound : largest;
+    }
+  }
+
+  // buckets were still being updated while we counted
+  return max.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::Count() {
+  return count.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::Sum() {
+  return sum.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::Max() {
+  return max.load(std::memory_order_relaxed);
+}
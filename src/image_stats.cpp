@@ -0,0 +1,150 @@
+#include "image_stats.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+const char* ImageChannelName(size_t channels, size_t channel) {
+  if(channels == 1) {
+    return "mono";
+  }
+
+  switch(channel) {
+    case 0: return "red";
+    case 1: return "green";
+    default: return "blue";
+  }
+}
+
+// Counts per position in the 2x2 tile. Consecutive tiles go to different
+// copies, so increments of the same bin do not wait on each other.
+struct TileCounts {
+  static const size_t COPIES = 4;
+
+  uint32_t bins[4][COPIES][256];
+  uint64_t sums[4];
+};
+
+// one row of 8-bit pixels, position is 0 on the upper and 2 on the lower row
+// of the tiles; sums come from the histogram later
+static void CountRow8(const uint8_t* row, size_t width, size_t step, size_t position, TileCounts& counts) {
+  uint32_t (*even)[256] = counts.bins[position];
+  uint32_t (*odd)[256] = counts.bins[position + 1];
+  size_t x = 0;
+
+  if(step == 1) {
+    for(; x + 7 < width; x += 8) {
+      even[0][row[x]]++;
+      odd[0][row[x + 1]]++;
+      even[1][row[x + 2]]++;
+      odd[1][row[x + 3]]++;
+      even[2][row[x + 4]]++;
+      odd[2][row[x + 5]]++;
+      even[3][row[x + 6]]++;
+      odd[3][row[x + 7]]++;
+    }
+  }
+
+  for(size_t copy = 0; x + 1 < width; x += 2 * step, copy = (copy + 1) % TileCounts::COPIES) {
+    even[copy][row[x]]++;
+    odd[copy][row[x + 1]]++;
+  }
+}
+
+// same for 16-bit pixels, anything past the bit depth lands in the top bin
+static void CountRow16(const uint16_t* row, size_t width, size_t step, int shift, size_t position, TileCounts& counts) {
+  uint32_t (*even)[256] = counts.bins[position];
+  uint32_t (*odd)[256] = counts.bins[position + 1];
+  uint64_t even_sum = 0;
+  uint64_t odd_sum = 0;
+
+  for(size_t x = 0, copy = 0; x + 1 < width; x += 2 * step, copy = (copy + 1) % TileCounts::COPIES) {
+    uint16_t left = row[x];
+    uint16_t right = row[x + 1];
+    even_sum += left;
+    odd_sum += right;
+
+    even[copy][std::min(left >> shift, 255)]++;
+    odd[copy][std::min(right >> shift, 255)]++;
+  }
+
+  counts.sums[position] += even_sum;
+  counts.sums[position + 1] += odd_sum;
+}
+
+bool ComputeImageStats(const Frame& frame, size_t step, int bits, ImageStats& stats, ImageHistogram* histogram) {
+  stats = ImageStats();
+
+  size_t bytes_per_pixel = BytesPerPixel(frame.pixel_format);
+  if(frame.data == nullptr || frame.width < 2 || frame.height < 2 || (bytes_per_pixel != 1 && bytes_per_pixel != 2)) {
+    return false;
+  }
+
+  step = std::max<size_t>(step, 1);
+  int shift = bytes_per_pixel == 2 ? std::max(0, std::min(bits, 16) - 8) : 0;
+
+  TileCounts counts;
+  memset(&counts, 0, sizeof(counts));
+
+  for(size_t y = 0; y + 1 < frame.height; y += 2 * step) {
+    for(size_t half = 0; half < 2; half++) {
+      const uint8_t* row = frame.data + (y + half) * frame.stride;
+      if(bytes_per_pixel == 1) {
+        CountRow8(row, frame.width, step, half * 2, counts);
+      }
+      else {
+        CountRow16((const uint16_t*)row, frame.width, step, shift, half * 2, counts);
+      }
+    }
+  }
+
+  // tile positions to channels
+  size_t red_x = 0;
+  size_t red_y = 0;
+  bool bayer = BayerPhase(frame.pixel_format, red_x, red_y);
+
+  ImageHistogram merged;
+  merged.channels = bayer ? 3 : 1;
+  uint64_t sums[3] = {};
+
+  for(size_t position = 0; position < 4; position++) {
+    size_t x = position % 2;
+    size_t y = position / 2;
+    size_t channel = 0;
+    if(bayer) {
+      channel = x == red_x && y == red_y ? 0 : (x != red_x && y != red_y ? 2 : 1);
+    }
+
+    for(size_t bin = 0; bin < 256; bin++) {
+      uint32_t count = 0;
+      for(size_t copy = 0; copy < TileCounts::COPIES; copy++) {
+        count += counts.bins[position][copy][bin];
+      }
+
+      merged.bins[channel][bin] += count;
+      merged.samples[channel] += count;
+      if(bytes_per_pixel == 1) {
+        sums[channel] += (uint64_t)count * bin;
+      }
+    }
+    sums[channel] += counts.sums[position];
+  }
+
+  stats.channels = merged.channels;
+  for(size_t channel = 0; channel < merged.channels; channel++) {
+    uint64_t samples = merged.samples[channel];
+    if(samples == 0) {
+      continue;
+    }
+
+    stats.mean[channel] = (double)sums[channel] / (1 << shift) / samples;
+    stats.under[channel] = 100.0 * merged.bins[channel][0] / samples;
+    stats.over[channel] = 100.0 * merged.bins[channel][255] / samples;
+  }
+  stats.valid = true;
+
+  if(histogram != nullptr) {
+    *histogram = merged;
+  }
+
+  return true;
+}
@@ -0,0 +1,212 @@
+#include "load_shedder.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include "clock.hpp"
+
+const char* ShedReasonName(ShedReason reason) {
+  switch(reason) {
+    case ShedReason::Decimated:
+      return "decimated";
+    case ShedReason::Superseded:
+      return "superseded";
+    case ShedReason::Adaptive:
+      return "adaptive";
+    case ShedReason::OverBudget:
+      return "over_budget";
+    default:
+      return "unknown";
+  }
+}
+
+bool ParseShedConfig(std::string text, ShedConfig& config) {
+  size_t separator = text.find(':');
+  std::string mode = text.substr(0, separator);
+  long value = separator == std::string::npos ? 0 : atol(text.c_str() + separator + 1);
+
+  if(mode == "off" && separator == std::string::npos) {
+    config = ShedConfig();
+    return true;
+  }
+  if(mode == "newest" && separator == std::string::npos) {
+    config = ShedConfig();
+    config.mode = ShedMode::NewestOnly;
+    return true;
+  }
+  if(mode == "every" && value >= 1) {
+    config = ShedConfig();
+    config.mode = ShedMode::EveryNth;
+    config.keep_every = value;
+    return true;
+  }
+  if(mode == "adaptive" && value >= 1) {
+    config = ShedConfig();
+    config.mode = ShedMode::Adaptive;
+    config.latency_budget = value * 1000000ULL;
+    return true;
+  }
+
+  return false;
+}
+
+void LoadShedder::Configure(ShedConfig config) {
+  this->config = config;
+  sequence = 0;
+  control_begin = 0;
+  capture.consumer_interval = 0;
+  for(Channel& channel : channels) {
+    channel.consumer_interval = 0;
+  }
+  decimation = config.mode == ShedMode::EveryNth ? std::max(config.keep_every, 1) : 1;
+}
+
+ShedConfig LoadShedder::Config() {
+  return config;
+}
+
+void LoadShedder::Watch(FrameQueue<FramePtr>* channel) {
+  Channel watched;
+  watched.queue = channel;
+  channels.push_back(watched);
+}
+
+bool LoadShedder::Admit(FrameQueue<FramePtr>& queue) {
+  switch(config.mode) {
+    case ShedMode::EveryNth:
+      if(!Decimate(config.keep_every)) {
+        Count(ShedReason::Decimated);
+        return false;
+      }
+      return true;
+
+    case ShedMode::NewestOnly: {
+      // whatever still waits is older than this frame, consumers skip straight to it
+      for(size_t stale = Supersede(queue); stale > 0; stale--) {
+        Count(ShedReason::Superseded);
+      }
+      return true;
+    }
+
+    case ShedMode::Adaptive: {
+      Control(queue);
+
+      if(!Decimate(decimation.load(std::memory_order_relaxed))) {
+        Count(ShedReason::Adaptive);
+        return false;
+      }
+
+      // a frame kept by decimation still goes when it would arrive too late
+      uint64_t wait = Wait();
+      predicted_wait.store(wait, std::memory_order_relaxed);
+      if(wait > config.latency_budget) {
+        Count(ShedReason::OverBudget);
+        return false;
+      }
+      return true;
+    }
+
+    default:
+      return true;
+  }
+}
+
+bool LoadShedder::Decimate(int factor) {
+  return factor <= 1 || sequence++ % factor == 0;
+}
+
+// discarded rather than popped so queue wait statistics stay the consumers';
+// fanned out channels hold the same frames, the one losing most counts
+size_t LoadShedder::Supersede(FrameQueue<FramePtr>& queue) {
+  size_t fanned_out = 0;
+  for(Channel& channel : channels) {
+    fanned_out = std::max(fanned_out, channel.queue->Discard());
+  }
+  return queue.Discard() + fanned_out;
+}
+
+void LoadShedder::Control(FrameQueue<FramePtr>& queue) {
+  uint64_t now = MonotonicNow();
+  capture.queue = &queue;
+
+  if(control_begin == 0) {
+    control_begin = now;
+    capture.control_popped = queue.Popped();
+    for(Channel& channel : channels) {
+      channel.control_popped = channel.queue->Popped();
+    }
+    return;
+  }
+
+  uint64_t elapsed = now - control_begin;
+  Pace(capture, elapsed);
+  for(Channel& channel : channels) {
+    Pace(channel, elapsed);
+  }
+
+  if(elapsed < CONTROL_INTERVAL) {
+    return;
+  }
+
+  control_begin = now;
+  capture.control_popped = queue.Popped();
+  for(Channel& channel : channels) {
+    channel.control_popped = channel.queue->Popped();
+  }
+
+  uint64_t wait = Wait();
+  int factor = decimation.load(std::memory_order_relaxed);
+
+  if(wait > config.latency_budget) {
+    factor = std::min(factor * 2, MAX_DECIMATION);
+  }
+  else if(wait < config.latency_budget / 2 && factor > 1) {
+    factor--;
+  }
+
+  decimation.store(factor, std::memory_order_relaxed);
+}
+
+// consumer pace so far in this interval, a stalled consumer with frames
+// waiting takes at least the time passed for its next one
+void LoadShedder::Pace(Channel& channel, uint64_t elapsed) {
+  uint64_t taken = channel.queue->Popped() - channel.control_popped;
+  if(taken > 0 && elapsed >= MIN_PACE_WINDOW) {
+    channel.consumer_interval = elapsed / taken;
+  }
+  else if(taken == 0 && !channel.queue->Empty()) {
+    channel.consumer_interval = std::max(channel.consumer_interval, elapsed);
+  }
+}
+
+// a new frame waits behind the capture queue and then in the slowest channel
+uint64_t LoadShedder::Wait() {
+  uint64_t wait = 0;
+  for(Channel& channel : channels) {
+    wait = std::max(wait, channel.queue->Size() * channel.consumer_interval);
+  }
+  return capture.queue->Size() * capture.consumer_interval + wait;
+}
+
+void LoadShedder::Count(ShedReason reason) {
+  shed[(size_t)reason].fetch_add(1, std::memory_order_relaxed);
+}
+
+uint64_t LoadShedder::Shed(ShedReason reason) {
+  return shed[(size_t)reason].load(std::memory_order_relaxed);
+}
+
+uint64_t LoadShedder::ShedTotal() {
+  uint64_t total = 0;
+  for(size_t i = 0; i < (size_t)ShedReason::Count; i++) {
+    total += shed[i].load(std::memory_order_relaxed);
+  }
+  return total;
+}
+
+int LoadShedder::Decimation() {
+  return decimation.load(std::memory_order_relaxed);
+}
+
+uint64_t LoadShedder::PredictedWait() {
+  return predicted_wait.load(std::memory_order_relaxed);
+}
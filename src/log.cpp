@@ -0,0 +1,377 @@
+#include "log.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include "clock.hpp"
+
+LogRing::LogRing(size_t capacity) :
+  capacity( capacity ),
+  records( new LogRecord[capacity] ) {}
+
+LogRecord* LogRing::Reserve() {
+  uint64_t position = head.load(std::memory_order_relaxed);
+  if(position - tail.load(std::memory_order_acquire) >= capacity) {
+    dropped.fetch_add(1, std::memory_order_relaxed);
+    return nullptr;
+  }
+  return &records[position % capacity];
+}
+
+void LogRing::Commit() {
+  head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+LogRecord* LogRing::Peek() {
+  uint64_t position = tail.load(std::memory_order_relaxed);
+  if(position == head.load(std::memory_order_acquire)) {
+    return nullptr;
+  }
+  return &records[position % capacity];
+}
+
+void LogRing::Release() {
+  tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+uint64_t LogRing::Dropped() {
+  return dropped.load(std::memory_order_relaxed);
+}
+
+// ring of a thread, closed when the thread ends so the logger can let it go
+struct ThreadLogRing {
+  std::shared_ptr<LogRing> ring;
+
+  ~ThreadLogRing() {
+    if(ring) {
+      ring->closed.store(true, std::memory_order_release);
+    }
+  }
+};
+
+static thread_local ThreadLogRing thread_ring;
+
+// rate limit state of the formats a thread logs, the address of the format
+// literal picks a set and the least recently used format of it makes room
+struct LogRateLimit {
+  const char* format = nullptr;
+  uint64_t window_start = 0;
+  uint64_t last_used = 0;
+  uint32_t count = 0;
+  uint32_t suppressed = 0;
+};
+
+static const size_t RATE_LIMIT_SETS = 16;
+static const size_t RATE_LIMIT_WAYS = 4;
+static thread_local LogRateLimit rate_limits[RATE_LIMIT_SETS][RATE_LIMIT_WAYS];
+
+// when this thread last looked for bursts which ended with messages left out
+static thread_local uint64_t rate_limit_sweep = 0;
+
+static const char SUPPRESSED_FORMAT[] = "{} messages like \"{}\" suppressed";
+
+// record being filled in by this thread between BeginLogRecord and CommitLogRecord
+static thread_local LogRing* pending_ring = nullptr;
+
+Logger& Logger::Instance() {
+  static Logger logger;
+  return logger;
+}
+
+Logger::Logger() {
+  thread = std::thread(&Logger::Run, this);
+}
+
+Logger::~Logger() {
+  {
+    std::lock_guard<std::mutex> lock(wake_mutex);
+    stopping = true;
+  }
+  wake.notify_one();
+  thread.join();
+  Drain();
+}
+
+LogRing* Logger::ThreadRing() {
+  if(!thread_ring.ring) {
+    thread_ring.ring = std::make_shared<LogRing>(RING_RECORDS);
+
+    std::lock_guard<std::mutex> lock(rings_mutex);
+    rings.push_back(thread_ring.ring);
+  }
+  return thread_ring.ring.get();
+}
+
+// a format gave up its rate limit state, or its burst ended without another
+// message to carry the count
+static void ReportSuppressed(LogRateLimit& limit, uint64_t now) {
+  LogRing* ring = Logger::Instance().ThreadRing();
+  LogRecord* record = ring->Reserve();
+  if(record != nullptr) {
+    record->time = now;
+    record->format = SUPPRESSED_FORMAT;
+    record->suppressed = 0;
+    record->level = LogLevel::Warning;
+    record->argument_count = 0;
+    record->text_used = 0;
+    AppendLogArgument(*record, limit.suppressed);
+    AppendLogArgument(*record, limit.format);
+    ring->Commit();
+  }
+  limit.suppressed = 0;
+}
+
+bool Logger::Admit(const char* format, uint64_t now, uint32_t& suppressed) {
+  LogRateLimit* set = rate_limits[((uintptr_t)format >> 3) % RATE_LIMIT_SETS];
+
+  LogRateLimit* found = nullptr;
+  LogRateLimit* oldest = &set[0];
+  for(size_t i = 0; i < RATE_LIMIT_WAYS; i++) {
+    if(set[i].format == format) {
+      found = &set[i];
+      break;
+    }
+    if(set[i].last_used < oldest->last_used) {
+      oldest = &set[i];
+    }
+  }
+
+  if(found == nullptr) {
+    if(oldest->suppressed > 0) {
+      ReportSuppressed(*oldest, now);
+    }
+    *oldest = LogRateLimit();
+    oldest->format = format;
+    found = oldest;
+  }
+
+  LogRateLimit& limit = *found;
+  limit.last_used = now;
+
+  // counts of other formats whose window passed go out on their own
+  if(now - rate_limit_sweep >= RATE_LIMIT_WINDOW) {
+    rate_limit_sweep = now;
+    for(auto& other_set : rate_limits) {
+      for(LogRateLimit& other : other_set) {
+        if(&other != &limit && other.suppressed > 0 && now - other.window_start >= RATE_LIMIT_WINDOW) {
+          ReportSuppressed(other, now);
+        }
+      }
+    }
+  }
+
+  if(now - limit.window_start >= RATE_LIMIT_WINDOW) {
+    limit.window_start = now;
+    limit.count = 0;
+  }
+
+  if(limit.count >= RATE_LIMIT_MESSAGES) {
+    limit.suppressed++;
+    Instance().suppressed.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  limit.count++;
+  suppressed = limit.suppressed;
+  limit.suppressed = 0;
+  return true;
+}
+
+void Logger::Flush() {
+  Drain();
+}
+
+void Logger::Write(const std::string& text) {
+  std::lock_guard<std::mutex> lock(text_mutex);
+  if(text_bytes + text.size() > MAX_TEXT_BYTES) {
+    text_drops++;
+    return;
+  }
+
+  // time taken under the lock keeps blocks in the order of their times
+  texts.push_back(TextBlock{ MonotonicNow(), text });
+  text_bytes += text.size();
+}
+
+uint64_t Logger::Written() {
+  return written.load(std::memory_order_relaxed);
+}
+
+uint64_t Logger::Dropped() {
+  uint64_t dropped = 0;
+  {
+    std::lock_guard<std::mutex> lock(text_mutex);
+    dropped += text_drops;
+  }
+
+  std::lock_guard<std::mutex> lock(rings_mutex);
+  dropped += retired_drops;
+  for(auto& ring : rings) {
+    dropped += ring->Dropped();
+  }
+  return dropped;
+}
+
+uint64_t Logger::Suppressed() {
+  return suppressed.load(std::memory_order_relaxed);
+}
+
+void Logger::Run() {
+  std::unique_lock<std::mutex> lock(wake_mutex);
+  while(!stopping) {
+    wake.wait_for(lock, std::chrono::milliseconds(FLUSH_INTERVAL));
+
+    lock.unlock();
+    Drain();
+    lock.lock();
+  }
+}
+
+void Logger::Drain() {
+  std::lock_guard<std::mutex> lock(drain_mutex);
+  DrainLocked();
+}
+
+void Logger::DrainLocked() {
+  // text first, records a thread logged before its text are in the rings by then
+  text_batch.clear();
+  {
+    std::lock_guard<std::mutex> lock(text_mutex);
+    text_batch.swap(texts);
+    text_bytes = 0;
+  }
+
+  std::vector<std::shared_ptr<LogRing>> current;
+  {
+    std::lock_guard<std::mutex> lock(rings_mutex);
+    current = rings;
+  }
+
+  batch.clear();
+  for(auto& ring : current) {
+    // closed before looking, so nothing can arrive after the ring was emptied
+    bool closed = ring->closed.load(std::memory_order_acquire);
+
+    for(LogRecord* record = ring->Peek(); record != nullptr; record = ring->Peek()) {
+      batch.push_back(*record);
+      ring->Release();
+    }
+
+    if(closed) {
+      std::lock_guard<std::mutex> lock(rings_mutex);
+      retired_drops += ring->Dropped();
+      rings.erase(std::find(rings.begin(), rings.end(), ring));
+    }
+  }
+
+  uint64_t dropped = Dropped();
+  if(batch.empty() && text_batch.empty() && dropped == reported_drops) {
+    return;
+  }
+
+  // threads are drained one after another, interleave their messages again
+  std::stable_sort(batch.begin(), batch.end(), [](const LogRecord& a, const LogRecord& b) {
+    return a.time < b.time;
+  });
+
+  output.clear();
+  size_t next_text = 0;
+  for(const LogRecord& record : batch) {
+    while(next_text < text_batch.size() && text_batch[next_text].time <= record.time) {
+      output += text_batch[next_text++].text;
+    }
+    Format(record, output);
+  }
+  while(next_text < text_batch.size()) {
+    output += text_batch[next_text++].text;
+  }
+
+  if(dropped != reported_drops) {
+    output += "Warning: " + std::to_string(dropped - reported_drops) + " log messages lost, logging faster than they are written\n";
+    reported_drops = dropped;
+  }
+
+  fwrite(output.data(), 1, output.size(), stdout);
+  fflush(stdout);
+  written.fetch_add(batch.size(), std::memory_order_relaxed);
+}
+
+void Logger::Format(const LogRecord& record, std::string& output) {
+  if(record.level == LogLevel::Warning) {
+    output += "Warning: ";
+  }
+  else if(record.level == LogLevel::Error) {
+    output += "Error: ";
+  }
+
+  size_t argument = 0;
+  for(const char* c = record.format; *c != '\0'; c++) {
+    if(c[0] != '{' || c[1] != '}' || argument >= record.argument_count) {
+      output += *c;
+      continue;
+    }
+
+    char number[32];
+    switch(record.types[argument]) {
+      case LogArgumentType::Signed:
+        snprintf(number, sizeof(number), "%lld", (long long)record.values[argument].signed_value);
+        output += number;
+        break;
+      case LogArgumentType::Unsigned:
+        snprintf(number, sizeof(number), "%llu", (unsigned long long)record.values[argument].unsigned_value);
+        output += number;
+        break;
+      case LogArgumentType::Float:
+        snprintf(number, sizeof(number), "%g", record.values[argument].float_value);
+        output += number;
+        break;
+      case LogArgumentType::Text:
+        output.append(record.text + record.values[argument].text.offset, record.values[argument].text.length);
+        break;
+    }
+
+    argument++;
+    c++;
+  }
+
+  if(record.suppressed > 0) {
+    output += " (" + std::to_string(record.suppressed) + " similar messages suppressed)";
+  }
+  output += '\n';
+}
+
+LogRecord* BeginLogRecord(LogLevel level, const char* format) {
+  uint64_t now = MonotonicNow();
+  uint32_t suppressed = 0;
+  if(!Logger::Admit(format, now, suppressed)) {
+    return nullptr;
+  }
+
+  LogRing* ring = Logger::Instance().ThreadRing();
+  LogRecord* record = ring->Reserve();
+  if(record == nullptr) {
+    return nullptr;
+  }
+
+  record->time = now;
+  record->format = format;
+  record->suppressed = suppressed;
+  record->level = level;
+  record->argument_count = 0;
+  record->text_used = 0;
+
+  pending_ring = ring;
+  return record;
+}
+
+void CommitLogRecord() {
+  pending_ring->Commit();
+  pending_ring = nullptr;
+}
+
+void FlushLog() {
+  Logger::Instance().Flush();
+}
+
+void LogText(const std::string& text) {
+  Logger::Instance().Write(text);
+}
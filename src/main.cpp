@@ -1,129 +1,668 @@
 #include "main.hpp"
 
-bool run = true;
-const int QUEUE_READ_INTERVAL = 25 * 1000; // microseconds (every 25ms);
-bool convert = false;
+std::atomic<bool> run{true};
+std::atomic<bool> snapshot{false};
 
-// capture queue
-std::queue<Spinnaker::ImagePtr> capture_queue;
+// capture queue per camera
+const size_t CAPTURE_QUEUE_SIZE = 64; // frames
+const OverflowPolicy CAPTURE_QUEUE_POLICY = OverflowPolicy::DropOldest;
+CameraManager* camera_manager = NULL;
 
-void HandleSigInt(int sig) {
-  std::cout << "Exiting" << std::endl;
+// Bayer to BGR conversion of every frame unless a pipeline config says otherwise
+const DemosaicMethod DEMOSAIC_METHOD = DemosaicMethod::Bilinear;
+const size_t SNAPSHOT_QUEUE_SIZE = 4; // frames
+const size_t PREVIEW_QUEUE_SIZE = 2; // frames
+
+// processing stages per camera
+std::vector<Pipeline*> pipelines;
+
+// prometheus endpoint on localhost, 0 disables it
+const int METRICS_PORT = 9464;
+
+// how often the main thread looks for shutdown while it waits for keys or nothing
+const int SHUTDOWN_POLL = 100; // ms
+
+// signal which asked us to stop, 0 for none
+volatile sig_atomic_t stop_signal = 0;
+
+// only async-signal-safe stores, the main thread does the rest once it sees run turn false
+void HandleSignal(int sig) {
+  stop_signal = sig;
   run = false;
 }
 
-void Convert(Spinnaker::ImagePtr &spinnaker_frame) {
-  std::cout << "Converting" << std::endl;
-  Spinnaker::ImagePtr converted_image = spinnaker_frame->Convert(Spinnaker::PixelFormat_BGR8, Spinnaker::HQ_LINEAR);
+// on the main thread after run turned false, whoever asked for it
+void Shutdown() {
+  if(stop_signal != 0) {
+    LogInfo("Exiting on signal {}", (int)stop_signal);
+  }
+  else {
+    LogInfo("Exiting");
+  }
+  run = false;
+
+  // release capture threads waiting for free queue space and idle consumers
+  if(camera_manager != NULL) {
+    camera_manager->Close();
+  }
+  for(Pipeline* pipeline : pipelines) {
+    pipeline->Close();
+  }
 }
 
-void ConsumeQueue() {
-  Spinnaker::ImagePtr image = capture_queue.front();
-  capture_queue.pop();
+// save next converted frame when "c" is pressed
+void SaveSnapshot(std::string serial, const FramePtr& converted) {
+  if(!snapshot.exchange(false)) {
+    return;
+  }
 
-  if(convert) {
-    convert = false;
-    Convert(image);
+  std::string file_name = "snapshot_" + (serial.empty() ? std::string("camera") : serial) + "_" + std::to_string(converted->id) + ".png";
+  cv::Mat image(converted->height, converted->width, CV_8UC3, converted->data, converted->stride);
+
+  if(cv::imwrite(file_name, image)) {
+    LogInfo("Saved {}", file_name);
+  }
+  else {
+    LogInfo("Cannot save {}", file_name);
   }
 }
 
-void ProcessQueue() {
-  while(run) {
-    while(!capture_queue.empty()) {
-      ConsumeQueue();
-    }
+// convert -> snapshot, plus record when a directory is given and publish when asked
+PipelineConfig DefaultPipelineConfig(int conversion_workers, std::string record_directory, bool publish, float motion_threshold,
+    int stats_step, double preview_fps) {
+  PipelineConfig config;
+
+  // everything downstream only sees frames with motion
+  std::string raw_input = "source";
+  if(motion_threshold > 0) {
+    StageConfig motion;
+    motion.name = "motion";
+    motion.type = "motion";
+    motion.options["threshold"] = std::to_string(motion_threshold);
+    config.stages.push_back(motion);
+    raw_input = "motion";
+  }
+
+  // exposure statistics travel with every frame from here on
+  if(stats_step > 0) {
+    StageConfig stats;
+    stats.name = "stats";
+    stats.type = "stats";
+    stats.input = raw_input;
+    stats.options["step"] = std::to_string(stats_step);
+    config.stages.push_back(stats);
+    raw_input = "stats";
+  }
+
+  StageConfig convert;
+  convert.name = "convert";
+  convert.type = "convert";
+  convert.input = raw_input;
+  convert.workers = conversion_workers;
+  convert.options["method"] = DemosaicMethodName(DEMOSAIC_METHOD);
+  config.stages.push_back(convert);
 
-    // pause a little bit between queue processing
-    usleep(QUEUE_READ_INTERVAL); // 100 miliseconds or 0.1 second
+  StageConfig save;
+  save.name = "snapshot";
+  save.type = "snapshot";
+  save.input = "convert";
+  save.queue_size = SNAPSHOT_QUEUE_SIZE;
+  save.policy = OverflowPolicy::DropOldest;
+  config.stages.push_back(save);
+
+  if(!record_directory.empty()) {
+    StageConfig record;
+    record.name = "record";
+    record.type = "record";
+    record.input = raw_input;
+    record.options["directory"] = record_directory;
+    config.stages.push_back(record);
   }
+
+  if(publish) {
+    StageConfig shared;
+    shared.name = "publish";
+    shared.type = "publish";
+    shared.input = raw_input;
+    config.stages.push_back(shared);
+  }
+
+  // small and best effort, never holds up the frames it is made from
+  if(preview_fps > 0) {
+    StageConfig preview;
+    preview.name = "preview";
+    preview.type = "preview";
+    preview.input = raw_input;
+    preview.queue_size = PREVIEW_QUEUE_SIZE;
+    preview.policy = OverflowPolicy::DropOldest;
+    preview.options["fps"] = std::to_string(preview_fps);
+    config.stages.push_back(preview);
+
+    StageConfig shared;
+    shared.name = "publish_preview";
+    shared.type = "publish";
+    shared.input = "preview";
+    shared.queue_size = PREVIEW_QUEUE_SIZE;
+    shared.policy = OverflowPolicy::DropOldest;
+    shared.options["suffix"] = "_preview";
+    config.stages.push_back(shared);
+  }
+
+  return config;
+}
+
+void RegisterStages() {
+  RegisterBuiltinStages();
+
+  Pipeline::RegisterStage("snapshot", [](const StageConfig& config, StageContext& context) -> Stage* {
+    std::string serial = context.serial;
+    return new CallbackStage(context.run, config.workers, FrameKind::Converted, [serial](const FramePtr& converted) {
+      SaveSnapshot(serial, converted);
+    });
+  });
 }
 
+// current resident memory in kB
 int MemoryUsage() {
-  struct rusage r_usage;
-  getrusage(RUSAGE_SELF, &r_usage);
-  int memory_usage = r_usage.ru_maxrss;
+  return ResidentMemory() / 1024;
+}
+
+std::string CollectMetrics() {
+  MetricsWriter metrics;
+
+  camera_manager->WriteMetrics(metrics);
+  for(size_t i = 0; i < pipelines.size(); i++) {
+    pipelines[i]->WriteMetrics(metrics, camera_manager->Labels(i));
+  }
+
+  metrics.Gauge("process_resident_memory_bytes", "Resident memory size in bytes.", "", ResidentMemory());
+  metrics.Gauge("frame_memory_mapped_bytes", "Memory mapped for frame arenas.", "", ArenaMappedBytes());
+  metrics.Gauge("frame_memory_huge_page_bytes", "Frame arena memory backed by explicit huge pages.", "", ArenaHugePageBytes());
+  metrics.Gauge("frame_memory_locked_bytes", "Frame arena memory locked in RAM.", "", ArenaLockedBytes());
 
-  return memory_usage;
+  Logger& logger = Logger::Instance();
+  metrics.Counter("log_records_total", "Log messages written.", "", logger.Written());
+  metrics.Counter("log_dropped_total", "Log messages lost because the logger fell behind.", "", logger.Dropped());
+  metrics.Counter("log_suppressed_total", "Log messages left out by the rate limit.", "", logger.Suppressed());
+
+  return metrics.Text();
 }
 
-void Stat(Camera* camera) {
+// only the stats thread starts new queue latency windows, commands would take its samples
+std::string StatsText(CameraManager* manager, bool new_window) {
+  std::ostringstream out;
+  out << "memory usage: " << MemoryUsage() <<
+      ", frame memory MB: " << ArenaMappedBytes() / (1024 * 1024) <<
+      " (huge pages " << ArenaHugePageBytes() / (1024 * 1024) <<
+      ", locked " << ArenaLockedBytes() / (1024 * 1024) << ")" << std::endl;
+  manager->PrintStats(out, new_window);
+
+  for(Pipeline* pipeline : pipelines) {
+    pipeline->PrintStats(out);
+  }
+  return out.str();
+}
+
+void Stat(CameraManager* manager) {
   while(run) {
-    std::cout << "memory usage: " << MemoryUsage() << ", fps: " << camera->FPS() << std::endl;
+    // written at once, in order with the log
+    LogText(StatsText(manager, true));
+
     sleep(1);
   }
 }
 
+// camera settings stop acquisition for a while, they are deferred to the
+// command thread of the server
+void RegisterControlCommands(ControlServer& server, std::vector<RoiProfile>& roi_profiles, size_t& roi_index) {
+  server.Register("snapshot", "", 0, false, [](const std::vector<std::string>& arguments, std::string& reply) {
+    snapshot = true;
+    return true;
+  });
+
+  server.Register("record", "start|stop", 1, false, [](const std::vector<std::string>& arguments, std::string& reply) {
+    if(arguments[0] != "start" && arguments[0] != "stop") {
+      reply = "usage: record start|stop";
+      return false;
+    }
+
+    size_t recordings = 0;
+    for(Pipeline* pipeline : pipelines) {
+      for(Stage* stage : pipeline->Stages("record")) {
+        RecordStage* record = dynamic_cast<RecordStage*>(stage);
+        if(record != NULL) {
+          record->SetPaused(arguments[0] == "stop");
+          recordings++;
+        }
+      }
+    }
+
+    if(recordings == 0) {
+      reply = "nothing is recorded, see -r";
+      return false;
+    }
+    return true;
+  });
+
+  server.Register("roi", "<name>|next", 1, true, [&roi_profiles, &roi_index](const std::vector<std::string>& arguments, std::string& reply) {
+    size_t index = (roi_index + 1) % roi_profiles.size();
+    if(arguments[0] != "next" && !FindRoiProfile(roi_profiles, arguments[0], index)) {
+      reply = "unknown roi " + arguments[0];
+      return false;
+    }
+
+    // frame and conversion buffers follow the new size
+    roi_index = index;
+    camera_manager->SetRoi(roi_profiles[roi_index]);
+    return true;
+  });
+
+  server.Register("exposure", "<microseconds>", 1, true, [](const std::vector<std::string>& arguments, std::string& reply) {
+    double exposure = atof(arguments[0].c_str());
+    if(exposure <= 0) {
+      reply = "exposure needs a positive number of microseconds";
+      return false;
+    }
+
+    if(!camera_manager->SetExposure(exposure)) {
+      reply = "not every camera took exposure time " + arguments[0];
+      return false;
+    }
+    return true;
+  });
+
+  server.Register("stats", "", 0, false, [](const std::vector<std::string>& arguments, std::string& reply) {
+    reply = StatsText(camera_manager, false);
+    return true;
+  });
+
+  server.Register("quit", "", 0, false, [](const std::vector<std::string>& arguments, std::string& reply) {
+    // main thread shuts down once it notices
+    run = false;
+    return true;
+  });
+}
+
+void PrintUsage(char* name) {
+  std::cout << "Usage: " << name << " [-s serial]... [-a cpu_list] [-w workers] [-m port] [-r directory] [-x] [-g percent]" << std::endl;
+  std::cout << std::string(strlen(name) + 7, ' ') << " [-i step] [-v fps] [-c file] [-e] [-l] [-R priority] [-n] [-u socket] [-d shedding] [-o roi]" << std::endl;
+  std::cout << "       " << name << " -t WIDTHxHEIGHT[@FPS]... | -p recording... [options]" << std::endl;
+  std::cout << "  -s serial    capture from camera with given serial number, repeat for more cameras" << std::endl;
+  std::cout << "               (default: all connected cameras)" << std::endl;
+  std::cout << "  -a cpu_list  cpus for capture threads, e.g. 2,3 or 2-5 (default: one cpu per camera from cpu 0)" << std::endl;
+  std::cout << "  -w workers   conversion threads per camera, 1-" << MAX_STAGE_WORKERS << " (default: number of cpus)" << std::endl;
+  std::cout << "  -m port      serve prometheus metrics on localhost port, 0 disables (default: " << METRICS_PORT << ")" << std::endl;
+  std::cout << "  -r directory record raw frames of every camera into directory" << std::endl;
+  std::cout << "  -x           publish raw frames of every camera to shared memory " << SHM_NAME_PREFIX << "<serial>" << std::endl;
+  std::cout << "               for other local processes, see tools/shm_read.cpp" << std::endl;
+  std::cout << "  -g percent   pass on only frames of which more than percent changed since the previous one," << std::endl;
+  std::cout << "               with the frames shortly before and after them, to conversion, snapshots and sinks" << std::endl;
+  std::cout << "  -i step      exposure statistics of every raw frame, reading every step-th Bayer tile in both directions" << std::endl;
+  std::cout << "  -v fps       publish quarter size previews at up to fps to shared memory " << SHM_NAME_PREFIX << "<serial>_preview" << std::endl;
+  std::cout << "  -c file      build the processing stages of every camera from a pipeline config," << std::endl;
+  std::cout << "               -w, -r, -x, -g, -i and -v are ignored then (default: convert and snapshot, record with -r," << std::endl;
+  std::cout << "               publish with -x)" << std::endl;
+  std::cout << "  -t spec      capture synthetic Bayer frames instead of a camera, e.g. 1920x1200@60, repeatable" << std::endl;
+  std::cout << "  -p file      replay a recording instead of a camera, repeatable" << std::endl;
+  std::cout << "  -e           queue copies of driver image events instead of grabbing on the capture thread" << std::endl;
+  std::cout << "  -l           lock frame memory in RAM, needs a sufficient memlock limit" << std::endl;
+  std::cout << "  -R priority  run capture threads SCHED_FIFO at priority 1-99 and lock process memory, other" << std::endl;
+  std::cout << "               threads move off the capture cpus; needs CAP_SYS_NICE or an rtprio limit (default: off)" << std::endl;
+  std::cout << "  -n           run without a terminal, e.g. under a service manager, controlled through the socket only" << std::endl;
+  std::cout << "  -u socket    control socket taking snapshot, record start|stop, roi <name>|next, exposure <us>," << std::endl;
+  std::cout << "               stats and quit, see tools/capture_control.cpp (default: " << DefaultControlSocket() << ")" << std::endl;
+  std::cout << "  -d shedding  give up frames before the capture queue when consumers fall behind:" << std::endl;
+  std::cout << "               every:N keeps every Nth frame, newest keeps only the latest waiting frame," << std::endl;
+  std::cout << "               adaptive:MS decimates to keep queue wait within MS milliseconds (default: off)" << std::endl;
+  std::cout << "  -o roi       sensor readout profile (default: full), \"r\" switches to the next one:" << std::endl;
+  std::cout << "              ";
+  for(RoiProfile& profile : RoiProfiles()) {
+    std::cout << " " << profile.name;
+  }
+  std::cout << std::endl;
+}
+
+// cpu for the capture thread of source number `index`
+int CaptureCpu(std::vector<int>& cpus, size_t index) {
+  return cpus.empty() ? index % CpuCount() : cpus[index % cpus.size()];
+}
+
 int mygetch() {
   struct termios oldt,newt;
-  int ch;
+  unsigned char ch;
   tcgetattr( STDIN_FILENO, &oldt );
   newt = oldt;
   newt.c_lflag &= ~( ICANON | ECHO );
   tcsetattr( STDIN_FILENO, TCSANOW, &newt );
-  ch = getchar();
+  // unbuffered, keys left in a stdio buffer would be invisible to poll
+  ssize_t got = read( STDIN_FILENO, &ch, 1 );
   tcsetattr( STDIN_FILENO, TCSANOW, &oldt );
-  return ch;
+  return got == 1 ? ch : EOF;
 }
 
 int main(int argc, char **argv) {
-  // Register shutdown signal
-  signal(SIGINT, HandleSigInt);
+  std::vector<std::string> serials;
+  std::vector<int> cpus;
+  int conversion_workers = CpuCount();
+  int metrics_port = METRICS_PORT;
+  std::string record_directory;
+  std::vector<SyntheticConfig> synthetic_sources;
+  std::vector<std::string> replays;
+  std::vector<RoiProfile> roi_profiles = RoiProfiles();
+  size_t roi_index = 0;
+  GrabMode grab_mode = GrabMode::Polling;
+  std::string pipeline_path;
+  ArenaOptions arena_options;
+  ShedConfig shed_config;
+  bool publish = false;
+  int realtime_priority = 0;
+  float motion_threshold = 0;
+  int stats_step = 0;
+  double preview_fps = 0;
+  bool headless = false;
+  std::string control_socket = DefaultControlSocket();
+
+  int option;
+  while((option = getopt(argc, argv, "s:a:w:m:r:t:p:o:ec:ld:xR:g:i:v:nu:h")) != -1) {
+    switch(option) {
+      case 's':
+        serials.push_back(optarg);
+        break;
+      case 'a':
+        cpus = ParseCpuList(optarg);
+        break;
+      case 'w': {
+        size_t workers;
+        if(!ParseCount(optarg, 1, MAX_STAGE_WORKERS, workers)) {
+          PrintUsage(argv[0]);
+          return EX_USAGE;
+        }
+        conversion_workers = workers;
+        break;
+      }
+      case 'm': {
+        // 0 is a valid choice here, it turns metrics off
+        size_t port;
+        if(!ParseCount(optarg, 0, 65535, port)) {
+          PrintUsage(argv[0]);
+          return EX_USAGE;
+        }
+        metrics_port = port;
+        break;
+      }
+      case 'r':
+        record_directory = optarg;
+        break;
+      case 't': {
+        SyntheticConfig config;
+        if(!ParseSyntheticConfig(optarg, config)) {
+          PrintUsage(argv[0]);
+          return EX_USAGE;
+        }
+        config.name = "synthetic-" + std::to_string(synthetic_sources.size());
+        synthetic_sources.push_back(config);
+        break;
+      }
+      case 'p':
+        replays.push_back(optarg);
+        break;
+      case 'e':
+        grab_mode = GrabMode::Callback;
+        break;
+      case 'c':
+        pipeline_path = optarg;
+        break;
+      case 'l':
+        arena_options.lock = true;
+        break;
+      case 'x':
+        publish = true;
+        break;
+      case 'g':
+        motion_threshold = atof(optarg);
+        if(motion_threshold <= 0) {
+          PrintUsage(argv[0]);
+          return EX_USAGE;
+        }
+        break;
+      case 'i':
+        stats_step = atoi(optarg);
+        if(stats_step < 1) {
+          PrintUsage(argv[0]);
+          return EX_USAGE;
+        }
+        break;
+      case 'v':
+        preview_fps = atof(optarg);
+        if(preview_fps <= 0) {
+          PrintUsage(argv[0]);
+          return EX_USAGE;
+        }
+        break;
+      case 'n':
+        headless = true;
+        break;
+      case 'u':
+        control_socket = optarg;
+        break;
+      case 'R':
+        realtime_priority = atoi(optarg);
+        if(realtime_priority < 1 || realtime_priority > 99) {
+          PrintUsage(argv[0]);
+          return EX_USAGE;
+        }
+        break;
+      case 'd':
+        if(!ParseShedConfig(optarg, shed_config)) {
+          PrintUsage(argv[0]);
+          return EX_USAGE;
+        }
+        break;
+      case 'o':
+        if(!FindRoiProfile(roi_profiles, optarg, roi_index)) {
+          PrintUsage(argv[0]);
+          return EX_USAGE;
+        }
+        break;
+      default:
+        PrintUsage(argv[0]);
+        return EX_USAGE;
+    }
+  }
+
+  // before any pool maps frame memory
+  SetArenaOptions(arena_options);
 
+  RegisterStages();
+
+  PipelineConfig pipeline_config = DefaultPipelineConfig(conversion_workers, record_directory, publish, motion_threshold, stats_step, preview_fps);
+  if(!pipeline_path.empty() && !LoadPipelineConfig(pipeline_path, pipeline_config)) {
+    return EX_CONFIG;
+  }
+
+  // Register shutdown signals, service managers stop us with SIGTERM
+  signal(SIGINT, HandleSignal);
+  signal(SIGTERM, HandleSignal);
+
+  // without a terminal everything comes through the control socket
   static struct termios orig_term;
-  if (tcgetattr(fileno(stdin), &orig_term) < 0){
-    std::cout << "can't get tty settings" << std::endl;
-    return -1;
+  if(!headless) {
+    if (tcgetattr(fileno(stdin), &orig_term) < 0){
+      std::cout << "can't get tty settings, see -n to run without one" << std::endl;
+      return -1;
+    }
+
+    // put termios in raw mode
+    struct termios term;
+    term.c_iflag |= IGNBRK;
+    term.c_iflag &= ~(INLCR | ICRNL | IXON | IXOFF);
+    term.c_lflag &= ~(ICANON | ECHO | ECHOK | ECHOE | ECHONL | ISIG | IEXTEN);
+    term.c_cc[VMIN] = 1;
+    term.c_cc[VTIME] = 0;
+    if(tcsetattr(fileno(stdin), TCSANOW, &term) < 0) {
+      std::cout << "can't put tty to raw mode" << std::endl;
+      return -1;
+    }
   }
 
-  // put termios in raw mode
-  struct termios term;
-  term.c_iflag |= IGNBRK;
-  term.c_iflag &= ~(INLCR | ICRNL | IXON | IXOFF);
-  term.c_lflag &= ~(ICANON | ECHO | ECHOK | ECHOE | ECHONL | ISIG | IEXTEN);
-  term.c_cc[VMIN] = 1;
-  term.c_cc[VTIME] = 0;
-  if(tcsetattr(fileno(stdin), TCSANOW, &term) < 0) {
-    std::cout << "can't put tty to raw mode" << std::endl;
-    return -1;
+  // Initialize camera objects, all sharing one Spinnaker system
+  camera_manager = new CameraManager(run, CAPTURE_QUEUE_SIZE, CAPTURE_QUEUE_POLICY);
+
+  // cameras are only looked for when no other source is requested
+  bool hardware_free = !synthetic_sources.empty() || !replays.empty();
+
+  if(serials.empty() && !hardware_free) {
+    serials = camera_manager->Enumerate();
+  }
+
+  // wait for first camera to be connected when there is none yet
+  if(serials.empty() && !hardware_free) {
+    serials.push_back("");
+  }
+
+  for(size_t i = 0; i < serials.size(); i++) {
+    camera_manager->Add(serials[i], CaptureCpu(cpus, camera_manager->Size()), grab_mode);
+  }
+
+  for(SyntheticConfig& config : synthetic_sources) {
+    camera_manager->AddSource(new SyntheticSource(run, config), CaptureCpu(cpus, camera_manager->Size()));
+  }
+
+  for(std::string& path : replays) {
+    ReplaySource* replay = new ReplaySource(run, path);
+    if(!replay->IsOpen()) {
+      delete replay;
+      continue;
+    }
+    camera_manager->AddSource(replay, CaptureCpu(cpus, camera_manager->Size()));
+  }
+
+  camera_manager->SetShedding(shed_config);
+
+  // cameras pick it up when they connect
+  if(roi_index != 0) {
+    camera_manager->SetRoi(roi_profiles[roi_index]);
   }
 
-  // Initialize camera object
-  Camera* camera = new Camera(std::ref(run));
+  // capture threads get their cpus to themselves, every thread started from
+  // here on inherits the rest
+  if(realtime_priority > 0) {
+    std::vector<int> other_cpus = OtherCpus(camera_manager->Cpus());
+    if(other_cpus.empty()) {
+      std::cout << "capture threads use every cpu, processing shares them" << std::endl;
+    }
+    else {
+      PinCurrentThreadToCpus(other_cpus);
+    }
+
+    camera_manager->SetRealtime(realtime_priority);
+    LockAllMemory();
+  }
 
   // threads
   std::vector<std::thread> threads;
 
-  // start queue processing thread
-  threads.push_back(std::thread(ProcessQueue));
+  // start processing stages per camera
+  for(size_t i = 0; i < camera_manager->Size(); i++) {
+    Pipeline* pipeline = new Pipeline(run, camera_manager->GetSource(i), camera_manager->Queue(i));
+    pipelines.push_back(pipeline);
+
+    if(!pipeline->Build(pipeline_config)) {
+      run = false;
+      break;
+    }
 
-  // start camera capture thread
-  threads.push_back(std::thread(&Camera::Capture, camera, std::ref(capture_queue)));
+    pipeline->Start();
+  }
+
+  // start camera capture threads
+  camera_manager->Start();
 
   // start stats thread
-  threads.push_back(std::thread(Stat, std::ref(camera)));
+  threads.push_back(std::thread(Stat, camera_manager));
+
+  // metrics are optional, capture goes on when the port is taken
+  MetricsServer* metrics_server = NULL;
+  if(metrics_port > 0) {
+    metrics_server = new MetricsServer(run, metrics_port, CollectMetrics);
+    metrics_server->Start();
+  }
+
+  // keyboard and other processes control capture through the same commands,
+  // keys work without the socket but a headless capture is useless without it
+  int result = 0;
+  ControlServer control_server(run, control_socket);
+  RegisterControlCommands(control_server, roi_profiles, roi_index);
+  if(!control_server.Start() && headless) {
+    run = false;
+    result = EX_UNAVAILABLE;
+  }
+
+  while(run && headless) {
+    usleep(SHUTDOWN_POLL * 1000);
+  }
+
+  while(run && !headless) {
+    // signals and the quit command are noticed without a key being pressed
+    struct pollfd keys = {STDIN_FILENO, POLLIN, 0};
+    if(poll(&keys, 1, SHUTDOWN_POLL) <= 0) {
+      continue;
+    }
 
-  while(run) {
     int keyboard_input = mygetch();
+    std::string command;
 
     // CTRL+c
     if(keyboard_input == 3) {
-      HandleSigInt(0);
+      command = "quit";
     }
     // detect "c" key pressed
     else if(keyboard_input == 99) {
-      convert = true;
+      command = "snapshot";
+    }
+    // detect "r" key pressed
+    else if(keyboard_input == 114) {
+      command = "roi next";
+    }
+    else {
+      continue;
     }
 
-    sleep(1);
+    // run here, the socket may belong to another capture
+    std::string reply;
+    if(!control_server.Execute(command, reply)) {
+      LogError("{}: {}", command, reply);
+    }
+  }
+
+  Shutdown();
+
+  // finish pipelines first, recordings and channels hold frames which go back to the cameras
+  for(Pipeline* pipeline : pipelines) {
+    pipeline->Join();
   }
 
   // wait for all threads to be finished
+  camera_manager->Join();
   std::for_each(threads.begin(), threads.end(), std::mem_fn(&std::thread::join));
 
+  delete metrics_server;
+  control_server.Join();
+
+  for(Pipeline* pipeline : pipelines) {
+    delete pipeline;
+  }
+
+  // release cameras and system
+  delete camera_manager;
+
+  // capture threads are gone, write out what they logged
+  FlushLog();
+
   // flush and reset terminal
-  if (tcsetattr(fileno(stdin), TCSAFLUSH, &orig_term) < 0) {
+  if (!headless && tcsetattr(fileno(stdin), TCSAFLUSH, &orig_term) < 0) {
     return -1;
   }
 
-  return 0;
+  return result;
 }
@@ -0,0 +1,150 @@
+#include "memory_arena.hpp"
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <sys/mman.h>
+#include <unistd.h>
+
+static ArenaOptions arena_options;
+
+static std::atomic<size_t> mapped_bytes{0};
+static std::atomic<size_t> huge_page_bytes{0};
+static std::atomic<size_t> locked_bytes{0};
+
+// lock failures repeat for every arena, one message is enough
+static std::atomic<bool> lock_failure_reported{false};
+
+static size_t AlignUp(size_t size, size_t alignment) {
+  return (size + alignment - 1) / alignment * alignment;
+}
+
+void SetArenaOptions(ArenaOptions options) {
+  arena_options = options;
+}
+
+ArenaOptions GetArenaOptions() {
+  return arena_options;
+}
+
+size_t ArenaMappedBytes() {
+  return mapped_bytes.load(std::memory_order_relaxed);
+}
+
+size_t ArenaHugePageBytes() {
+  return huge_page_bytes.load(std::memory_order_relaxed);
+}
+
+size_t ArenaLockedBytes() {
+  return locked_bytes.load(std::memory_order_relaxed);
+}
+
+MemoryArena::MemoryArena(size_t size) : size( size ) {
+  if(size == 0) {
+    return;
+  }
+
+  // explicit huge pages only pay off when at least one is filled, MAP_POPULATE
+  // faults them in right away
+  if(arena_options.huge_pages && size >= HUGE_PAGE_SIZE) {
+    size_t length = AlignUp(size, HUGE_PAGE_SIZE);
+    void* mapping = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+
+    if(mapping != MAP_FAILED) {
+      data = (uint8_t*)mapping;
+      mapped_size = length;
+      huge_pages = true;
+    }
+  }
+
+  if(data == nullptr) {
+    size_t length = AlignUp(size, sysconf(_SC_PAGESIZE));
+    void* mapping = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if(mapping == MAP_FAILED) {
+      std::cout << "Error: cannot map " << length << " bytes of frame memory: " << strerror(errno) << std::endl;
+      return;
+    }
+
+    data = (uint8_t*)mapping;
+    mapped_size = length;
+
+    // transparent huge pages need the hint before the first touch
+    if(arena_options.huge_pages) {
+      madvise(data, mapped_size, MADV_HUGEPAGE);
+    }
+
+    Prefault();
+  }
+
+  mapped_bytes.fetch_add(mapped_size, std::memory_order_relaxed);
+  if(huge_pages) {
+    huge_page_bytes.fetch_add(mapped_size, std::memory_order_relaxed);
+  }
+
+  if(arena_options.lock) {
+    Lock();
+  }
+}
+
+MemoryArena::~MemoryArena() {
+  if(data == nullptr) {
+    return;
+  }
+
+  if(locked) {
+    munlock(data, mapped_size);
+    locked_bytes.fetch_sub(mapped_size, std::memory_order_relaxed);
+  }
+  if(huge_pages) {
+    huge_page_bytes.fetch_sub(mapped_size, std::memory_order_relaxed);
+  }
+  mapped_bytes.fetch_sub(mapped_size, std::memory_order_relaxed);
+
+  munmap(data, mapped_size);
+}
+
+void MemoryArena::Prefault() {
+  // one write per page, anonymous memory is zero already
+  size_t page_size = sysconf(_SC_PAGESIZE);
+  for(size_t offset = 0; offset < mapped_size; offset += page_size) {
+    ((volatile uint8_t*)data)[offset] = 0;
+  }
+}
+
+void MemoryArena::Lock() {
+  if(mlock(data, mapped_size) != 0) {
+    if(!lock_failure_reported.exchange(true)) {
+      std::cout << "Error: cannot lock frame memory (" << strerror(errno) << "), raise the memlock limit" << std::endl;
+    }
+    return;
+  }
+
+  locked = true;
+  locked_bytes.fetch_add(mapped_size, std::memory_order_relaxed);
+}
+
+bool MemoryArena::Valid() {
+  return data != nullptr;
+}
+
+uint8_t* MemoryArena::Data() {
+  return data;
+}
+
+size_t MemoryArena::Size() {
+  return size;
+}
+
+size_t MemoryArena::MappedSize() {
+  return mapped_size;
+}
+
+bool MemoryArena::HugePages() {
+  return huge_pages;
+}
+
+bool MemoryArena::Locked() {
+  return locked;
+}
@@ -0,0 +1,93 @@
+#include "metrics.hpp"
+
+#include <cstdio>
+#include <iomanip>
+#include <sstream>
+#include <unistd.h>
+
+size_t ResidentMemory() {
+  // second field of statm is resident pages
+  FILE* statm = fopen("/proc/self/statm", "r");
+  if(statm == NULL) {
+    return 0;
+  }
+
+  unsigned long size = 0;
+  unsigned long resident = 0;
+  int fields = fscanf(statm, "%lu %lu", &size, &resident);
+  fclose(statm);
+
+  if(fields != 2) {
+    return 0;
+  }
+
+  return resident * sysconf(_SC_PAGESIZE);
+}
+
+void MetricsWriter::Counter(std::string name, std::string help, std::string labels, uint64_t value) {
+  GetFamily(name, help, "counter").samples.push_back(Sample(name, labels, std::to_string(value)));
+}
+
+void MetricsWriter::Gauge(std::string name, std::string help, std::string labels, double value) {
+  std::ostringstream text;
+  text << std::setprecision(15) << value;
+  GetFamily(name, help, "gauge").samples.push_back(Sample(name, labels, text.str()));
+}
+
+void MetricsWriter::Summary(std::string name, std::string help, std::string labels, LatencyHistogram& histogram) {
+  Family& family = GetFamily(name, help, "summary");
+  std::string separator = labels.empty() ? "" : ",";
+
+  const double quantiles[] = {0.5, 0.99, 0.999};
+  for(double quantile : quantiles) {
+    std::ostringstream label;
+    label << labels << separator << "quantile=\"" << quantile << "\"";
+
+    std::ostringstream value;
+    value << std::setprecision(15) << histogram.Percentile(quantile) / 1e9;
+    family.samples.push_back(Sample(name, label.str(), value.str()));
+  }
+
+  std::ostringstream sum;
+  sum << std::setprecision(15) << histogram.Sum() / 1e9;
+  family.samples.push_back(Sample(name + "_sum", labels, sum.str()));
+  family.samples.push_back(Sample(name + "_count", labels, std::to_string(histogram.Count())));
+}
+
+std::string MetricsWriter::Text() {
+  std::string text;
+
+  for(Family& family : families) {
+    text += "# HELP " + family.name + " " + family.help + "\n";
+    text += "# TYPE " + family.name + " " + family.type + "\n";
+    for(std::string& sample : family.samples) {
+      text += sample;
+    }
+  }
+
+  return text;
+}
+
+MetricsWriter::Family& MetricsWriter::GetFamily(std::string name, std::string help, std::string type) {
+  for(Family& family : families) {
+    if(family.name == name) {
+      return family;
+    }
+  }
+
+  Family family;
+  family.name = name;
+  family.help = help;
+  family.type = type;
+  families.push_back(family);
+
+  return families.back();
+}
+
+std::string MetricsWriter::Sample(std::string name, std::string labels, std::string value) {
+  if(labels.empty()) {
+    return name + " " + value + "\n";
+  }
+
+  return name + "{" + labels + "} " + value + "\n";
+}
@@ -0,0 +1,113 @@
+#include "metrics_server.hpp"
+
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+MetricsServer::MetricsServer(std::atomic<bool>& run, int port, std::function<std::string()> collect) :
+  run( run ),
+  port( port ),
+  collect( collect ) {}
+
+MetricsServer::~MetricsServer() {
+  Join();
+
+  if(listen_socket >= 0) {
+    close(listen_socket);
+  }
+}
+
+bool MetricsServer::Start() {
+  listen_socket = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if(listen_socket < 0) {
+    std::cout << "Error: cannot create metrics socket: " << strerror(errno) << std::endl;
+    return false;
+  }
+
+  int reuse = 1;
+  setsockopt(listen_socket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+  // only reachable from this host
+  struct sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  if(bind(listen_socket, (struct sockaddr*)&address, sizeof(address)) < 0 || listen(listen_socket, 4) < 0) {
+    std::cout << "Error: cannot serve metrics on port " << port << ": " << strerror(errno) << std::endl;
+    close(listen_socket);
+    listen_socket = -1;
+    return false;
+  }
+
+  thread = std::thread(&MetricsServer::Serve, this);
+  return true;
+}
+
+void MetricsServer::Join() {
+  if(thread.joinable()) {
+    thread.join();
+  }
+}
+
+int MetricsServer::Port() {
+  return port;
+}
+
+void MetricsServer::Serve() {
+  while(run) {
+    struct pollfd listener = {listen_socket, POLLIN, 0};
+    if(poll(&listener, 1, ACCEPT_TIMEOUT) <= 0) {
+      continue;
+    }
+
+    int connection = accept4(listen_socket, NULL, NULL, SOCK_CLOEXEC);
+    if(connection < 0) {
+      continue;
+    }
+
+    Respond(connection);
+    close(connection);
+  }
+}
+
+void MetricsServer::Respond(int connection) {
+  // read request head, its content does not matter
+  std::string request;
+  char buffer[1024];
+  while(request.find("\r\n\r\n") == std::string::npos && request.size() < 8192) {
+    struct pollfd client = {connection, POLLIN, 0};
+    if(poll(&client, 1, REQUEST_TIMEOUT) <= 0) {
+      return;
+    }
+
+    ssize_t received = recv(connection, buffer, sizeof(buffer), 0);
+    if(received <= 0) {
+      return;
+    }
+    request.append(buffer, received);
+  }
+
+  std::string body = collect();
+  std::string response =
+      "HTTP/1.0 200 OK\r\n"
+      "Content-Type: text/plain; version=0.0.4\r\n"
+      "Content-Length: " + std::to_string(body.size()) + "\r\n"
+      "Connection: close\r\n"
+      "\r\n" + body;
+
+  size_t sent = 0;
+  while(sent < response.size()) {
+    ssize_t written = send(connection, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+    if(written <= 0) {
+      return;
+    }
+    sent += written;
+  }
+}
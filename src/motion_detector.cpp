@@ -0,0 +1,151 @@
+#include "motion_detector.hpp"
+
+#include <cstdlib>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MOTION_X86
+#endif
+
+// sum of absolute differences of n pixels, copies them into reference
+static uint32_t BlockDifference(const uint8_t* row, uint8_t* reference, size_t n) {
+  uint32_t sum = 0;
+  for(size_t i = 0; i < n; i++) {
+    sum += abs((int)row[i] - (int)reference[i]);
+    reference[i] = row[i];
+  }
+  return sum;
+}
+
+#ifdef MOTION_X86
+
+__attribute__((target("sse4.1")))
+static size_t CountChangedBlocksSSE41(const uint8_t* row, uint8_t* reference, size_t blocks, uint32_t limit) {
+  size_t changed = 0;
+
+  for(size_t block = 0; block < blocks; block++) {
+    const uint8_t* current = row + block * MotionDetector::BLOCK_PIXELS;
+    uint8_t* previous = reference + block * MotionDetector::BLOCK_PIXELS;
+
+    __m128i current0 = _mm_loadu_si128((const __m128i*)current);
+    __m128i current1 = _mm_loadu_si128((const __m128i*)(current + 16));
+    __m128i sad = _mm_add_epi64(_mm_sad_epu8(current0, _mm_loadu_si128((const __m128i*)previous)),
+        _mm_sad_epu8(current1, _mm_loadu_si128((const __m128i*)(previous + 16))));
+    _mm_storeu_si128((__m128i*)previous, current0);
+    _mm_storeu_si128((__m128i*)(previous + 16), current1);
+
+    uint32_t sum = _mm_cvtsi128_si32(_mm_add_epi64(sad, _mm_unpackhi_epi64(sad, sad)));
+    changed += sum > limit;
+  }
+
+  return changed;
+}
+
+__attribute__((target("avx2")))
+static size_t CountChangedBlocksAVX2(const uint8_t* row, uint8_t* reference, size_t blocks, uint32_t limit) {
+  size_t changed = 0;
+
+  for(size_t block = 0; block < blocks; block++) {
+    const uint8_t* current = row + block * MotionDetector::BLOCK_PIXELS;
+    uint8_t* previous = reference + block * MotionDetector::BLOCK_PIXELS;
+
+    __m256i pixels = _mm256_loadu_si256((const __m256i*)current);
+    __m256i sad = _mm256_sad_epu8(pixels, _mm256_loadu_si256((const __m256i*)previous));
+    _mm256_storeu_si256((__m256i*)previous, pixels);
+
+    // four partial sums of 8 pixels each
+    __m128i half = _mm_add_epi64(_mm256_castsi256_si128(sad), _mm256_extracti128_si256(sad, 1));
+    uint32_t sum = _mm_cvtsi128_si32(_mm_add_epi64(half, _mm_unpackhi_epi64(half, half)));
+    changed += sum > limit;
+  }
+
+  return changed;
+}
+
+#endif
+
+size_t CountChangedBlocks(const uint8_t* row, uint8_t* reference, size_t width, int sensitivity, SimdLevel simd) {
+  const size_t block_pixels = MotionDetector::BLOCK_PIXELS;
+  size_t blocks = width / block_pixels;
+  uint32_t limit = sensitivity * block_pixels;
+  size_t changed = 0;
+
+#ifdef MOTION_X86
+  if(simd == SimdLevel::AVX2) {
+    changed = CountChangedBlocksAVX2(row, reference, blocks, limit);
+  }
+  else if(simd == SimdLevel::SSE41) {
+    changed = CountChangedBlocksSSE41(row, reference, blocks, limit);
+  }
+  else
+#endif
+  {
+    for(size_t block = 0; block < blocks; block++) {
+      changed += BlockDifference(row + block * block_pixels, reference + block * block_pixels, block_pixels) > limit;
+    }
+  }
+
+  // a partial block at the end is judged on its own pixels
+  size_t rest = width - blocks * block_pixels;
+  if(rest > 0) {
+    changed += BlockDifference(row + blocks * block_pixels, reference + blocks * block_pixels, rest) > sensitivity * rest;
+  }
+
+  return changed;
+}
+
+MotionDetector::MotionDetector(int sensitivity, size_t row_step, SimdLevel simd) :
+  sensitivity( sensitivity > 0 ? sensitivity : DEFAULT_SENSITIVITY ),
+  row_step( row_step > 0 ? row_step : DEFAULT_ROW_STEP ),
+  simd( simd ) {}
+
+void MotionDetector::Reset() {
+  reference.clear();
+}
+
+SimdLevel MotionDetector::Simd() {
+  return simd;
+}
+
+float MotionDetector::Score(const Frame& frame) {
+  size_t bytes_per_pixel = BytesPerPixel(frame.pixel_format);
+  if(frame.data == nullptr || frame.width == 0 || frame.height == 0 || bytes_per_pixel == 0) {
+    return -1;
+  }
+
+  // 16-bit pixels are narrowed to one byte, BGR compares every channel byte
+  size_t row_bytes = bytes_per_pixel == 2 ? frame.width : frame.width * bytes_per_pixel;
+  size_t rows = (frame.height + row_step - 1) / row_step;
+
+  // a new format has nothing to compare against, its rows become the reference
+  bool fresh = reference.empty() || frame.width != width || frame.height != height || frame.pixel_format != pixel_format;
+  if(fresh) {
+    reference.assign(rows * row_bytes, 0);
+    width = frame.width;
+    height = frame.height;
+    pixel_format = frame.pixel_format;
+  }
+
+  size_t changed = 0;
+  for(size_t i = 0; i < rows; i++) {
+    const uint8_t* row = frame.data + i * row_step * frame.stride;
+
+    // most significant byte of little endian pixels
+    if(bytes_per_pixel == 2) {
+      narrowed.resize(frame.width);
+      for(size_t x = 0; x < frame.width; x++) {
+        narrowed[x] = row[2 * x + 1];
+      }
+      row = narrowed.data();
+    }
+
+    changed += CountChangedBlocks(row, reference.data() + i * row_bytes, row_bytes, sensitivity, simd);
+  }
+
+  if(fresh) {
+    return -1;
+  }
+
+  size_t blocks_per_row = (row_bytes + BLOCK_PIXELS - 1) / BLOCK_PIXELS;
+  return 100.0f * changed / (rows * blocks_per_row);
+}
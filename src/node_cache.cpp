@@ -0,0 +1,20 @@
+#include "node_cache.hpp"
+
+Spinnaker::GenApi::INode* NodeCache::Get(Spinnaker::GenApi::INodeMap* map, std::string name) {
+  std::lock_guard<std::mutex> lock(mutex);
+
+  auto key = std::make_pair(map, name);
+  auto it = nodes.find(key);
+  if(it != nodes.end()) {
+    return it->second;
+  }
+
+  Spinnaker::GenApi::INode* node = map->GetNode(name.c_str());
+  nodes[key] = node;
+  return node;
+}
+
+void NodeCache::Clear() {
+  std::lock_guard<std::mutex> lock(mutex);
+  nodes.clear();
+}
@@ -0,0 +1,101 @@
+#include "notifier.hpp"
+
+#include <climits>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include "clock.hpp"
+#include "platform.hpp"
+
+uint32_t Notifier::Prepare() {
+  return epoch.load(std::memory_order_seq_cst);
+}
+
+bool Notifier::Wait(uint32_t epoch, int64_t timeout_us) {
+  if(Spin(epoch)) {
+    // event arrived while spinning, spin a little longer next time
+    int limit = spin_limit.load(std::memory_order_relaxed);
+    if(limit < SPIN_MAX) {
+      spin_limit.store(limit * 2 > SPIN_MAX ? SPIN_MAX : limit * 2, std::memory_order_relaxed);
+    }
+    return true;
+  }
+
+  // spinning was wasted, spin less next time
+  int limit = spin_limit.load(std::memory_order_relaxed);
+  if(limit > SPIN_MIN) {
+    spin_limit.store(limit / 2 < SPIN_MIN ? SPIN_MIN : limit / 2, std::memory_order_relaxed);
+  }
+
+  return Park(epoch, timeout_us);
+}
+
+bool Notifier::Spin(uint32_t epoch) {
+  int limit = spin_limit.load(std::memory_order_relaxed);
+
+  for(int i = 0; i < limit; i++) {
+    if(this->epoch.load(std::memory_order_acquire) != epoch) {
+      return true;
+    }
+    CpuRelax();
+  }
+
+  return false;
+}
+
+bool Notifier::Park(uint32_t epoch, int64_t timeout_us) {
+  uint64_t deadline = timeout_us < 0 ? 0 : MonotonicNow() + (uint64_t)timeout_us * 1000;
+  bool notified = false;
+
+  waiters.fetch_add(1, std::memory_order_seq_cst);
+
+  while(true) {
+    if(this->epoch.load(std::memory_order_seq_cst) != epoch) {
+      notified = true;
+      break;
+    }
+
+    struct timespec timeout;
+    struct timespec* timeout_ptr = NULL;
+
+    if(timeout_us >= 0) {
+      uint64_t now = MonotonicNow();
+      if(now >= deadline) {
+        break;
+      }
+
+      uint64_t remaining = deadline - now;
+      timeout.tv_sec = remaining / 1000000000ULL;
+      timeout.tv_nsec = remaining % 1000000000ULL;
+      timeout_ptr = &timeout;
+    }
+
+    // returns right away if epoch already moved on
+    syscall(SYS_futex, &this->epoch, FUTEX_WAIT_PRIVATE, epoch, timeout_ptr, NULL, 0);
+  }
+
+  waiters.fetch_sub(1, std::memory_order_relaxed);
+
+  return notified;
+}
+
+void Notifier::Notify() {
+  epoch.fetch_add(1, std::memory_order_seq_cst);
+
+  if(waiters.load(std::memory_order_seq_cst) > 0) {
+    Wake(1);
+  }
+}
+
+void Notifier::NotifyAll() {
+  epoch.fetch_add(1, std::memory_order_seq_cst);
+
+  if(waiters.load(std::memory_order_seq_cst) > 0) {
+    Wake(INT_MAX);
+  }
+}
+
+void Notifier::Wake(int count) {
+  syscall(SYS_futex, &epoch, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+}
@@ -0,0 +1,310 @@
+#include "pipeline.hpp"
+
+#include <iostream>
+#include <set>
+#include "clock.hpp"
+
+const char* FrameKindName(FrameKind kind) {
+  switch(kind) {
+    case FrameKind::Raw: return "raw";
+    case FrameKind::Converted: return "converted";
+  }
+  return "unknown";
+}
+
+Stage::~Stage() {}
+
+FrameKind Stage::Produces(FrameKind input) {
+  return input;
+}
+
+void Stage::PrintStats(std::ostream& out) {}
+
+void Stage::WriteMetrics(MetricsWriter& metrics, std::string labels) {}
+
+void Stage::AddOutput(FrameQueue<FramePtr>* output) {
+  outputs.push_back(output);
+}
+
+uint64_t Stage::Processed() {
+  return processed.load();
+}
+
+LatencyHistogram& Stage::ProcessLatency() {
+  return process_latency;
+}
+
+void Stage::Emit(const FramePtr& frame) {
+  for(FrameQueue<FramePtr>* output : outputs) {
+    output->Push(frame);
+  }
+}
+
+WorkerStage::WorkerStage(std::atomic<bool>& run, int workers) :
+  run( run ),
+  workers( workers > 0 ? workers : 1 ) {}
+
+WorkerStage::~WorkerStage() {
+  Join();
+}
+
+void WorkerStage::Start(FrameQueue<FramePtr>& input) {
+  for(int i = 0; i < workers; i++) {
+    threads.push_back(std::thread(&WorkerStage::Work, this, std::ref(input)));
+  }
+}
+
+void WorkerStage::Join() {
+  for(std::thread& thread : threads) {
+    if(thread.joinable()) {
+      thread.join();
+    }
+  }
+}
+
+int WorkerStage::Workers() {
+  return workers;
+}
+
+void WorkerStage::Work(FrameQueue<FramePtr>& input) {
+  while(run) {
+    FramePtr frame;
+    if(!input.WaitPop(frame, QUEUE_WAIT_TIMEOUT)) {
+      if(input.IsClosed()) {
+        break;
+      }
+      continue;
+    }
+
+    uint64_t start = MonotonicNow();
+    FramePtr result = Process(frame);
+    process_latency.Record(MonotonicNow() - start);
+    processed++;
+
+    if(result) {
+      Emit(result);
+    }
+  }
+}
+
+CallbackStage::CallbackStage(std::atomic<bool>& run, int workers, FrameKind kind, Callback callback) :
+  WorkerStage( run, workers ),
+  kind( kind ),
+  callback( callback ) {}
+
+bool CallbackStage::Accepts(FrameKind kind) {
+  return kind == this->kind;
+}
+
+FramePtr CallbackStage::Process(const FramePtr& frame) {
+  callback(frame);
+  return frame;
+}
+
+Pipeline::Pipeline(std::atomic<bool>& run, FrameSource* source, FrameQueue<FramePtr>& source_queue) :
+  run( run ),
+  source( source ),
+  source_queue( source_queue ) {}
+
+Pipeline::~Pipeline() {
+  Close();
+  Join();
+}
+
+std::map<std::string, StageFactory>& Pipeline::Registry() {
+  static std::map<std::string, StageFactory> registry;
+  return registry;
+}
+
+void Pipeline::RegisterStage(std::string type, StageFactory factory) {
+  Registry()[type] = factory;
+}
+
+bool Pipeline::Build(const PipelineConfig& config) {
+  std::set<std::string> names;
+  for(const StageConfig& stage : config.stages) {
+    if(stage.name == "source" || !names.insert(stage.name).second) {
+      std::cout << "Error: stage name " << stage.name << " is used twice or reserved" << std::endl;
+      return false;
+    }
+
+    if(Registry().find(stage.type) == Registry().end()) {
+      std::cout << "Error: stage " << stage.name << " has unknown type " << stage.type << std::endl;
+      return false;
+    }
+  }
+
+  // place stages once their input is placed, what is left has an unknown input or a cycle
+  std::map<std::string, FrameKind> kinds;
+  kinds["source"] = FrameKind::Raw;
+
+  std::vector<const StageConfig*> pending;
+  for(const StageConfig& stage : config.stages) {
+    pending.push_back(&stage);
+  }
+
+  StageContext context = { run, source, source->Serial() };
+
+  while(!pending.empty()) {
+    bool placed = false;
+
+    for(auto it = pending.begin(); it != pending.end(); ) {
+      const StageConfig& stage_config = **it;
+      if(kinds.find(stage_config.input) == kinds.end()) {
+        ++it;
+        continue;
+      }
+
+      Stage* stage = Registry()[stage_config.type](stage_config, context);
+      if(stage == NULL) {
+        return false;
+      }
+
+      FrameKind input_kind = kinds[stage_config.input];
+      if(!stage->Accepts(input_kind)) {
+        std::cout << "Error: stage " << stage_config.name << " cannot take " << FrameKindName(input_kind) <<
+            " frames from " << stage_config.input << std::endl;
+        delete stage;
+        return false;
+      }
+      kinds[stage_config.name] = stage->Produces(input_kind);
+
+      std::unique_ptr<Node> node(new Node());
+      node->config = stage_config;
+      node->stage.reset(stage);
+      nodes.push_back(std::move(node));
+
+      it = pending.erase(it);
+      placed = true;
+    }
+
+    if(!placed) {
+      std::cout << "Error: stage " << pending.front()->name << " has unknown input " <<
+          pending.front()->input << " or is part of a cycle" << std::endl;
+      return false;
+    }
+  }
+
+  // a single consumer of the capture queue saves a hop
+  size_t source_consumers = 0;
+  for(std::unique_ptr<Node>& node : nodes) {
+    if(node->config.input == "source") {
+      source_consumers++;
+    }
+  }
+
+  for(std::unique_ptr<Node>& node : nodes) {
+    if(node->config.input == "source" && source_consumers == 1) {
+      node->input = &source_queue;
+      continue;
+    }
+
+    node->channel.reset(new FrameQueue<FramePtr>(node->config.queue_size, node->config.policy));
+    node->input = node->channel.get();
+
+    // frames wait here rather than in the capture queue, shedding has to see them
+    if(node->config.input == "source") {
+      source_outputs.push_back(node->input);
+      source->Shedder().Watch(node->input);
+    }
+    else {
+      for(std::unique_ptr<Node>& producer : nodes) {
+        if(producer->config.name == node->config.input) {
+          producer->stage->AddOutput(node->input);
+        }
+      }
+    }
+  }
+
+  return true;
+}
+
+void Pipeline::Start() {
+  // consumers first so nothing is pushed into a channel nobody drains
+  for(auto it = nodes.rbegin(); it != nodes.rend(); ++it) {
+    (*it)->stage->Start(*(*it)->input);
+  }
+
+  if(!source_outputs.empty()) {
+    fan_out = std::thread(&Pipeline::FanOut, this);
+  }
+}
+
+void Pipeline::FanOut() {
+  while(run) {
+    FramePtr frame;
+    if(!source_queue.WaitPop(frame, QUEUE_WAIT_TIMEOUT)) {
+      continue;
+    }
+
+    for(FrameQueue<FramePtr>* output : source_outputs) {
+      output->Push(frame);
+    }
+  }
+}
+
+void Pipeline::Close() {
+  for(std::unique_ptr<Node>& node : nodes) {
+    if(node->channel) {
+      node->channel->Close();
+    }
+  }
+}
+
+void Pipeline::Join() {
+  if(fan_out.joinable()) {
+    fan_out.join();
+  }
+
+  for(std::unique_ptr<Node>& node : nodes) {
+    node->stage->Join();
+
+    // frames nobody will process any more, lent ones go back to the camera
+    FramePtr frame;
+    while(node->channel && node->channel->Pop(frame)) {
+      frame.reset();
+    }
+  }
+}
+
+std::vector<Stage*> Pipeline::Stages(std::string type) {
+  std::vector<Stage*> stages;
+  for(std::unique_ptr<Node>& node : nodes) {
+    if(node->config.type == type) {
+      stages.push_back(node->stage.get());
+    }
+  }
+  return stages;
+}
+
+void Pipeline::PrintStats(std::ostream& out) {
+  for(std::unique_ptr<Node>& node : nodes) {
+    Stage* stage = node->stage.get();
+    FrameQueue<FramePtr>& input = *node->input;
+
+    out << "stage " << node->config.name << " (" << node->config.type << ")" <<
+        ", workers: " << stage->Workers() <<
+        ", processed: " << stage->Processed() <<
+        ", queue: " << input.Size() << "/" << input.Capacity() <<
+        ", dropped: " << input.Dropped() <<
+        ", process p50/p99 us: " << stage->ProcessLatency().Percentile(0.5) / 1000 <<
+        "/" << stage->ProcessLatency().Percentile(0.99) / 1000 << std::endl;
+
+    stage->PrintStats(out);
+  }
+}
+
+void Pipeline::WriteMetrics(MetricsWriter& metrics, std::string labels) {
+  for(std::unique_ptr<Node>& node : nodes) {
+    Stage* stage = node->stage.get();
+    FrameQueue<FramePtr>& input = *node->input;
+    std::string stage_labels = labels + ",stage=\"" + node->config.name + "\"";
+
+    metrics.Counter("pipeline_stage_frames_total", "Frames processed by the stage.", stage_labels, stage->Processed());
+    metrics.Gauge("pipeline_stage_queue_depth", "Frames waiting in the stage input channel.", stage_labels, input.Size());
+    metrics.Counter("pipeline_stage_queue_dropped_total", "Frames dropped by the stage input channel overflow policy.", stage_labels, input.Dropped());
+    metrics.Summary("pipeline_stage_process_seconds", "Time the stage spends on one frame.", stage_labels, stage->ProcessLatency());
+
+    stage->WriteMetrics(metrics, labels);
+  }
+}
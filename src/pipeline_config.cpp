@@ -0,0 +1,126 @@
+#include "pipeline_config.hpp"
+
+#include <cerrno>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+
+std::string StageConfig::Option(std::string key, std::string fallback) const {
+  auto it = options.find(key);
+  return it == options.end() ? fallback : it->second;
+}
+
+static std::string Trim(std::string text) {
+  size_t begin = text.find_first_not_of(" \t\r");
+  if(begin == std::string::npos) {
+    return "";
+  }
+
+  size_t end = text.find_last_not_of(" \t\r");
+  return text.substr(begin, end - begin + 1);
+}
+
+bool ParseCount(const std::string& text, size_t minimum, size_t maximum, size_t& count) {
+  if(text.empty() || text[0] < '0' || text[0] > '9') {
+    return false;
+  }
+
+  char* end = NULL;
+  errno = 0;
+  unsigned long long value = strtoull(text.c_str(), &end, 10);
+  if(errno != 0 || *end != '\0' || value < minimum || value > maximum) {
+    return false;
+  }
+
+  count = value;
+  return true;
+}
+
+bool ParseOverflowPolicy(std::string name, OverflowPolicy& policy) {
+  if(name == "block") {
+    policy = OverflowPolicy::Block;
+  }
+  else if(name == "drop_oldest") {
+    policy = OverflowPolicy::DropOldest;
+  }
+  else if(name == "drop_newest") {
+    policy = OverflowPolicy::DropNewest;
+  }
+  else {
+    return false;
+  }
+
+  return true;
+}
+
+bool LoadPipelineConfig(std::string path, PipelineConfig& config) {
+  std::ifstream file(path);
+  if(!file) {
+    std::cout << "Error: cannot open pipeline config " << path << std::endl;
+    return false;
+  }
+
+  config.stages.clear();
+
+  std::string line;
+  int line_number = 0;
+
+  while(std::getline(file, line)) {
+    line_number++;
+    line = Trim(line.substr(0, line.find('#')));
+
+    if(line.empty()) {
+      continue;
+    }
+
+    if(line.front() == '[' && line.back() == ']') {
+      StageConfig stage;
+      stage.name = Trim(line.substr(1, line.size() - 2));
+      stage.type = stage.name;
+      config.stages.push_back(stage);
+      continue;
+    }
+
+    size_t separator = line.find('=');
+    if(separator == std::string::npos || config.stages.empty()) {
+      std::cout << "Error: " << path << ":" << line_number << ": expected [stage] or key = value" << std::endl;
+      return false;
+    }
+
+    StageConfig& stage = config.stages.back();
+    std::string key = Trim(line.substr(0, separator));
+    std::string value = Trim(line.substr(separator + 1));
+
+    if(key == "type") {
+      stage.type = value;
+    }
+    else if(key == "input") {
+      stage.input = value;
+    }
+    else if(key == "workers") {
+      size_t workers;
+      if(!ParseCount(value, 1, MAX_STAGE_WORKERS, workers)) {
+        std::cout << "Error: " << path << ":" << line_number << ": workers must be from 1 to " << MAX_STAGE_WORKERS << std::endl;
+        return false;
+      }
+      stage.workers = workers;
+    }
+    else if(key == "queue") {
+      if(!ParseCount(value, 1, MAX_STAGE_QUEUE_SIZE, stage.queue_size)) {
+        std::cout << "Error: " << path << ":" << line_number << ": queue must be from 1 to " << MAX_STAGE_QUEUE_SIZE << std::endl;
+        return false;
+      }
+    }
+    else if(key == "policy") {
+      if(!ParseOverflowPolicy(value, stage.policy)) {
+        std::cout << "Error: " << path << ":" << line_number << ": unknown policy " << value << std::endl;
+        return false;
+      }
+    }
+    else {
+      stage.options[key] = value;
+    }
+  }
+
+  return true;
+}
@@ -0,0 +1,563 @@
+#include "pipeline_stages.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <sstream>
+#include "clock.hpp"
+
+ConvertStage::ConvertStage(std::atomic<bool>& run, int workers, DemosaicMethod method) :
+  run( run ),
+  workers( workers ),
+  method( method ) {}
+
+ConvertStage::~ConvertStage() {
+  Join();
+}
+
+bool ConvertStage::Accepts(FrameKind kind) {
+  return kind == FrameKind::Raw;
+}
+
+FrameKind ConvertStage::Produces(FrameKind input) {
+  return FrameKind::Converted;
+}
+
+void ConvertStage::Start(FrameQueue<FramePtr>& input) {
+  pool.reset(new ConversionPool(run, input, workers, method));
+  pool->AddSink([this](const FramePtr& frame, const FramePtr& converted) {
+    processed++;
+    if(frame->convert_time >= frame->dequeue_time) {
+      process_latency.Record(frame->convert_time - frame->dequeue_time);
+    }
+
+    if(converted) {
+      Emit(converted);
+    }
+  });
+  pool->Start();
+}
+
+void ConvertStage::Join() {
+  if(pool) {
+    pool->Join();
+  }
+}
+
+int ConvertStage::Workers() {
+  return pool ? pool->Workers() : workers;
+}
+
+void ConvertStage::PrintStats(std::ostream& out) {
+  if(!pool) {
+    return;
+  }
+
+  out << "conversion fps: " << pool->FPS() <<
+      ", workers: " << pool->Workers() <<
+      ", in flight: " << pool->InFlight() <<
+      ", converted: " << pool->Converted() <<
+      ", failed: " << pool->Failed() <<
+      ", stolen: " << pool->Stolen() <<
+      ", total latency p50/p99/p999 us: " << pool->TotalLatency().Percentile(0.5) / 1000 <<
+      "/" << pool->TotalLatency().Percentile(0.99) / 1000 <<
+      "/" << pool->TotalLatency().Percentile(0.999) / 1000 << std::endl;
+}
+
+void ConvertStage::WriteMetrics(MetricsWriter& metrics, std::string labels) {
+  if(pool) {
+    pool->WriteMetrics(metrics, labels);
+  }
+}
+
+RecordStage::RecordStage(std::atomic<bool>& run, std::string path, std::string camera) :
+  WorkerStage( run, 1 ),
+  recorder( path, camera ) {}
+
+bool RecordStage::Accepts(FrameKind kind) {
+  return kind == FrameKind::Raw;
+}
+
+void RecordStage::Start(FrameQueue<FramePtr>& input) {
+  // capture goes on without a recording when the file cannot be created
+  if(recorder.Start()) {
+    WorkerStage::Start(input);
+  }
+}
+
+void RecordStage::Join() {
+  WorkerStage::Join();
+  recorder.Stop();
+}
+
+void RecordStage::SetPaused(bool paused) {
+  this->paused = paused;
+}
+
+bool RecordStage::Paused() {
+  return paused;
+}
+
+FramePtr RecordStage::Process(const FramePtr& frame) {
+  if(!paused) {
+    recorder.Record(frame);
+  }
+  return frame;
+}
+
+void RecordStage::PrintStats(std::ostream& out) {
+  out << "recording " << recorder.Path() <<
+      ", frames: " << recorder.Recorded() <<
+      ", dropped: " << recorder.Dropped() <<
+      ", MB written: " << recorder.BytesWritten() / (1024 * 1024) <<
+      ", direct io: " << recorder.DirectIO() <<
+      (recorder.Failed() ? ", failed" : "") <<
+      (paused ? ", paused" : "") << std::endl;
+}
+
+void RecordStage::WriteMetrics(MetricsWriter& metrics, std::string labels) {
+  recorder.WriteMetrics(metrics, labels);
+}
+
+PublishStage::PublishStage(std::atomic<bool>& run, std::string name, std::string camera, size_t slots) :
+  WorkerStage( run, 1 ),
+  publisher( name, camera, slots ) {}
+
+bool PublishStage::Accepts(FrameKind kind) {
+  return true;
+}
+
+FramePtr PublishStage::Process(const FramePtr& frame) {
+  publisher.Publish(*frame);
+  return frame;
+}
+
+void PublishStage::PrintStats(std::ostream& out) {
+  out << "publishing " << publisher.Name() <<
+      ", frames: " << publisher.Published() <<
+      ", failed: " << publisher.Failed() <<
+      ", replaced: " << publisher.Replaced() <<
+      ", MB mapped: " << publisher.SegmentSize() / (1024 * 1024) << std::endl;
+}
+
+void PublishStage::WriteMetrics(MetricsWriter& metrics, std::string labels) {
+  metrics.Counter("capture_shm_published_frames_total", "Frames published to shared memory.", labels, publisher.Published());
+  metrics.Counter("capture_shm_failed_frames_total", "Frames which could not be published to shared memory.", labels, publisher.Failed());
+  metrics.Counter("capture_shm_replaced_total", "Times the shared memory segment was recreated for larger frames.", labels, publisher.Replaced());
+  metrics.Gauge("capture_shm_segment_bytes", "Size of the shared memory segment.", labels, publisher.SegmentSize());
+}
+
+MotionStage::MotionStage(std::atomic<bool>& run, MotionConfig config) :
+  WorkerStage( run, 1 ),
+  config( config ),
+  detector( config.sensitivity, config.row_step ),
+  // copies emitted before an event may still be downstream while the next pre-roll fills
+  pre_roll_pool( config.pre_roll * 2 ) {}
+
+bool MotionStage::Accepts(FrameKind kind) {
+  return kind == FrameKind::Raw;
+}
+
+void MotionStage::Join() {
+  WorkerStage::Join();
+
+  // held frames go back to their pool or the camera
+  pre_roll.clear();
+}
+
+FramePtr MotionStage::Process(const FramePtr& input) {
+  // stages fed from the same channel hold input as well
+  FramePtr frame = AnnotatedFrame(input);
+  frame->motion_score = detector.Score(*frame);
+  last_score = frame->motion_score;
+
+  if(frame->motion_score >= config.threshold) {
+    if(post_roll_left == 0) {
+      events++;
+    }
+    post_roll_left = config.post_roll + 1;
+
+    // the moments before the event go out ahead of it, in order
+    for(FramePtr& held : pre_roll) {
+      Emit(held);
+      passed++;
+    }
+    pre_roll.clear();
+  }
+
+  if(post_roll_left > 0) {
+    post_roll_left--;
+    passed++;
+    return frame;
+  }
+
+  if(!config.drop) {
+    frame->still = true;
+    passed++;
+    marked++;
+    return frame;
+  }
+
+  if(config.pre_roll == 0) {
+    discarded++;
+    return FramePtr();
+  }
+
+  FramePtr held = Hold(frame);
+  if(!held) {
+    discarded++;
+    return FramePtr();
+  }
+
+  pre_roll.push_back(held);
+  if(pre_roll.size() > config.pre_roll) {
+    pre_roll.pop_front();
+    discarded++;
+  }
+
+  return FramePtr();
+}
+
+FramePtr MotionStage::Hold(const FramePtr& frame) {
+  if(!frame->zero_copy) {
+    return frame;
+  }
+
+  FramePtr copy;
+
+  if(pre_roll_pool.Reserve(frame->size)) {
+    copy = pre_roll_pool.Acquire();
+  }
+
+  if(copy) {
+    uint8_t* data = copy->data;
+    memcpy(data, frame->data, frame->size);
+    *copy = *frame;
+    copy->data = data;
+    copy->zero_copy = false;
+  }
+
+  return copy;
+}
+
+void MotionStage::PrintStats(std::ostream& out) {
+  out << "motion events: " << events.load() <<
+      ", passed: " << passed.load() <<
+      ", discarded: " << discarded.load() <<
+      ", marked still: " << marked.load() <<
+      ", last score: " << last_score.load() << "%" <<
+      ", simd: " << SimdLevelName(detector.Simd()) << std::endl;
+}
+
+void MotionStage::WriteMetrics(MetricsWriter& metrics, std::string labels) {
+  metrics.Counter("pipeline_motion_events_total", "Motion events, each counted when a still scene starts moving.", labels, events.load());
+  metrics.Counter("pipeline_motion_passed_frames_total", "Frames the motion gate passed on.", labels, passed.load());
+  metrics.Counter("pipeline_motion_discarded_frames_total", "Still frames the motion gate gave up.", labels, discarded.load());
+  metrics.Counter("pipeline_motion_marked_frames_total", "Still frames the motion gate passed on marked still.", labels, marked.load());
+  metrics.Gauge("pipeline_motion_score_percent", "Changed share of the last scored frame.", labels, last_score.load());
+}
+
+StatsStage::StatsStage(std::atomic<bool>& run, int workers, size_t step, int bits) :
+  WorkerStage( run, workers ),
+  step( step ),
+  bits( bits ) {}
+
+bool StatsStage::Accepts(FrameKind kind) {
+  return kind == FrameKind::Raw;
+}
+
+FramePtr StatsStage::Process(const FramePtr& input) {
+  ImageHistogram histogram;
+  ImageStats stats;
+  if(!ComputeImageStats(*input, step, bits, stats, &histogram)) {
+    unsupported++;
+    return input;
+  }
+
+  // record, publish and preview fed from the same channel may read input meanwhile
+  FramePtr frame = AnnotatedFrame(input);
+  frame->stats = stats;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  last_stats = frame->stats;
+  last_histogram = histogram;
+  return frame;
+}
+
+void StatsStage::PrintStats(std::ostream& out) {
+  std::lock_guard<std::mutex> lock(mutex);
+
+  out << "image";
+  for(size_t channel = 0; channel < last_stats.channels; channel++) {
+    out << (channel == 0 ? " " : ", ") << ImageChannelName(last_stats.channels, channel) <<
+        " mean/under/over: " << last_stats.mean[channel] <<
+        "/" << last_stats.under[channel] << "%" <<
+        "/" << last_stats.over[channel] << "%";
+  }
+  out << (last_stats.valid ? "" : " no statistics") <<
+      ", unsupported frames: " << unsupported.load() << std::endl;
+}
+
+void StatsStage::WriteMetrics(MetricsWriter& metrics, std::string labels) {
+  std::lock_guard<std::mutex> lock(mutex);
+
+  metrics.Counter("pipeline_image_unsupported_frames_total", "Frames in a format image statistics cannot be computed for.", labels, unsupported.load());
+
+  for(size_t channel = 0; channel < last_stats.channels; channel++) {
+    std::string channel_labels = labels + ",channel=\"" + ImageChannelName(last_stats.channels, channel) + "\"";
+
+    metrics.Gauge("pipeline_image_mean", "Mean pixel value of the last frame on a 0-255 scale.", channel_labels, last_stats.mean[channel]);
+    metrics.Gauge("pipeline_image_underexposed_percent", "Share of pixels of the last frame in the lowest 1/256 of the range.", channel_labels, last_stats.under[channel]);
+    metrics.Gauge("pipeline_image_overexposed_percent", "Share of pixels of the last frame in the highest 1/256 of the range.", channel_labels, last_stats.over[channel]);
+
+    uint64_t samples = last_histogram.samples[channel];
+    size_t bins_per_bucket = 256 / METRIC_BUCKETS;
+    for(size_t bucket = 0; bucket < METRIC_BUCKETS && samples > 0; bucket++) {
+      uint64_t count = 0;
+      for(size_t bin = bucket * bins_per_bucket; bin < (bucket + 1) * bins_per_bucket; bin++) {
+        count += last_histogram.bins[channel][bin];
+      }
+
+      metrics.Gauge("pipeline_image_histogram_percent", "Share of pixels of the last frame per sixteenth of the range.",
+          channel_labels + ",bucket=\"" + std::to_string(bucket) + "\"", 100.0 * count / samples);
+    }
+  }
+}
+
+PreviewStage::PreviewStage(std::atomic<bool>& run, std::vector<size_t> scales, double fps) :
+  WorkerStage( run, 1 ),
+  interval( fps > 0 ? 1e9 / fps : 0 ) {
+  size_t smallest = *std::max_element(scales.begin(), scales.end());
+  for(size_t scale = 2; scale <= smallest; scale *= 2) {
+    Level level;
+    level.scale = scale;
+    level.emit = std::find(scales.begin(), scales.end(), scale) != scales.end();
+    if(level.emit) {
+      level.pool.reset(new FramePool(POOL_FRAMES));
+    }
+    levels.push_back(std::move(level));
+  }
+}
+
+bool PreviewStage::Accepts(FrameKind kind) {
+  return kind == FrameKind::Raw;
+}
+
+FrameKind PreviewStage::Produces(FrameKind input) {
+  return FrameKind::Converted;
+}
+
+FramePtr PreviewStage::Process(const FramePtr& frame) {
+  uint64_t now = MonotonicNow();
+  if(interval > 0 && last_preview != 0 && now - last_preview < interval) {
+    rate_limited++;
+    return FramePtr();
+  }
+  last_preview = now;
+
+  std::vector<FramePtr> images;
+  const uint8_t* above = nullptr;
+  size_t above_width = 0;
+  size_t above_height = 0;
+
+  for(Level& level : levels) {
+    size_t width = frame->width / level.scale;
+    size_t height = frame->height / level.scale;
+    size_t stride = width * BytesPerPixel(PixelFormat::BGR8);
+    if(width == 0 || height == 0) {
+      break;
+    }
+
+    FramePtr image;
+    uint8_t* output;
+    if(level.emit) {
+      if(level.pool->Reserve(stride * height)) {
+        image = level.pool->Acquire();
+      }
+      if(!image) {
+        unavailable++;
+        return FramePtr();
+      }
+      output = image->data;
+    }
+    else {
+      level.scratch.resize(stride * height);
+      output = level.scratch.data();
+    }
+
+    if(above == nullptr) {
+      if(!scaler.Bin(*frame, output, stride)) {
+        unsupported++;
+        return FramePtr();
+      }
+    }
+    else {
+      scaler.Halve(above, above_width, above_height, above_width * BytesPerPixel(PixelFormat::BGR8), output, stride);
+    }
+
+    if(image) {
+      image->width = width;
+      image->height = height;
+      image->stride = stride;
+      image->size = stride * height;
+      image->pixel_format = PixelFormat::BGR8;
+      CopyFrameMetadata(*frame, *image);
+      images.push_back(image);
+    }
+
+    above = output;
+    above_width = width;
+    above_height = height;
+  }
+
+  if(images.empty()) {
+    return FramePtr();
+  }
+
+  for(size_t i = 0; i + 1 < images.size(); i++) {
+    Emit(images[i]);
+  }
+  previews++;
+  return images.back();
+}
+
+void PreviewStage::PrintStats(std::ostream& out) {
+  out << "previews: " << previews.load() <<
+      ", rate limited: " << rate_limited.load() <<
+      ", no free buffer: " << unavailable.load() <<
+      ", unsupported: " << unsupported.load() <<
+      ", simd: " << SimdLevelName(scaler.Simd()) << std::endl;
+}
+
+void PreviewStage::WriteMetrics(MetricsWriter& metrics, std::string labels) {
+  metrics.Counter("pipeline_preview_frames_total", "Frames previews were made of.", labels, previews.load());
+  metrics.Counter("pipeline_preview_rate_limited_total", "Frames passed over to keep the preview rate.", labels, rate_limited.load());
+  metrics.Counter("pipeline_preview_unavailable_total", "Previews left out while consumers held every preview buffer.", labels, unavailable.load());
+  metrics.Counter("pipeline_preview_unsupported_frames_total", "Frames in a format previews cannot be made of.", labels, unsupported.load());
+}
+
+std::string RecordingPath(std::string directory, std::string serial) {
+  char started[32];
+  std::time_t now = std::time(0);
+  std::strftime(started, sizeof(started), "%Y%m%d-%H%M%S", std::localtime(&now));
+
+  return directory + "/" + (serial.empty() ? std::string("camera") : serial) + "_" + started + ".rec";
+}
+
+std::string PublishName(std::string serial) {
+  return std::string(SHM_NAME_PREFIX) + (serial.empty() ? std::string("camera") : serial);
+}
+
+bool ParseMotionConfig(const StageConfig& stage, MotionConfig& config) {
+  config.threshold = atof(stage.Option("threshold", std::to_string(config.threshold)).c_str());
+
+  size_t sensitivity = config.sensitivity;
+  if(!ParseCount(stage.Option("sensitivity", std::to_string(sensitivity)), 1, MAX_MOTION_SENSITIVITY, sensitivity) ||
+      !ParseCount(stage.Option("row_step", std::to_string(config.row_step)), 1, MAX_MOTION_ROW_STEP, config.row_step) ||
+      !ParseCount(stage.Option("pre_roll", std::to_string(config.pre_roll)), 0, MAX_MOTION_PRE_ROLL, config.pre_roll) ||
+      !ParseCount(stage.Option("post_roll", std::to_string(config.post_roll)), 0, MAX_MOTION_POST_ROLL, config.post_roll)) {
+    return false;
+  }
+  config.sensitivity = sensitivity;
+
+  std::string mode = stage.Option("mode", "drop");
+  if(mode != "drop" && mode != "mark") {
+    return false;
+  }
+  config.drop = mode == "drop";
+
+  return config.threshold > 0;
+}
+
+bool ParsePreviewScales(std::string list, std::vector<size_t>& scales) {
+  scales.clear();
+
+  std::stringstream stream(list);
+  std::string item;
+  while(std::getline(stream, item, ',')) {
+    size_t scale;
+    if(!ParseCount(item, 2, 8, scale) || (scale != 2 && scale != 4 && scale != 8)) {
+      return false;
+    }
+    scales.push_back(scale);
+  }
+
+  return !scales.empty();
+}
+
+bool ParseDemosaicMethod(std::string name, DemosaicMethod& method) {
+  for(DemosaicMethod candidate : { DemosaicMethod::Bilinear, DemosaicMethod::EdgeAware }) {
+    if(name == DemosaicMethodName(candidate)) {
+      method = candidate;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void RegisterBuiltinStages() {
+  Pipeline::RegisterStage("convert", [](const StageConfig& config, StageContext& context) -> Stage* {
+    DemosaicMethod method;
+    if(!ParseDemosaicMethod(config.Option("method", "bilinear"), method)) {
+      std::cout << "Error: stage " << config.name << " has unknown method " << config.Option("method") << std::endl;
+      return NULL;
+    }
+    return new ConvertStage(context.run, config.workers, method);
+  });
+
+  Pipeline::RegisterStage("record", [](const StageConfig& config, StageContext& context) -> Stage* {
+    if(config.Option("directory").empty()) {
+      std::cout << "Error: stage " << config.name << " needs a directory" << std::endl;
+      return NULL;
+    }
+    return new RecordStage(context.run, RecordingPath(config.Option("directory"), context.serial), context.serial);
+  });
+
+  Pipeline::RegisterStage("publish", [](const StageConfig& config, StageContext& context) -> Stage* {
+    std::string name = config.Option("name", PublishName(context.serial) + config.Option("suffix"));
+    if(name.empty() || name[0] != '/') {
+      std::cout << "Error: stage " << config.name << " needs a shared memory name starting with /" << std::endl;
+      return NULL;
+    }
+
+    size_t slots;
+    if(!ParseCount(config.Option("slots", std::to_string(ShmPublisher::DEFAULT_SLOTS)), ShmPublisher::MIN_SLOTS, ShmPublisher::MAX_SLOTS, slots)) {
+      std::cout << "Error: stage " << config.name << " needs slots from " << ShmPublisher::MIN_SLOTS << " to " << ShmPublisher::MAX_SLOTS << std::endl;
+      return NULL;
+    }
+    return new PublishStage(context.run, name, context.serial, slots);
+  });
+
+  Pipeline::RegisterStage("stats", [](const StageConfig& config, StageContext& context) -> Stage* {
+    int step = atoi(config.Option("step", "2").c_str());
+    int bits = atoi(config.Option("bits", "16").c_str());
+    if(step < 1 || bits < 8 || bits > 16) {
+      std::cout << "Error: stage " << config.name << " needs a step of at least 1 and bits from 8 to 16" << std::endl;
+      return NULL;
+    }
+    return new StatsStage(context.run, config.workers, step, bits);
+  });
+
+  Pipeline::RegisterStage("preview", [](const StageConfig& config, StageContext& context) -> Stage* {
+    std::vector<size_t> scales;
+    if(!ParsePreviewScales(config.Option("scales", "4"), scales)) {
+      std::cout << "Error: stage " << config.name << " needs scales from 2, 4 and 8, e.g. 2,8" << std::endl;
+      return NULL;
+    }
+    return new PreviewStage(context.run, scales, atof(config.Option("fps", "5").c_str()));
+  });
+
+  Pipeline::RegisterStage("motion", [](const StageConfig& config, StageContext& context) -> Stage* {
+    MotionConfig motion;
+    if(!ParseMotionConfig(config, motion)) {
+      std::cout << "Error: stage " << config.name << " needs a positive threshold, sensitivity from 1 to " << MAX_MOTION_SENSITIVITY <<
+          ", row_step from 1 to " << MAX_MOTION_ROW_STEP << ", pre_roll up to " << MAX_MOTION_PRE_ROLL <<
+          ", post_roll up to " << MAX_MOTION_POST_ROLL << " and mode drop or mark" << std::endl;
+      return NULL;
+    }
+    return new MotionStage(context.run, motion);
+  });
+}
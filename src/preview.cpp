@@ -0,0 +1,71 @@
+#include "preview.hpp"
+
+#include "demosaic_kernels.hpp"
+
+PreviewScaler::PreviewScaler(SimdLevel simd) :
+  simd( simd ) {}
+
+SimdLevel PreviewScaler::Simd() {
+  return simd;
+}
+
+bool PreviewScaler::Bin(const Frame& frame, uint8_t* output, size_t output_stride) {
+  size_t bytes_per_pixel = BytesPerPixel(frame.pixel_format);
+  if(frame.data == nullptr || frame.width < 2 || frame.height < 2 || (bytes_per_pixel != 1 && bytes_per_pixel != 2)) {
+    return false;
+  }
+
+  BinnedRow row;
+  row.tiles = frame.width / 2;
+  row.mono = !BayerPhase(frame.pixel_format, row.red_x, row.red_y);
+
+  for(size_t y = 0; y + 1 < frame.height; y += 2) {
+    row.top = frame.data + y * frame.stride;
+    row.bottom = row.top + frame.stride;
+    row.output = output + y / 2 * output_stride;
+
+    // most significant byte of little endian samples, both rows of the tiles
+    if(bytes_per_pixel == 2) {
+      narrowed.resize(2 * frame.width);
+      for(size_t half = 0; half < 2; half++) {
+        const uint16_t* samples = (const uint16_t*)(half == 0 ? row.top : row.bottom);
+        for(size_t x = 0; x < frame.width; x++) {
+          narrowed[half * frame.width + x] = samples[x] >> 8;
+        }
+      }
+      row.top = narrowed.data();
+      row.bottom = narrowed.data() + frame.width;
+    }
+
+    size_t tile = 0;
+    if(simd == SimdLevel::AVX2) {
+      tile = BinRowAVX2(row, tile);
+    }
+    if(simd >= SimdLevel::SSE41) {
+      tile = BinRowSSE41(row, tile);
+    }
+    for(; tile < row.tiles; tile++) {
+      BinTile(row, tile);
+    }
+  }
+
+  return true;
+}
+
+void PreviewScaler::Halve(const uint8_t* input, size_t width, size_t height, size_t input_stride, uint8_t* output, size_t output_stride) {
+  size_t output_width = width / 2;
+
+  for(size_t y = 0; y + 1 < height; y += 2) {
+    const uint8_t* top = input + y * input_stride;
+    const uint8_t* bottom = top + input_stride;
+    uint8_t* row = output + y / 2 * output_stride;
+
+    size_t x = 0;
+    if(simd >= SimdLevel::SSE41) {
+      x = HalveRowSSE41(top, bottom, row, x, output_width);
+    }
+    for(; x < output_width; x++) {
+      HalvePixel(top, bottom, row, x);
+    }
+  }
+}
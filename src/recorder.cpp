@@ -0,0 +1,286 @@
+#include "recorder.hpp"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include "clock.hpp"
+#include "log.hpp"
+
+static size_t AlignUp(size_t size, size_t alignment) {
+  return (size + alignment - 1) / alignment * alignment;
+}
+
+Recorder::Recorder(std::string path, std::string camera, size_t queue_size) :
+  path( path ),
+  camera( camera ),
+  queue( queue_size, OverflowPolicy::DropNewest ) {}
+
+Recorder::~Recorder() {
+  Stop();
+  free(chunk);
+}
+
+bool Recorder::Start() {
+  // page cache is bypassed when possible, not every file system supports it
+  fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | O_DIRECT, 0644);
+  direct_io = fd >= 0;
+
+  if(fd < 0 && errno == EINVAL) {
+    fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  }
+
+  if(fd < 0) {
+    LogError("cannot create recording {}: {}", path, strerror(errno));
+    return false;
+  }
+
+  if(!EnsureChunkSize(CHUNK_SIZE)) {
+    close(fd);
+    fd = -1;
+    return false;
+  }
+
+  // file header takes the first block
+  memset(chunk, 0, RECORDING_BLOCK_SIZE);
+  RecordingHeader* header = (RecordingHeader*)chunk;
+  header->magic = RECORDING_MAGIC;
+  header->version = RECORDING_VERSION;
+  header->block_size = RECORDING_BLOCK_SIZE;
+
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  header->created = (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+  strncpy(header->camera, camera.c_str(), sizeof(header->camera) - 1);
+
+  if(!WriteBlocks(chunk, RECORDING_BLOCK_SIZE)) {
+    close(fd);
+    fd = -1;
+    return false;
+  }
+
+  chunk_used = sizeof(ChunkHeader);
+  writer = std::thread(&Recorder::Write, this);
+
+  return true;
+}
+
+void Recorder::Stop() {
+  queue.Close();
+
+  if(writer.joinable()) {
+    writer.join();
+  }
+}
+
+bool Recorder::Record(const FramePtr& frame) {
+  if(failed.load() || queue.IsClosed()) {
+    return false;
+  }
+
+  return queue.Push(frame);
+}
+
+void Recorder::Write() {
+  FramePtr frame;
+
+  while(!queue.IsClosed() || !queue.Empty()) {
+    if(!queue.WaitPop(frame, QUEUE_WAIT_TIMEOUT)) {
+      continue;
+    }
+
+    // after a write error frames are only taken off the queue to release them
+    if(!failed.load() && Append(frame)) {
+      recorded++;
+    }
+
+    frame.reset();
+  }
+
+  if(!failed.load() && FlushChunk() && WriteIndex()) {
+    fdatasync(fd);
+  }
+
+  close(fd);
+  fd = -1;
+}
+
+bool Recorder::Append(const FramePtr& frame) {
+  size_t record_size = sizeof(RecordHeader) + AlignUp(frame->size, RECORD_ALIGNMENT);
+
+  if(chunk_used + record_size > chunk_capacity) {
+    if(!FlushChunk()) {
+      return false;
+    }
+
+    // frame larger than a whole chunk
+    if(!EnsureChunkSize(AlignUp(sizeof(ChunkHeader) + record_size, RECORDING_BLOCK_SIZE))) {
+      return false;
+    }
+  }
+
+  RecordHeader* record = (RecordHeader*)(chunk + chunk_used);
+  memset(record, 0, sizeof(RecordHeader));
+  record->magic = RECORD_MAGIC;
+  record->pixel_format = (uint32_t)frame->pixel_format;
+  record->id = frame->id;
+  record->grab_time = frame->grab_time;
+  record->offset = file_offset + chunk_used + sizeof(RecordHeader);
+  record->size = frame->size;
+  record->width = frame->width;
+  record->height = frame->height;
+  record->stride = frame->stride;
+
+  uint8_t* data = chunk + chunk_used + sizeof(RecordHeader);
+  memcpy(data, frame->data, frame->size);
+  memset(data + frame->size, 0, record_size - sizeof(RecordHeader) - frame->size);
+
+  index.push_back(*record);
+  chunk_used += record_size;
+  chunk_records++;
+
+  return true;
+}
+
+bool Recorder::FlushChunk() {
+  if(chunk_records == 0) {
+    return true;
+  }
+
+  size_t size = AlignUp(chunk_used, RECORDING_BLOCK_SIZE);
+  memset(chunk + chunk_used, 0, size - chunk_used);
+
+  ChunkHeader* header = (ChunkHeader*)chunk;
+  memset(header, 0, sizeof(ChunkHeader));
+  header->magic = CHUNK_MAGIC;
+  header->records = chunk_records;
+  header->size = size;
+
+  uint64_t start = MonotonicNow();
+  if(!WriteBlocks(chunk, size)) {
+    return false;
+  }
+  write_latency.Record(MonotonicNow() - start);
+
+  chunk_used = sizeof(ChunkHeader);
+  chunk_records = 0;
+
+  return true;
+}
+
+bool Recorder::WriteIndex() {
+  size_t index_size = index.size() * sizeof(RecordHeader);
+  size_t size = AlignUp(index_size + sizeof(IndexFooter), RECORDING_BLOCK_SIZE);
+
+  if(!EnsureChunkSize(size)) {
+    return false;
+  }
+
+  memset(chunk, 0, size);
+  if(index_size > 0) {
+    memcpy(chunk, index.data(), index_size);
+  }
+
+  // footer ends the file so readers find it without knowing the index size
+  IndexFooter* footer = (IndexFooter*)(chunk + size - sizeof(IndexFooter));
+  footer->magic = INDEX_MAGIC;
+  footer->index_offset = file_offset;
+  footer->records = index.size();
+
+  return WriteBlocks(chunk, size);
+}
+
+bool Recorder::WriteBlocks(const uint8_t* data, size_t size) {
+  size_t written = 0;
+
+  while(written < size) {
+    ssize_t result = pwrite(fd, data + written, size - written, file_offset + written);
+
+    if(result < 0 && errno == EINTR) {
+      continue;
+    }
+
+    // some file systems accept O_DIRECT on open but not on write
+    if(result < 0 && errno == EINVAL && direct_io) {
+      fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+      direct_io = false;
+      continue;
+    }
+
+    if(result <= 0) {
+      LogError("cannot write recording {}: {}", path, strerror(errno));
+      failed = true;
+      return false;
+    }
+
+    written += result;
+  }
+
+  file_offset += size;
+  bytes_written += size;
+
+  return true;
+}
+
+// grows chunk buffer, keeps what is already in it
+bool Recorder::EnsureChunkSize(size_t size) {
+  if(size <= chunk_capacity) {
+    return true;
+  }
+
+  void* buffer = NULL;
+  if(posix_memalign(&buffer, RECORDING_BLOCK_SIZE, size) != 0) {
+    LogError("cannot allocate {} bytes for recording", size);
+    failed = true;
+    return false;
+  }
+
+  if(chunk != nullptr) {
+    memcpy(buffer, chunk, chunk_used);
+    free(chunk);
+  }
+
+  chunk = (uint8_t*)buffer;
+  chunk_capacity = size;
+
+  return true;
+}
+
+std::string Recorder::Path() {
+  return path;
+}
+
+bool Recorder::DirectIO() {
+  return direct_io;
+}
+
+uint64_t Recorder::Recorded() {
+  return recorded.load();
+}
+
+uint64_t Recorder::Dropped() {
+  return queue.Dropped();
+}
+
+uint64_t Recorder::BytesWritten() {
+  return bytes_written.load();
+}
+
+bool Recorder::Failed() {
+  return failed.load();
+}
+
+LatencyHistogram& Recorder::WriteLatency() {
+  return write_latency;
+}
+
+void Recorder::WriteMetrics(MetricsWriter& metrics, std::string labels) {
+  metrics.Counter("capture_recorded_frames_total", "Frames written to the recording.", labels, Recorded());
+  metrics.Counter("capture_recording_dropped_total", "Frames dropped because the recording writer fell behind.", labels, Dropped());
+  metrics.Counter("capture_recording_bytes_total", "Bytes written to the recording.", labels, BytesWritten());
+  metrics.Gauge("capture_recording_queue_depth", "Frames waiting for the recording writer.", labels, queue.Size());
+  metrics.Gauge("capture_recording_failed", "1 when the recording stopped after a write error.", labels, Failed());
+  metrics.Summary("capture_recording_write_seconds", "Time to write one chunk.", labels, write_latency);
+}
@@ -0,0 +1,193 @@
+#include "recording_reader.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+RecordingReader::RecordingReader() {}
+
+RecordingReader::~RecordingReader() {
+  Close();
+}
+
+bool RecordingReader::Open(std::string path) {
+  Close();
+  this->path = path;
+
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if(fd < 0) {
+    std::cout << "Error: cannot open recording " << path << ": " << strerror(errno) << std::endl;
+    return false;
+  }
+
+  struct stat info;
+  if(fstat(fd, &info) < 0 || (size_t)info.st_size < RECORDING_BLOCK_SIZE) {
+    std::cout << "Error: " << path << " is not a recording" << std::endl;
+    close(fd);
+    return false;
+  }
+
+  // mapping stays valid after the descriptor is closed
+  void* mapping = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+
+  if(mapping == MAP_FAILED) {
+    std::cout << "Error: cannot map recording " << path << ": " << strerror(errno) << std::endl;
+    return false;
+  }
+
+  data = (const uint8_t*)mapping;
+  size = info.st_size;
+
+  const RecordingHeader* header = (const RecordingHeader*)data;
+  if(header->magic != RECORDING_MAGIC || header->version != RECORDING_VERSION) {
+    std::cout << "Error: " << path << " is not a recording" << std::endl;
+    Close();
+    return false;
+  }
+
+  camera = std::string(header->camera, strnlen(header->camera, sizeof(header->camera)));
+
+  indexed = LoadIndex();
+  if(!indexed && !ScanChunks()) {
+    Close();
+    return false;
+  }
+
+  // frames are read in order most of the time
+  madvise(mapping, size, MADV_SEQUENTIAL);
+
+  return true;
+}
+
+void RecordingReader::Close() {
+  if(data != nullptr) {
+    munmap((void*)data, size);
+  }
+
+  data = nullptr;
+  size = 0;
+  records = nullptr;
+  record_count = 0;
+  scanned.clear();
+  camera.clear();
+  indexed = false;
+}
+
+bool RecordingReader::LoadIndex() {
+  const IndexFooter* footer = (const IndexFooter*)(data + size - sizeof(IndexFooter));
+
+  // offset is checked before it is subtracted, a corrupt one would wrap around
+  if(footer->magic != INDEX_MAGIC || footer->index_offset < RECORDING_BLOCK_SIZE ||
+      footer->index_offset > size - sizeof(IndexFooter) ||
+      footer->index_offset % RECORD_ALIGNMENT != 0 ||
+      footer->records > (size - sizeof(IndexFooter) - footer->index_offset) / sizeof(RecordHeader)) {
+    return false;
+  }
+
+  records = (const RecordHeader*)(data + footer->index_offset);
+  record_count = footer->records;
+
+  for(size_t i = 0; i < record_count; i++) {
+    if(!ValidRecord(records[i])) {
+      records = nullptr;
+      record_count = 0;
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool RecordingReader::ScanChunks() {
+  std::cout << "Recording " << path << " has no index, scanning chunks" << std::endl;
+
+  size_t offset = RECORDING_BLOCK_SIZE;
+
+  // stop at the first chunk which was not written completely
+  while(offset + sizeof(ChunkHeader) <= size) {
+    const ChunkHeader* chunk = (const ChunkHeader*)(data + offset);
+    if(chunk->magic != CHUNK_MAGIC || chunk->size < sizeof(ChunkHeader) || chunk->size > size - offset) {
+      break;
+    }
+
+    size_t record_offset = offset + sizeof(ChunkHeader);
+    for(uint32_t i = 0; i < chunk->records; i++) {
+      if(record_offset + sizeof(RecordHeader) > offset + chunk->size) {
+        break;
+      }
+
+      const RecordHeader* record = (const RecordHeader*)(data + record_offset);
+      if(!ValidRecord(*record) || record->offset != record_offset + sizeof(RecordHeader)) {
+        break;
+      }
+
+      scanned.push_back(*record);
+      record_offset += sizeof(RecordHeader) + (record->size + RECORD_ALIGNMENT - 1) / RECORD_ALIGNMENT * RECORD_ALIGNMENT;
+    }
+
+    offset += chunk->size;
+  }
+
+  records = scanned.data();
+  record_count = scanned.size();
+
+  return true;
+}
+
+bool RecordingReader::ValidRecord(const RecordHeader& record) {
+  return record.magic == RECORD_MAGIC && record.offset <= size && record.size <= size - record.offset;
+}
+
+size_t RecordingReader::Frames() {
+  return record_count;
+}
+
+std::string RecordingReader::CameraSerial() {
+  return camera;
+}
+
+bool RecordingReader::Indexed() {
+  return indexed;
+}
+
+bool RecordingReader::Read(size_t index, Frame& frame) {
+  if(index >= record_count) {
+    return false;
+  }
+
+  const RecordHeader& record = records[index];
+
+  frame = Frame();
+  frame.data = (uint8_t*)(data + record.offset);
+  frame.size = record.size;
+  frame.width = record.width;
+  frame.height = record.height;
+  frame.stride = record.stride;
+  frame.pixel_format = (PixelFormat)record.pixel_format;
+  frame.id = record.id;
+  frame.grab_time = record.grab_time;
+
+  return true;
+}
+
+const RecordHeader& RecordingReader::Record(size_t index) {
+  return records[index];
+}
+
+size_t RecordingReader::FindId(uint64_t id) {
+  const RecordHeader* found = std::lower_bound(records, records + record_count, id,
+      [](const RecordHeader& record, uint64_t id) { return record.id < id; });
+  return found - records;
+}
+
+size_t RecordingReader::FindTime(uint64_t grab_time) {
+  const RecordHeader* found = std::lower_bound(records, records + record_count, grab_time,
+      [](const RecordHeader& record, uint64_t grab_time) { return record.grab_time < grab_time; });
+  return found - records;
+}
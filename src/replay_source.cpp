@@ -0,0 +1,110 @@
+#include "replay_source.hpp"
+
+#include <cstring>
+#include <time.h>
+#include "clock.hpp"
+#include "log.hpp"
+
+ReplaySource::ReplaySource(std::atomic<bool>& run, std::string path, double speed, bool loop) :
+  FrameSource( run, FRAME_POOL_SIZE ),
+  path( path ),
+  speed( speed ),
+  loop( loop ) {
+  open = reader.Open(path);
+}
+
+bool ReplaySource::IsOpen() {
+  return open;
+}
+
+void ReplaySource::Capture(FrameQueue<FramePtr>& capture_queue) {
+  RegisterCaptureStart();
+
+  if(!open || reader.Frames() == 0) {
+    LogInfo("Nothing to replay from {}", path);
+    return;
+  }
+
+  while(run) {
+    // recorded grab times are mapped onto host time once per pass
+    uint64_t pass_begin = MonotonicNow();
+    uint64_t recording_begin = reader.Record(0).grab_time;
+
+    for(size_t i = 0; i < reader.Frames() && run; i++) {
+      if(speed > 0) {
+        uint64_t recorded = reader.Record(i).grab_time - recording_begin;
+        WaitUntil(pass_begin + (uint64_t)(recorded / speed));
+      }
+
+      // corrupt records are left out and counted as incomplete frames
+      FramePtr frame;
+      if(Load(i, frame)) {
+        Deliver(frame, MonotonicNow(), capture_queue);
+      }
+      else {
+        RegisterIncompleteFrame();
+        LogWarning("Skipping invalid record {} of {}", i, path);
+      }
+      RegisterFrameCapture();
+    }
+
+    if(!loop) {
+      LogInfo("Replay of {} finished", path);
+      break;
+    }
+  }
+}
+
+// rows must fit in what was recorded, otherwise every consumer reads past the frame
+static bool ValidLayout(const Frame& frame) {
+  size_t bytes = BytesPerPixel(frame.pixel_format);
+  return bytes != 0 && frame.width > 0 && frame.height > 0 &&
+      frame.width <= frame.stride / bytes && frame.stride <= frame.size / frame.height;
+}
+
+bool ReplaySource::Load(size_t index, FramePtr& frame) {
+  Frame recorded;
+
+  if(!reader.Read(index, recorded) || !ValidLayout(recorded)) {
+    return false;
+  }
+
+  if(frame_pool.Reserve(recorded.size)) {
+    frame = frame_pool.Acquire();
+  }
+
+  if(frame) {
+    memcpy(frame->data, recorded.data, recorded.size);
+    frame->size = recorded.size;
+    frame->width = recorded.width;
+    frame->height = recorded.height;
+    frame->stride = recorded.stride;
+    frame->pixel_format = recorded.pixel_format;
+  }
+
+  // no pool buffer is counted as missed once delivered
+  return true;
+}
+
+// sleeps in slices so gaps in the recording do not hold up shutdown
+void ReplaySource::WaitUntil(uint64_t deadline) {
+  while(run) {
+    uint64_t now = MonotonicNow();
+    if(now >= deadline) {
+      return;
+    }
+
+    uint64_t wake_time = deadline - now > MAX_SLEEP ? now + MAX_SLEEP : deadline;
+
+    struct timespec wake;
+    wake.tv_sec = wake_time / 1000000000ULL;
+    wake.tv_nsec = wake_time % 1000000000ULL;
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL);
+  }
+}
+
+std::string ReplaySource::Serial() {
+  // file name tells replays apart, several of them may come from one camera
+  size_t slash = path.find_last_of('/');
+  return "replay:" + (slash == std::string::npos ? path : path.substr(slash + 1));
+}
@@ -0,0 +1,32 @@
+#include "roi_profile.hpp"
+
+static RoiProfile MakeProfile(std::string name, double width, double height, int binning, int decimation) {
+  RoiProfile profile;
+  profile.name = name;
+  profile.width = width;
+  profile.height = height;
+  profile.binning = binning;
+  profile.decimation = decimation;
+  return profile;
+}
+
+std::vector<RoiProfile> RoiProfiles() {
+  return {
+    MakeProfile("full", 1, 1, 1, 1),
+    MakeProfile("center-half", 0.5, 0.5, 1, 1),
+    MakeProfile("center-quarter", 0.25, 0.25, 1, 1),
+    MakeProfile("bin2", 1, 1, 2, 1),
+    MakeProfile("decimate2", 1, 1, 1, 2),
+  };
+}
+
+bool FindRoiProfile(const std::vector<RoiProfile>& profiles, std::string name, size_t& index) {
+  for(size_t i = 0; i < profiles.size(); i++) {
+    if(profiles[i].name == name) {
+      index = i;
+      return true;
+    }
+  }
+
+  return false;
+}
@@ -0,0 +1,141 @@
+#include "scheduling.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <pthread.h>
+#include <sched.h>
+#include <sstream>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+static bool PinNativeThread(pthread_t thread, int cpu) {
+  if(cpu < 0 || cpu >= CPU_SETSIZE) {
+    return false;
+  }
+
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  CPU_SET(cpu, &cpu_set);
+
+  int result = pthread_setaffinity_np(thread, sizeof(cpu_set), &cpu_set);
+  if(result != 0) {
+    std::cout << "Cannot pin thread to cpu " << cpu << ": error " << result << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+bool PinThread(std::thread& thread, int cpu) {
+  return PinNativeThread(thread.native_handle(), cpu);
+}
+
+bool PinCurrentThread(int cpu) {
+  return PinNativeThread(pthread_self(), cpu);
+}
+
+bool PinCurrentThreadToCpus(std::vector<int> cpus) {
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+
+  for(int cpu : cpus) {
+    if(cpu >= 0 && cpu < CPU_SETSIZE) {
+      CPU_SET(cpu, &cpu_set);
+    }
+  }
+
+  if(CPU_COUNT(&cpu_set) == 0) {
+    return false;
+  }
+
+  int result = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+  if(result != 0) {
+    std::cout << "Cannot pin thread to cpus: error " << result << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+std::vector<int> OtherCpus(std::vector<int> cpus) {
+  std::vector<int> others;
+
+  for(int cpu = 0; cpu < CpuCount(); cpu++) {
+    if(std::find(cpus.begin(), cpus.end(), cpu) == cpus.end()) {
+      others.push_back(cpu);
+    }
+  }
+
+  return others;
+}
+
+bool SetRealtimePriority(std::thread& thread, int priority) {
+  struct sched_param param;
+  param.sched_priority = priority;
+
+  int result = pthread_setschedparam(thread.native_handle(), SCHED_FIFO, &param);
+  if(result != 0) {
+    std::cout << "Cannot set SCHED_FIFO priority " << priority << ": " << strerror(result) << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+bool LockAllMemory() {
+  // with a limited memlock budget MCL_FUTURE would make later allocations fail
+  struct rlimit limit;
+  int flags = MCL_CURRENT;
+  if(getrlimit(RLIMIT_MEMLOCK, &limit) == 0 && limit.rlim_cur == RLIM_INFINITY) {
+    flags |= MCL_FUTURE;
+  }
+  else {
+    std::cout << "memlock limit is not unlimited, only memory mapped so far is locked" << std::endl;
+  }
+
+  if(mlockall(flags) != 0) {
+    std::cout << "Cannot lock memory: " << strerror(errno) << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+std::vector<int> ParseCpuList(std::string cpu_list) {
+  std::vector<int> cpus;
+  std::stringstream stream(cpu_list);
+  std::string item;
+
+  while(std::getline(stream, item, ',')) {
+    if(item.empty()) {
+      continue;
+    }
+
+    size_t dash = item.find('-');
+
+    try {
+      if(dash == std::string::npos) {
+        cpus.push_back(std::stoi(item));
+      }
+      else {
+        int first = std::stoi(item.substr(0, dash));
+        int last = std::stoi(item.substr(dash + 1));
+        for(int cpu = first; cpu <= last; cpu++) {
+          cpus.push_back(cpu);
+        }
+      }
+    }
+    catch (std::exception &e) {
+      std::cout << "Invalid cpu list entry: " << item << std::endl;
+    }
+  }
+
+  return cpus;
+}
+
+int CpuCount() {
+  int count = std::thread::hardware_concurrency();
+  return count > 0 ? count : 1;
+}
@@ -0,0 +1,171 @@
+#include "shm_publisher.hpp"
+
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <new>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "clock.hpp"
+#include "log.hpp"
+
+static size_t AlignUp(size_t size, size_t alignment) {
+  return (size + alignment - 1) / alignment * alignment;
+}
+
+// readers live in other processes, so the futex is not private
+static void WakeReaders(ShmHeader* header) {
+  header->notify.fetch_add(1, std::memory_order_release);
+  syscall(SYS_futex, &header->notify, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+ShmPublisher::ShmPublisher(std::string name, std::string camera, size_t slot_count) :
+  name( name ),
+  camera( camera ),
+  slot_count( slot_count > 0 ? slot_count : DEFAULT_SLOTS ) {}
+
+// readers drop the segment once they see the state, the mapping goes away
+static void Retire(ShmHeader* header, ShmState state) {
+  header->state.store(state, std::memory_order_release);
+  WakeReaders(header);
+  munmap(header, header->segment_size);
+}
+
+ShmPublisher::~ShmPublisher() {
+  if(header != nullptr) {
+    Retire(header, SHM_CLOSED);
+    shm_unlink(name.c_str());
+  }
+}
+
+bool ShmPublisher::Create(size_t frame_size) {
+  size_t slot_size = AlignUp(frame_size, SHM_PAGE_SIZE);
+  size_t data_offset = SHM_PAGE_SIZE + AlignUp(slot_count * sizeof(ShmSlot), SHM_PAGE_SIZE);
+  size_t size = data_offset + slot_count * slot_size;
+
+  // leftover of a crashed run or the segment being replaced, readers holding
+  // it keep their mapping
+  shm_unlink(name.c_str());
+
+  int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+  if(fd < 0) {
+    LogError("cannot create shared memory {}: {}", name, strerror(errno));
+    return false;
+  }
+
+  if(ftruncate(fd, size) != 0) {
+    LogError("cannot size shared memory {}: {}", name, strerror(errno));
+    close(fd);
+    shm_unlink(name.c_str());
+    return false;
+  }
+
+  void* mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+  close(fd);
+
+  if(mapping == MAP_FAILED) {
+    LogError("cannot map shared memory {}: {}", name, strerror(errno));
+    shm_unlink(name.c_str());
+    return false;
+  }
+
+  segment = (uint8_t*)mapping;
+  header = new (segment) ShmHeader();
+  slots = (ShmSlot*)(segment + SHM_PAGE_SIZE);
+  for(size_t i = 0; i < slot_count; i++) {
+    new (&slots[i]) ShmSlot();
+    slots[i].sequence.store(0, std::memory_order_relaxed);
+  }
+
+  header->version = SHM_VERSION;
+  header->slot_count = slot_count;
+  header->slot_size = slot_size;
+  header->data_offset = data_offset;
+  header->segment_size = size;
+  strncpy(header->camera, camera.c_str(), sizeof(header->camera) - 1);
+  header->state.store(SHM_LIVE, std::memory_order_relaxed);
+  header->published.store(0, std::memory_order_relaxed);
+  header->notify.store(0, std::memory_order_relaxed);
+
+  // readers trust the rest of the header once they see the magic
+  std::atomic_thread_fence(std::memory_order_release);
+  header->magic = SHM_MAGIC;
+
+  sequence = 0;
+  segment_size = size;
+
+  return true;
+}
+
+bool ShmPublisher::Publish(const Frame& frame) {
+  if(header == nullptr || frame.size > header->slot_size) {
+    // a failed segment is not retried for every frame
+    uint64_t now = MonotonicNow();
+    if(last_create != 0 && now - last_create < CREATE_RETRY_INTERVAL) {
+      failed++;
+      return false;
+    }
+    last_create = now;
+
+    // the new segment holds the name before readers are sent off the old one
+    ShmHeader* previous = header;
+    if(!Create(frame.size)) {
+      failed++;
+      return false;
+    }
+
+    if(previous != nullptr) {
+      Retire(previous, SHM_REPLACED);
+      replaced++;
+    }
+  }
+
+  size_t index = sequence % slot_count;
+  ShmSlot& slot = slots[index];
+
+  // odd sequence tells readers the slot is being overwritten
+  slot.sequence.store(2 * sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  slot.pixel_format = (uint32_t)frame.pixel_format;
+  slot.width = frame.width;
+  slot.height = frame.height;
+  slot.stride = frame.stride;
+  slot.size = frame.size;
+  slot.id = frame.id;
+  slot.grab_time = frame.grab_time;
+  slot.sensor_time = frame.sensor_time;
+  memcpy(segment + header->data_offset + index * header->slot_size, frame.data, frame.size);
+  slot.publish_time = MonotonicNow();
+
+  slot.sequence.store(2 * sequence + 2, std::memory_order_release);
+  sequence++;
+  header->published.store(sequence, std::memory_order_release);
+  WakeReaders(header);
+
+  published++;
+  return true;
+}
+
+std::string ShmPublisher::Name() {
+  return name;
+}
+
+uint64_t ShmPublisher::Published() {
+  return published.load();
+}
+
+uint64_t ShmPublisher::Failed() {
+  return failed.load();
+}
+
+uint64_t ShmPublisher::Replaced() {
+  return replaced.load();
+}
+
+size_t ShmPublisher::SegmentSize() {
+  return segment_size.load();
+}
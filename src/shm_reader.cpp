@@ -0,0 +1,249 @@
+#include "shm_reader.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include "clock.hpp"
+
+ShmReader::ShmReader() {}
+
+ShmReader::~ShmReader() {
+  Close();
+}
+
+bool ShmReader::Open(std::string name) {
+  Close();
+  this->name = name;
+
+  if(!Map()) {
+    return false;
+  }
+
+  // only frames published from now on
+  next = header->published.load(std::memory_order_acquire);
+  return true;
+}
+
+void ShmReader::Close() {
+  Unmap();
+}
+
+bool ShmReader::IsOpen() {
+  return header != nullptr;
+}
+
+bool ShmReader::Map() {
+  int fd = shm_open(name.c_str(), O_RDONLY | O_CLOEXEC, 0);
+  if(fd < 0) {
+    return false;
+  }
+
+  struct stat status;
+  if(fstat(fd, &status) != 0 || (size_t)status.st_size < SHM_PAGE_SIZE) {
+    close(fd);
+    return false;
+  }
+
+  void* mapping = mmap(NULL, status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+
+  if(mapping == MAP_FAILED) {
+    return false;
+  }
+
+  segment = (const uint8_t*)mapping;
+  segment_size = status.st_size;
+  segment_inode = status.st_ino;
+  header = (const ShmHeader*)segment;
+
+  // the publisher writes the magic last
+  bool valid = header->magic == SHM_MAGIC;
+  std::atomic_thread_fence(std::memory_order_acquire);
+
+  // a replaced or closed segment may still hold the name for a moment
+  valid = valid && header->state.load(std::memory_order_acquire) == SHM_LIVE && header->version == SHM_VERSION && header->segment_size == segment_size && header->slot_count > 0 &&
+      header->data_offset + header->slot_count * header->slot_size <= segment_size;
+
+  if(!valid) {
+    Unmap();
+    return false;
+  }
+
+  slots = (const ShmSlot*)(segment + SHM_PAGE_SIZE);
+  return true;
+}
+
+void ShmReader::Unmap() {
+  if(segment != nullptr) {
+    munmap((void*)segment, segment_size);
+  }
+
+  segment = nullptr;
+  segment_size = 0;
+  header = nullptr;
+  slots = nullptr;
+  last_slot = nullptr;
+}
+
+// a publisher which died without closing leaves its segment live, the name
+// then points to a new segment or to none
+bool ShmReader::Abandoned() {
+  int fd = shm_open(name.c_str(), O_RDONLY | O_CLOEXEC, 0);
+  if(fd < 0) {
+    return true;
+  }
+
+  struct stat status;
+  bool abandoned = fstat(fd, &status) != 0 || status.st_ino != segment_inode;
+  close(fd);
+
+  return abandoned;
+}
+
+bool ShmReader::Next(Frame& frame, uint64_t& publish_time, int64_t timeout_us) {
+  uint64_t deadline = timeout_us < 0 ? 0 : MonotonicNow() + (uint64_t)timeout_us * 1000;
+
+  while(true) {
+    // follow the publisher to a replaced or restarted segment, frames left in
+    // the old one are given up
+    if(header == nullptr || header->state.load(std::memory_order_acquire) != SHM_LIVE) {
+      bool was_open = header != nullptr;
+      Unmap();
+
+      // a replacing segment is read from its start, a first one from now on
+      if(Map()) {
+        reopened += was_open ? 1 : 0;
+        next = was_open ? 0 : header->published.load(std::memory_order_acquire);
+        continue;
+      }
+    }
+    else {
+      // notify first, a frame published after it wakes the futex wait below
+      uint32_t notify = header->notify.load(std::memory_order_acquire);
+      uint64_t published = header->published.load(std::memory_order_acquire);
+
+      // overwritten frames are skipped, reading resumes at the oldest one left
+      if(published - next > header->slot_count) {
+        missed += published - header->slot_count - next;
+        next = published - header->slot_count;
+      }
+
+      if(next < published) {
+        uint64_t number = next++;
+        if(TakeFrame(number, frame, publish_time)) {
+          read++;
+          return true;
+        }
+
+        missed++;
+        continue;
+      }
+
+      if(WaitForPublish(notify, deadline)) {
+        continue;
+      }
+
+      if(Abandoned()) {
+        Unmap();
+        continue;
+      }
+    }
+
+    if(timeout_us >= 0 && MonotonicNow() >= deadline) {
+      return false;
+    }
+
+    // nothing mapped, wait for a publisher to show up
+    if(header == nullptr) {
+      usleep(REOPEN_INTERVAL);
+    }
+  }
+}
+
+bool ShmReader::TakeFrame(uint64_t number, Frame& frame, uint64_t& publish_time) {
+  const ShmSlot& slot = slots[number % header->slot_count];
+  uint64_t sequence = 2 * number + 2;
+
+  if(slot.sequence.load(std::memory_order_acquire) != sequence) {
+    return false;
+  }
+
+  frame = Frame();
+  frame.data = (uint8_t*)segment + header->data_offset + (number % header->slot_count) * header->slot_size;
+  frame.size = slot.size;
+  frame.width = slot.width;
+  frame.height = slot.height;
+  frame.stride = slot.stride;
+  frame.pixel_format = (PixelFormat)slot.pixel_format;
+  frame.id = slot.id;
+  frame.grab_time = slot.grab_time;
+  frame.sensor_time = slot.sensor_time;
+  publish_time = slot.publish_time;
+
+  // metadata is only consistent when the slot did not move on meanwhile
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if(slot.sequence.load(std::memory_order_relaxed) != sequence || frame.size > header->slot_size) {
+    return false;
+  }
+
+  last_slot = &slot;
+  last_sequence = sequence;
+  return true;
+}
+
+// true when woken by the publisher, false after an idle slice or at the deadline
+bool ShmReader::WaitForPublish(uint32_t notify, uint64_t deadline) {
+  uint64_t slice = (uint64_t)REOPEN_INTERVAL * 1000;
+  if(deadline != 0) {
+    uint64_t now = MonotonicNow();
+    if(now >= deadline) {
+      return false;
+    }
+    slice = std::min(slice, deadline - now);
+  }
+
+  struct timespec timeout;
+  timeout.tv_sec = slice / 1000000000ULL;
+  timeout.tv_nsec = slice % 1000000000ULL;
+
+  // shared futex, the publisher is another process; returns right away when
+  // notify already moved on
+  syscall(SYS_futex, &header->notify, FUTEX_WAIT, notify, &timeout, NULL, 0);
+
+  return header->notify.load(std::memory_order_acquire) != notify;
+}
+
+bool ShmReader::Intact() {
+  if(last_slot == nullptr) {
+    return false;
+  }
+
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return last_slot->sequence.load(std::memory_order_relaxed) == last_sequence;
+}
+
+std::string ShmReader::Name() {
+  return name;
+}
+
+std::string ShmReader::CameraSerial() {
+  return header != nullptr ? std::string(header->camera, strnlen(header->camera, sizeof(header->camera))) : std::string();
+}
+
+uint64_t ShmReader::Read() {
+  return read;
+}
+
+uint64_t ShmReader::Missed() {
+  return missed;
+}
+
+uint64_t ShmReader::Reopened() {
+  return reopened;
+}
@@ -0,0 +1,157 @@
+#include "synthetic_source.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <time.h>
+#include <unistd.h>
+#include "clock.hpp"
+
+bool ParseSyntheticConfig(std::string spec, SyntheticConfig& config) {
+  unsigned long width = 0;
+  unsigned long height = 0;
+  double fps = config.fps;
+
+  int fields = sscanf(spec.c_str(), "%lux%lu@%lf", &width, &height, &fps);
+  if(fields < 2 || width < 2 || height < 2 || fps < 0) {
+    return false;
+  }
+
+  config.width = width;
+  config.height = height;
+  config.fps = fps;
+
+  return true;
+}
+
+SyntheticSource::SyntheticSource(std::atomic<bool>& run, SyntheticConfig config) :
+  FrameSource( run, FRAME_POOL_SIZE ),
+  config( config ),
+  stride( config.width * BytesPerPixel(config.pixel_format) ) {
+  for(size_t i = 0; i < PATTERN_FRAMES; i++) {
+    patterns.push_back(std::vector<uint8_t>(stride * config.height));
+    RenderPattern(patterns.back().data(), config.width, config.height, stride, config.pixel_format, i);
+  }
+}
+
+void SyntheticSource::RenderPattern(uint8_t* data, size_t width, size_t height, size_t stride,
+    PixelFormat pixel_format, size_t phase) {
+  // position of the red sample within the 2x2 Bayer tile
+  size_t red_x = 0;
+  size_t red_y = 0;
+  switch(pixel_format) {
+    case PixelFormat::BayerGR8:
+    case PixelFormat::BayerGR16:
+      red_x = 1;
+      break;
+    case PixelFormat::BayerGB8:
+    case PixelFormat::BayerGB16:
+      red_y = 1;
+      break;
+    case PixelFormat::BayerBG8:
+    case PixelFormat::BayerBG16:
+      red_x = 1;
+      red_y = 1;
+      break;
+    default:
+      break;
+  }
+
+  bool bayer = IsBayer(pixel_format);
+  bool wide = BytesPerPixel(pixel_format) == 2;
+  size_t bar_width = width / PATTERN_FRAMES > 0 ? width / PATTERN_FRAMES : 1;
+  size_t bar_begin = phase % PATTERN_FRAMES * bar_width;
+
+  for(size_t y = 0; y < height; y++) {
+    uint8_t* row = data + y * stride;
+
+    for(size_t x = 0; x < width; x++) {
+      uint8_t red = x * 255 / (width - 1);
+      uint8_t green = y * 255 / (height - 1);
+      uint8_t blue = 255 - red;
+
+      // white bar moving to the right from frame to frame
+      if(x >= bar_begin && x < bar_begin + bar_width) {
+        red = green = blue = 255;
+      }
+
+      uint8_t value;
+      if(!bayer) {
+        value = (red + green + blue) / 3;
+      }
+      else if((y & 1) == red_y) {
+        value = (x & 1) == red_x ? red : green;
+      }
+      else {
+        value = (x & 1) == red_x ? green : blue;
+      }
+
+      if(wide) {
+        ((uint16_t*)row)[x] = value << 8;
+      }
+      else {
+        row[x] = value;
+      }
+    }
+  }
+}
+
+void SyntheticSource::Capture(FrameQueue<FramePtr>& capture_queue) {
+  RegisterCaptureStart();
+
+  uint64_t interval = config.fps > 0 ? 1e9 / config.fps : 0;
+  uint64_t deadline = MonotonicNow();
+
+  while(run) {
+    if(interval > 0) {
+      deadline += interval;
+
+      struct timespec wake;
+      wake.tv_sec = deadline / 1000000000ULL;
+      wake.tv_nsec = deadline % 1000000000ULL;
+      while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL) != 0 && run) {
+      }
+
+      // more than a frame behind, like a camera we skip instead of bursting
+      uint64_t now = MonotonicNow();
+      if(now > deadline + interval) {
+        deadline = now;
+      }
+    }
+
+    FramePtr frame = Generate();
+
+    // unpaced, wait for the pipeline to give back a buffer instead of counting a miss
+    if(!frame && interval == 0) {
+      usleep(POOL_WAIT);
+      continue;
+    }
+
+    Deliver(frame, MonotonicNow(), capture_queue);
+    RegisterFrameCapture();
+  }
+}
+
+FramePtr SyntheticSource::Generate() {
+  FramePtr frame;
+
+  if(frame_pool.Reserve(stride * config.height)) {
+    frame = frame_pool.Acquire();
+  }
+
+  if(frame) {
+    memcpy(frame->data, patterns[next_pattern].data(), stride * config.height);
+    frame->size = stride * config.height;
+    frame->width = config.width;
+    frame->height = config.height;
+    frame->stride = stride;
+    frame->pixel_format = config.pixel_format;
+  }
+
+  next_pattern = (next_pattern + 1) % patterns.size();
+
+  return frame;
+}
+
+std::string SyntheticSource::Serial() {
+  return config.name;
+}
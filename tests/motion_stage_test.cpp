@@ -0,0 +1,106 @@
+// Checks that a motion stage holding its pre-roll through a still scene does
+// not keep lent camera buffers, which would starve the camera of buffers and
+// block a reconnect after unplugging, and that the held copies still go out
+// ahead of the next motion event.
+//
+// Exits with non-zero status when a check fails.
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include "pipeline_stages.hpp"
+
+static const size_t WIDTH = 64;
+static const size_t HEIGHT = 48;
+static const size_t PRE_ROLL = 4;
+static const size_t STILL_FRAMES = 12;
+
+// counts driver buffers the stage has not given back yet
+static std::atomic<int> lent_frames{0};
+
+// frame standing in for a driver buffer the camera lends out
+static FramePtr LentFrame(uint64_t id, uint8_t value) {
+  std::vector<uint8_t>* buffer = new std::vector<uint8_t>(WIDTH * HEIGHT, value);
+
+  Frame* frame = new Frame();
+  frame->data = buffer->data();
+  frame->size = buffer->size();
+  frame->width = WIDTH;
+  frame->height = HEIGHT;
+  frame->stride = WIDTH;
+  frame->pixel_format = PixelFormat::Mono8;
+  frame->id = id;
+  frame->zero_copy = true;
+
+  lent_frames++;
+  return FramePtr(frame, [buffer](Frame* frame) {
+    delete frame;
+    delete buffer;
+    lent_frames--;
+  });
+}
+
+// workers let go of their input right after counting it processed
+static bool WaitFor(std::function<bool()> condition) {
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while(!condition()) {
+    if(std::chrono::steady_clock::now() > deadline) {
+      return false;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  return true;
+}
+
+static bool Check(bool condition, const char* what) {
+  std::cout << (condition ? "ok    " : "FAIL  ") << what << std::endl;
+  return condition;
+}
+
+int main() {
+  std::atomic<bool> run{true};
+  FrameQueue<FramePtr> input(STILL_FRAMES + 1, OverflowPolicy::Block);
+  FrameQueue<FramePtr> output(STILL_FRAMES + 1, OverflowPolicy::Block);
+
+  MotionConfig config;
+  config.pre_roll = PRE_ROLL;
+  config.post_roll = 0;
+
+  MotionStage stage(run, config);
+  stage.AddOutput(&output);
+  stage.Start(input);
+
+  bool passed = true;
+
+  for(uint64_t id = 1; id <= STILL_FRAMES; id++) {
+    input.Push(LentFrame(id, 0));
+  }
+
+  passed &= Check(WaitFor([&]() { return stage.Processed() == STILL_FRAMES; }), "still frames processed");
+  passed &= Check(output.Size() == 0, "still frames held back");
+  passed &= Check(WaitFor([]() { return lent_frames == 0; }), "held pre-roll keeps no lent buffers");
+
+  input.Push(LentFrame(STILL_FRAMES + 1, 255));
+  passed &= Check(WaitFor([&]() { return stage.Processed() == STILL_FRAMES + 1; }), "motion frame processed");
+
+  // the last still frames come first, then the frame with motion
+  bool ordered = output.Size() == PRE_ROLL + 1;
+  for(uint64_t id = STILL_FRAMES - PRE_ROLL + 1; ordered && id <= STILL_FRAMES + 1; id++) {
+    FramePtr frame;
+    ordered = output.Pop(frame) && frame->id == id && frame->width == WIDTH && frame->height == HEIGHT &&
+        frame->data[0] == (id > STILL_FRAMES ? 255 : 0);
+  }
+  passed &= Check(ordered, "pre-roll passed on ahead of motion");
+
+  run = false;
+  input.Close();
+  stage.Join();
+
+  passed &= Check(lent_frames == 0, "every lent buffer given back");
+
+  return passed ? 0 : 1;
+}
@@ -0,0 +1,70 @@
+// Sends one command to a running capture over its control socket and prints
+// the reply, e.g. `capture_control exposure 2000` or `capture_control stats`.
+//
+// With -l the time from sending the command to its acknowledgement is
+// printed as well.
+
+#include <iostream>
+#include <string>
+#include <unistd.h>
+#include "clock.hpp"
+#include "control_client.hpp"
+
+static void PrintUsage(char* name) {
+  std::cout << "Usage: " << name << " [-u socket] [-l] command [arguments]" << std::endl;
+  std::cout << "  -u socket  control socket of capture (default: " << DefaultControlSocket() << ")" << std::endl;
+  std::cout << "  -l         print how long the acknowledgement took" << std::endl;
+  std::cout << "  commands are listed by `" << name << " help`" << std::endl;
+}
+
+int main(int argc, char **argv) {
+  std::string path = DefaultControlSocket();
+  bool latency = false;
+
+  int option;
+  while((option = getopt(argc, argv, "u:lh")) != -1) {
+    switch(option) {
+      case 'u':
+        path = optarg;
+        break;
+      case 'l':
+        latency = true;
+        break;
+      default:
+        PrintUsage(argv[0]);
+        return 1;
+    }
+  }
+
+  if(optind >= argc) {
+    PrintUsage(argv[0]);
+    return 1;
+  }
+
+  std::string command = argv[optind];
+  for(int i = optind + 1; i < argc; i++) {
+    command += std::string(" ") + argv[i];
+  }
+
+  ControlClient client;
+  if(!client.Connect(path)) {
+    std::cout << "Error: cannot connect to " << path << std::endl;
+    return 1;
+  }
+
+  std::string reply;
+  uint64_t start = MonotonicNow();
+  bool ok = client.Send(command, reply);
+  uint64_t elapsed = MonotonicNow() - start;
+
+  if(!ok) {
+    std::cout << "Error: " << (client.IsConnected() ? reply : "no reply from " + path) << std::endl;
+    return 1;
+  }
+
+  std::cout << reply;
+  if(latency) {
+    std::cout << "acknowledged in " << elapsed / 1000.0 << " us" << std::endl;
+  }
+  return 0;
+}
@@ -0,0 +1,122 @@
+// Sample consumer of frames published to shared memory by capture -x.
+//
+// Follows one camera, touches every frame the way a real consumer would and
+// prints once per second how many frames it read, missed or found
+// overwritten while reading, along with publish to read and grab to read
+// latency percentiles.
+
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <signal.h>
+#include <string>
+#include <unistd.h>
+#include "clock.hpp"
+#include "histogram.hpp"
+#include "shm_format.hpp"
+#include "shm_reader.hpp"
+
+static volatile sig_atomic_t run = 1;
+
+static void HandleSigInt(int sig) {
+  run = 0;
+}
+
+// sum of one row in the middle, stands in for real processing
+static uint64_t TouchFrame(const Frame& frame) {
+  if(frame.height == 0) {
+    return 0;
+  }
+
+  const uint8_t* row = frame.data + frame.height / 2 * frame.stride;
+  uint64_t sum = 0;
+  for(size_t x = 0; x < frame.stride; x++) {
+    sum += row[x];
+  }
+  return sum;
+}
+
+static void PrintUsage(char* name) {
+  std::cout << "Usage: " << name << " [-s serial | -n name] [-t seconds]" << std::endl;
+  std::cout << "  -s serial   camera to follow, as published by capture -x (default: camera)" << std::endl;
+  std::cout << "  -n name     shared memory name instead of a serial number" << std::endl;
+  std::cout << "  -t seconds  stop after this long (default: until CTRL+c)" << std::endl;
+}
+
+int main(int argc, char **argv) {
+  std::string name = std::string(SHM_NAME_PREFIX) + "camera";
+  double seconds = 0;
+
+  int option;
+  while((option = getopt(argc, argv, "s:n:t:h")) != -1) {
+    switch(option) {
+      case 's':
+        name = std::string(SHM_NAME_PREFIX) + optarg;
+        break;
+      case 'n':
+        name = optarg;
+        break;
+      case 't':
+        seconds = atof(optarg);
+        break;
+      default:
+        PrintUsage(argv[0]);
+        return 1;
+    }
+  }
+
+  signal(SIGINT, HandleSigInt);
+
+  ShmReader reader;
+  if(!reader.Open(name)) {
+    std::cout << "waiting for " << name << std::endl;
+  }
+
+  uint64_t end = seconds > 0 ? MonotonicNow() + seconds * 1e9 : 0;
+  uint64_t second_begin = MonotonicNow();
+  uint64_t overwritten = 0;
+
+  // keeps the row sums from being optimized away
+  volatile uint64_t checksum = 0;
+  std::unique_ptr<LatencyHistogram> publish_latency(new LatencyHistogram());
+  std::unique_ptr<LatencyHistogram> grab_latency(new LatencyHistogram());
+
+  while(run && (end == 0 || MonotonicNow() < end)) {
+    Frame frame;
+    uint64_t publish_time;
+
+    if(reader.Next(frame, publish_time, 100 * 1000)) {
+      uint64_t now = MonotonicNow();
+      publish_latency->Record(now - publish_time);
+      if(frame.grab_time != 0) {
+        grab_latency->Record(now - frame.grab_time);
+      }
+
+      checksum += TouchFrame(frame);
+      if(!reader.Intact()) {
+        overwritten++;
+      }
+    }
+
+    if(MonotonicNow() - second_begin >= 1000000000ULL) {
+      std::cout << reader.Name() <<
+          " camera: " << reader.CameraSerial() <<
+          ", read: " << reader.Read() <<
+          ", missed: " << reader.Missed() <<
+          ", overwritten while read: " << overwritten <<
+          ", reopened: " << reader.Reopened() <<
+          ", publish to read p50/p99/p999 us: " << publish_latency->Percentile(0.5) / 1000.0 <<
+          "/" << publish_latency->Percentile(0.99) / 1000.0 <<
+          "/" << publish_latency->Percentile(0.999) / 1000.0 <<
+          ", grab to read p50/p99 us: " << grab_latency->Percentile(0.5) / 1000.0 <<
+          "/" << grab_latency->Percentile(0.99) / 1000.0 << std::endl;
+
+      publish_latency.reset(new LatencyHistogram());
+      grab_latency.reset(new LatencyHistogram());
+      second_begin = MonotonicNow();
+    }
+  }
+
+  return 0;
+}